@@ -0,0 +1,25 @@
+# Timing helpers of the benchmark scripts, each of them sources this file.
+
+# Run time of a command in milliseconds, its output goes to the file given first. Returns the exit status
+# of the command; the scripts timing programs do not check it, the LLVM IR main returns void.
+milliseconds() {
+    local output=$1 start end status
+    shift
+    start=$(date +%s%N)
+    "$@" > "$output"
+    status=$?
+    end=$(date +%s%N)
+    echo $(( (end - start) / 1000000 ))
+    return $status
+}
+
+# Average time of a command over $RUNS runs in milliseconds, its output is discarded
+average_milliseconds() {
+    local start end
+    start=$(date +%s%N)
+    for ((run = 0; run < RUNS; run++)); do
+        "$@" > /dev/null 2>&1
+    done
+    end=$(date +%s%N)
+    echo $(( (end - start) / RUNS / 1000000 ))
+}
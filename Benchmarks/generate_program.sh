@@ -0,0 +1,33 @@
+#!/bin/bash
+# Prints a program of n functions (default 2000) for measuring the compiler and the LLVM tools on large
+# inputs. Every function loops, branches, divides and calls the one before it, main calls the last one.
+# usage: Benchmarks/generate_program.sh [n]
+
+COUNT=${1:-2000}
+
+echo "int f0(int a, int b) {"
+echo "    return a + b;"
+echo "}"
+for ((i = 1; i < COUNT; i++)); do
+    cat <<FUNCTION
+int f$i(int a, int b) {
+    int s = 0;
+    int k = 0;
+    while (k < a) {
+        if (k / 3 * 3 == k) {
+            s = s + b * k;
+        } else {
+            s = s - k / (b + 1);
+        }
+        k = k + 1;
+    }
+    if (s > 1000) {
+        print("f$i large");
+    }
+    return s + f$((i - 1))(a, b + $((i % 7)));
+}
+FUNCTION
+done
+echo "void main() {"
+echo "    printi(f$((COUNT - 1))(5, 3));"
+echo "}"
@@ -0,0 +1,34 @@
+#!/bin/bash
+# Compiles every benchmark twice, with the options on its "// options:" line (default options without one)
+# and with the options on its "// baseline:" line, builds both with llc and the system C compiler,
+# checks that the outputs agree and prints the run times.
+# usage: Benchmarks/run_benchmarks.sh [path to hw5]
+
+HW5=${1:-./hw5}
+BENCH_DIR=$(dirname "$0")
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+source "$BENCH_DIR/common.sh"
+
+status=0
+for bench in "$BENCH_DIR"/Benchmark_*.in; do
+    name=$(basename "$bench" .in)
+    optimized_flags=$(sed -n 's|^// options:||p' "$bench")
+    baseline_flags=$(sed -n 's|^// baseline:||p' "$bench")
+    for variant in optimized baseline; do
+        flags=$optimized_flags
+        [ "$variant" = baseline ] && flags=$baseline_flags
+        "$HW5" $flags < "$bench" > "$WORK_DIR/$variant.ll" || exit 1
+        llc -O2 "$WORK_DIR/$variant.ll" -o "$WORK_DIR/$variant.s" || exit 1
+        cc -no-pie "$WORK_DIR/$variant.s" -o "$WORK_DIR/$variant" || exit 1
+    done
+    optimized=$(milliseconds "$WORK_DIR/optimized.out" "$WORK_DIR/optimized")
+    baseline=$(milliseconds "$WORK_DIR/baseline.out" "$WORK_DIR/baseline")
+    if ! cmp -s "$WORK_DIR/optimized.out" "$WORK_DIR/baseline.out"; then
+        echo "$name: outputs differ"
+        status=1
+        continue
+    fi
+    printf "%s%s: %s ms (baseline%s: %s ms)\n" "$name" "$optimized_flags" "$optimized" "$baseline_flags" "$baseline"
+done
+exit $status
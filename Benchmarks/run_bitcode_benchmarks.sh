@@ -0,0 +1,36 @@
+#!/bin/bash
+# Writes every benchmark and a generated program of many functions as LLVM IR text and as bitcode
+# (hw5 --target=llvm-bc), checks that llvm-dis prints the same module for the bitcode as for the text
+# assembled by llvm-as, and prints the sizes and the time opt takes to load and verify either form.
+# usage: Benchmarks/run_bitcode_benchmarks.sh [path to hw5] [runs per measurement]
+
+HW5=${1:-./hw5}
+RUNS=${2:-10}
+BENCH_DIR=$(dirname "$0")
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+source "$BENCH_DIR/common.sh"
+
+# The module without the lines naming the file it was read from
+disassemble() {
+    llvm-dis "$1" -o - | grep -v -e '^; ModuleID' -e '^source_filename'
+}
+
+"$BENCH_DIR/generate_program.sh" 150 > "$WORK_DIR/Generated_150_Functions.in"
+
+status=0
+for bench in "$BENCH_DIR"/Benchmark_*.in "$WORK_DIR/Generated_150_Functions.in"; do
+    name=$(basename "$bench" .in)
+    "$HW5" < "$bench" > "$WORK_DIR/program.ll" && "$HW5" --target=llvm-bc < "$bench" > "$WORK_DIR/program.bc" \
+        && llvm-as "$WORK_DIR/program.ll" -o "$WORK_DIR/reference.bc" || exit 1
+    if ! cmp -s <(disassemble "$WORK_DIR/program.bc") <(disassemble "$WORK_DIR/reference.bc"); then
+        echo "$name: bitcode differs from the text"
+        status=1
+        continue
+    fi
+    text_load=$(average_milliseconds opt -disable-output "$WORK_DIR/program.ll")
+    bitcode_load=$(average_milliseconds opt -disable-output "$WORK_DIR/program.bc")
+    printf "%s: bitcode %s bytes, loaded in %s ms (text: %s bytes, loaded in %s ms)\n" "$name" \
+        "$(wc -c < "$WORK_DIR/program.bc")" "$bitcode_load" "$(wc -c < "$WORK_DIR/program.ll")" "$text_load"
+done
+exit $status
@@ -0,0 +1,39 @@
+#!/bin/bash
+# Builds every benchmark through the C backend (hw5 --target=c, cc -O2) and through the LLVM IR
+# (hw5 with its default options, llc -O2, cc), checks that the outputs agree and prints the build and
+# run times of both.
+# usage: Benchmarks/run_c_benchmarks.sh [path to hw5]
+
+HW5=${1:-./hw5}
+BENCH_DIR=$(dirname "$0")
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+source "$BENCH_DIR/common.sh"
+
+build_c() {
+    "$HW5" --target=c < "$1" > "$WORK_DIR/program.c" && cc -std=c99 -O2 "$WORK_DIR/program.c" -o "$WORK_DIR/c"
+}
+
+build_llvm() {
+    "$HW5" < "$1" > "$WORK_DIR/program.ll" && llc -O2 "$WORK_DIR/program.ll" -o "$WORK_DIR/program.s" \
+        && cc -no-pie "$WORK_DIR/program.s" -o "$WORK_DIR/llvm"
+}
+
+status=0
+for bench in "$BENCH_DIR"/Benchmark_*.in; do
+    name=$(basename "$bench" .in)
+    rm -f "$WORK_DIR/c" "$WORK_DIR/llvm"
+    c_build=$(milliseconds /dev/null build_c "$bench")
+    llvm_build=$(milliseconds /dev/null build_llvm "$bench")
+    [ -x "$WORK_DIR/c" ] && [ -x "$WORK_DIR/llvm" ] || exit 1
+    c_run=$(milliseconds "$WORK_DIR/c.out" "$WORK_DIR/c")
+    llvm_run=$(milliseconds "$WORK_DIR/llvm.out" "$WORK_DIR/llvm")
+    if ! cmp -s "$WORK_DIR/c.out" "$WORK_DIR/llvm.out"; then
+        echo "$name: outputs differ"
+        status=1
+        continue
+    fi
+    printf "%s: c %s ms, built in %s ms (llvm: %s ms, built in %s ms)\n" \
+        "$name" "$c_run" "$c_build" "$llvm_run" "$llvm_build"
+done
+exit $status
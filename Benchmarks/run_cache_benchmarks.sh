@@ -0,0 +1,26 @@
+#!/bin/bash
+# Compiles a generated program of many functions without the compilation cache, once more with an empty
+# cache (a miss that stores the result) and again (a hit), checks that all three write the same module and
+# prints the compile times and the cache statistics.
+# usage: Benchmarks/run_cache_benchmarks.sh [path to hw5] [number of functions]
+
+HW5=${1:-./hw5}
+COUNT=${2:-2000}
+BENCH_DIR=$(dirname "$0")
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+source "$BENCH_DIR/common.sh"
+
+"$BENCH_DIR/generate_program.sh" "$COUNT" > "$WORK_DIR/program.in"
+
+uncached=$(milliseconds "$WORK_DIR/uncached.ll" "$HW5" < "$WORK_DIR/program.in") || exit 1
+miss=$(milliseconds "$WORK_DIR/miss.ll" "$HW5" --cache-dir="$WORK_DIR/cache" < "$WORK_DIR/program.in") || exit 1
+hit=$(milliseconds "$WORK_DIR/hit.ll" "$HW5" --cache-dir="$WORK_DIR/cache" --cache-stats < "$WORK_DIR/program.in" \
+    2> "$WORK_DIR/stats.txt") || exit 1
+
+if ! cmp -s "$WORK_DIR/uncached.ll" "$WORK_DIR/miss.ll" || ! cmp -s "$WORK_DIR/uncached.ll" "$WORK_DIR/hit.ll"; then
+    echo "$COUNT functions: the cached module differs from the compiled one"
+    exit 1
+fi
+printf "%s functions: %s ms without the cache, %s ms on a miss, %s ms on a hit\n" "$COUNT" "$uncached" "$miss" "$hit"
+cat "$WORK_DIR/stats.txt"
@@ -0,0 +1,32 @@
+#!/bin/bash
+# Compiles a generated program of many functions without an incremental state, once more with an empty
+# state, again unchanged, and after editing the string one function in the middle prints. Checks that every
+# incremental compilation writes the module a full compilation writes and prints the compile times and
+# the reused functions.
+# usage: Benchmarks/run_incremental_benchmarks.sh [path to hw5] [number of functions]
+
+HW5=${1:-./hw5}
+COUNT=${2:-2000}
+BENCH_DIR=$(dirname "$0")
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+source "$BENCH_DIR/common.sh"
+
+"$BENCH_DIR/generate_program.sh" "$COUNT" > "$WORK_DIR/program.in"
+sed "s/\"f$((COUNT / 2)) large\"/\"f$((COUNT / 2)) edited\"/" "$WORK_DIR/program.in" > "$WORK_DIR/edited.in"
+"$HW5" < "$WORK_DIR/edited.in" > "$WORK_DIR/edited.ll" || exit 1
+
+full=$(milliseconds "$WORK_DIR/full.ll" "$HW5" < "$WORK_DIR/program.in") || exit 1
+empty=$(milliseconds "$WORK_DIR/empty.ll" "$HW5" --incremental="$WORK_DIR/state" < "$WORK_DIR/program.in") || exit 1
+unchanged=$(milliseconds "$WORK_DIR/unchanged.ll" "$HW5" --incremental="$WORK_DIR/state" < "$WORK_DIR/program.in") || exit 1
+edit=$(milliseconds "$WORK_DIR/incremental.ll" "$HW5" --incremental="$WORK_DIR/state" --incremental-stats \
+    < "$WORK_DIR/edited.in" 2> "$WORK_DIR/stats.txt") || exit 1
+
+if ! cmp -s "$WORK_DIR/full.ll" "$WORK_DIR/empty.ll" || ! cmp -s "$WORK_DIR/full.ll" "$WORK_DIR/unchanged.ll" \
+    || ! cmp -s "$WORK_DIR/edited.ll" "$WORK_DIR/incremental.ll"; then
+    echo "$COUNT functions: the incremental module differs from the compiled one"
+    exit 1
+fi
+printf "%s functions: %s ms without a state, %s ms with an empty state, %s ms unchanged, %s ms after one edit\n" \
+    "$COUNT" "$full" "$empty" "$unchanged" "$edit"
+cat "$WORK_DIR/stats.txt"
@@ -0,0 +1,30 @@
+#!/bin/bash
+# Compiles a generated program of many functions with llc as one module and as shards (hw5 --shards=n,
+# one shard per core) compiled in parallel, checks that the linked shards print what the single module
+# prints and prints the llc times.
+# usage: Benchmarks/run_shard_benchmarks.sh [path to hw5] [number of functions]
+
+HW5=${1:-./hw5}
+COUNT=${2:-2000}
+BENCH_DIR=$(dirname "$0")
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+source "$BENCH_DIR/common.sh"
+CORES=$(nproc)
+
+"$BENCH_DIR/generate_program.sh" "$COUNT" > "$WORK_DIR/program.in"
+"$HW5" < "$WORK_DIR/program.in" > "$WORK_DIR/program.ll" || exit 1
+"$HW5" --shards="$CORES" --shard-dir="$WORK_DIR/shards" < "$WORK_DIR/program.in" || exit 1
+modules=$(grep -v '^#' "$WORK_DIR/shards/manifest.txt" | cut -f1 | sed "s|^|$WORK_DIR/shards/|")
+
+single=$(milliseconds /dev/null llc -relocation-model=pic -filetype=obj "$WORK_DIR/program.ll" -o "$WORK_DIR/program.o") || exit 1
+sharded=$(milliseconds /dev/null xargs -P "$CORES" -I {} llc -relocation-model=pic -filetype=obj {} -o {}.o <<< "$modules") \
+    || exit 1
+
+cc "$WORK_DIR/program.o" -o "$WORK_DIR/single" && cc $(echo "$modules" | sed 's|$|.o|') -o "$WORK_DIR/sharded" || exit 1
+if ! cmp -s <("$WORK_DIR/single") <("$WORK_DIR/sharded"); then
+    echo "$COUNT functions: the linked shards print something else than the single module"
+    exit 1
+fi
+printf "%s functions: llc %s ms for one module, %s ms for %s modules on %s cores\n" "$COUNT" "$single" "$sharded" \
+    "$(echo "$modules" | wc -l)" "$CORES"
@@ -0,0 +1,32 @@
+#!/bin/bash
+# Compiles generated programs of many functions with 1, 2, 4, ... threads up to the number of cores,
+# checks that every thread count writes the same module as a single thread and prints the compile times.
+# usage: Benchmarks/run_thread_benchmarks.sh [path to hw5] [runs per measurement]
+
+HW5=${1:-./hw5}
+RUNS=${2:-3}
+BENCH_DIR=$(dirname "$0")
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+source "$BENCH_DIR/common.sh"
+CORES=$(nproc)
+
+compile() {
+    "$HW5" "--threads=$1" < "$2"
+}
+
+status=0
+for count in 1000 4000; do
+    program="$WORK_DIR/Generated_${count}_Functions.in"
+    "$BENCH_DIR/generate_program.sh" "$count" > "$program"
+    compile 1 "$program" > "$WORK_DIR/reference.ll" || exit 1
+    for ((threads = 1; threads <= CORES; threads *= 2)); do
+        if ! cmp -s <(compile "$threads" "$program") "$WORK_DIR/reference.ll"; then
+            echo "$count functions: output with $threads threads differs from 1 thread"
+            status=1
+            continue
+        fi
+        printf "%s functions, %s threads: %s ms\n" "$count" "$threads" "$(average_milliseconds compile "$threads" "$program")"
+    done
+done
+exit $status
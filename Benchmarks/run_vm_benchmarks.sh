@@ -0,0 +1,26 @@
+#!/bin/bash
+# Runs every benchmark in the bytecode virtual machine (hw5 --vm) and with lli on the generated LLVM IR,
+# checks that the outputs agree and prints both run times. The times include loading the program:
+# lli compiles the IR before running it, the virtual machine parses and lowers the source.
+# usage: Benchmarks/run_vm_benchmarks.sh [path to hw5]
+
+HW5=${1:-./hw5}
+BENCH_DIR=$(dirname "$0")
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+source "$BENCH_DIR/common.sh"
+
+status=0
+for bench in "$BENCH_DIR"/Benchmark_*.in; do
+    name=$(basename "$bench" .in)
+    "$HW5" < "$bench" > "$WORK_DIR/program.ll" || exit 1
+    vm=$(milliseconds "$WORK_DIR/vm.out" "$HW5" --vm < "$bench")
+    lli=$(milliseconds "$WORK_DIR/lli.out" lli "$WORK_DIR/program.ll")
+    if ! cmp -s "$WORK_DIR/vm.out" "$WORK_DIR/lli.out"; then
+        echo "$name: outputs differ"
+        status=1
+        continue
+    fi
+    printf "%s: vm %s ms (lli: %s ms)\n" "$name" "$vm" "$lli"
+done
+exit $status
@@ -4,9 +4,23 @@
 #include "visitor.hpp"
 #include "symbolTable.hpp"
 #include "output.hpp"
+#include "compilerOptions.hpp"
+#include "loopAnalyzer.hpp"
+#include "constantPropagation.hpp"
+#include "callGraph.hpp"
+#include "functionEffects.hpp"
+#include "memoization.hpp"
+#include "functionSpecializer.hpp"
+#include "threadPool.hpp"
+#include "functionFingerprint.hpp"
+#include "incrementalState.hpp"
 #include <string>
 #include <stdexcept>
 #include <vector>
+#include <unordered_map>
+#include <set>
+#include <memory>
+#include <sstream>
 #include <iostream>
 
 
@@ -25,6 +39,10 @@ define void @print(i8*) { \n\
     ret void \n\
 }\n";
 
+// A single message constant for the division error blocks of all functions
+const string DIVISION_ERROR_MESSAGE = "Error division by zero";
+const string DIVISION_ERROR_STRING = "@.division_error";
+
 using namespace std;
 using namespace ast;
 
@@ -63,21 +81,175 @@ static BuiltInType binOp_ResultType(Exp& left, Exp& right, SymbolTable& symbolTa
     }
 }
 
+/* ProgramAnalyses struct
+ * Whole-program facts the generators of the single functions share. The specializer decides only
+ * between the batches of functions, every other analysis is read-only (or, for the compile-time calls,
+ * locked) while the functions are generated.
+ */
+struct ProgramAnalyses {
+    CallGraph callGraph;
+    FunctionEffects effects;
+    Memoization memoization;
+    // Compile-time results of pure calls with constant arguments
+    PureCallEvaluator pureCalls;
+    FunctionSpecializer specializer;
+};
+
+/* FunctionTask struct
+ * A function to generate: a function of the program under its name (or its ".compute" name when it is
+ * memoized), the memoization wrapper of a function, or a clone with bound parameters.
+ */
+struct FunctionTask {
+    FuncDecl* function = nullptr;
+    string name;
+    map<string, int32_t> boundParameters;
+    bool isWrapper = false;
+};
+
+/* SpecializationRequest struct
+ * A call the specializer may redirect to a clone. Whether it does depends on the calls decided before
+ * it, possibly in functions other threads generate, so the call is emitted to a placeholder callee with
+ * the non-constant arguments only, and is settled when the module is put together in source order.
+ */
+struct SpecializationRequest {
+    string function;
+    vector<ConstantValue> arguments;
+    bool isInLoop = false;
+    // "@f.request0(", unique within the generated function
+    string placeholder;
+    string operands;
+    // Operands of the call of the function itself, with the constant arguments as literals
+    string unspecializedOperands;
+};
+
+/* GeneratedFunction struct
+ * The code of one task in a buffer of its own and what the module needs to know about it.
+ */
+struct GeneratedFunction {
+    output::CodeBuffer code;
+    vector<SpecializationRequest> requests;
+    LoopAnalyzer loops;
+    int divisionGuards = 0;
+    int elidedDivisionGuards = 0;
+    int failingDivisions = 0;
+    set<string> calledRuntimeFunctions;
+    bool usesDivisionError = false;
+
+    // The code, the calls that may go to clones and the runtime the function needs, for the incremental
+    // state. The loops and the division counts are only reported, a compilation that reports them does not
+    // read functions back.
+    void save(ostream& os) {
+        code.save(os);
+        os << requests.size() << "\n";
+        for (const SpecializationRequest& request : requests) {
+            output::writeText(os, request.function);
+            os << request.arguments.size();
+            for (const ConstantValue& argument : request.arguments) {
+                os << " " << argument.kind << " " << argument.value;
+            }
+            os << " " << request.isInLoop << "\n";
+            output::writeText(os, request.placeholder);
+            output::writeText(os, request.operands);
+            output::writeText(os, request.unspecializedOperands);
+        }
+        os << calledRuntimeFunctions.size() << "\n";
+        for (const string& function : calledRuntimeFunctions) {
+            output::writeText(os, function);
+        }
+        os << usesDivisionError << "\n";
+    }
+
+    bool load(istream& is) {
+        size_t count = 0;
+        if (!code.load(is) || !(is >> count)) {
+            return false;
+        }
+        requests.resize(count);
+        for (SpecializationRequest& request : requests) {
+            size_t arguments = 0;
+            if (!output::readText(is, request.function) || !(is >> arguments)) {
+                return false;
+            }
+            request.arguments.resize(arguments);
+            for (ConstantValue& argument : request.arguments) {
+                int kind = 0;
+                if (!(is >> kind >> argument.value)) {
+                    return false;
+                }
+                argument.kind = static_cast<ConstantValue::Kind>(kind);
+            }
+            if (!(is >> request.isInLoop) || is.get() != '\n' || !output::readText(is, request.placeholder)
+                || !output::readText(is, request.operands) || !output::readText(is, request.unspecializedOperands)) {
+                return false;
+            }
+        }
+        if (!(is >> count) || is.get() != '\n') {
+            return false;
+        }
+        for (size_t function = 0; function < count; ++function) {
+            string name;
+            if (!output::readText(is, name)) {
+                return false;
+            }
+            calledRuntimeFunctions.insert(name);
+        }
+        return static_cast<bool>(is >> usesDivisionError);
+    }
+};
+
 class CodeGenerator : public Visitor {
 private:
     output::CodeBuffer codeBuffer;
     SymbolTable symbolTable;
     string tabs = "";
+    CompilerOptions options;
+    LoopAnalyzer loopAnalyzer;
+    string currentFunction;
+    // Constants of the function being generated, on every path and across loops
+    ConstantPropagation constants;
+    shared_ptr<ProgramAnalyses> analyses;
+    // Parameters of the function being generated that a specialization binds to constants
+    map<string, int32_t> boundParameters;
+    // LLVM number of the next parameter the generated function takes
+    int nextParameter = 0;
+    // Weight of the taken side of a branch that is almost always taken
+    static const int64_t LIKELY_BRANCH_WEIGHT = 2000;
+    // Label of the division error block of the function being generated, undefined until a division needs it
+    output::Value divisionErrorLabel;
+    bool usesDivisionError = false;
+    // Divisions with a runtime zero check, with a divisor proven non-zero and with a divisor proven zero
+    int divisionGuards = 0;
+    int elidedDivisionGuards = 0;
+    int failingDivisions = 0;
+    // Calls of the function being generated that may go to clones
+    vector<SpecializationRequest> specializationRequests;
+    // Runtime functions (print, printi, exit) the generated code calls
+    set<string> calledRuntimeFunctions;
+    // Registers of the loop invariant expressions computed in the preheaders of the loops being generated
+    unordered_map<const Exp*, RegisterStruct> hoistedValues;
+    // Functions of the last compilation that are read back instead of generated, none without --incremental
+    IncrementalState* incremental = nullptr;
+    map<string, string> fingerprints;
 
 public:
     // SemanticAnalyzer(SymbolTable* symbolTable)
     //     : symbolTable(symbolTable) {}
-    CodeGenerator() : codeBuffer(), symbolTable() {}
+    explicit CodeGenerator(const CompilerOptions& options = CompilerOptions())
+        : codeBuffer(), symbolTable(), options(options), loopAnalyzer(options.unrollBudget, options.unroll, options.hoistInvariants),
+          analyses(make_shared<ProgramAnalyses>()) {}
+
+    // A generator of single functions (see generate), one per thread of the module generation
+    CodeGenerator(const CompilerOptions& options, const shared_ptr<ProgramAnalyses>& analyses, const Funcs& program)
+        : codeBuffer(), symbolTable(), options(options), loopAnalyzer(options.unrollBudget, options.unroll, options.hoistInvariants),
+          analyses(analyses) {
+        declareFunctions(program);
+        this->constants.setCallEvaluator(&this->analyses->pureCalls);
+    }
 
-    void CodeGenerator_beginScope(string scopeName = "", bool isLoopScope = false, string condition_Label = "", string done_Label = "") {
+    void CodeGenerator_beginScope(string scopeName = "", bool isLoopScope = false, output::Value condition_Label = output::Value(), output::Value done_Label = output::Value()) {
         if (!isLoopScope && symbolTable.getCurrentScope()->isInLoopScope()) {
-            string conditionLabelPrev = symbolTable.getCurrentScope()->getConditionLabel();
-            string doneLabelPrev = symbolTable.getCurrentScope()->getDoneLabel();
+            output::Value conditionLabelPrev = symbolTable.getCurrentScope()->getConditionLabel();
+            output::Value doneLabelPrev = symbolTable.getCurrentScope()->getDoneLabel();
             symbolTable.beginScope(true, scopeName);
             symbolTable.getCurrentScope()->setConditionLabel(conditionLabelPrev);
             symbolTable.getCurrentScope()->setDoneLabel(doneLabelPrev);
@@ -98,10 +270,196 @@ public:
         tabs = tabs.substr(0, tabs.size() - 1);
     }
 
+    // Known value of and/or: a left operand proven constant may decide the result on its own (lazy evaluation)
+    static void setLogicalOpKnownValue(RegisterStruct& result, const RegisterStruct& left, const RegisterStruct& right, bool isOr) {
+        const bool isLeftProven = left.isRegisterValueKnown && left.isRegisterValueProven;
+        const bool isRightProven = right.isRegisterValueKnown && right.isRegisterValueProven;
+        const bool leftValue = 0 != left.registerValue;
+        const bool rightValue = 0 != right.registerValue;
+        if (isLeftProven && leftValue == isOr) {
+            result.setRegisterValue(true, isOr ? 1 : 0);
+            result.isRegisterValueProven = true;
+        } else if (isLeftProven && isRightProven) {
+            result.setRegisterValue(true, (isOr ? (leftValue || rightValue) : (leftValue && rightValue)) ? 1 : 0);
+            result.isRegisterValueProven = true;
+        } else {
+            result.setRegisterValue(false);
+            result.isRegisterValueProven = false;
+        }
+    }
+
+    // The single assignment a branch of an if consists of, looking through braces, or null
+    static shared_ptr<Assign> singleAssign(const shared_ptr<Statement>& statement) {
+        shared_ptr<Statement> current = statement;
+        shared_ptr<Statements> block = dynamic_pointer_cast<Statements>(current);
+        while (block && block->getStatements().size() == 1) {
+            current = block->getStatements().front();
+            block = dynamic_pointer_cast<Statements>(current);
+        }
+        return dynamic_pointer_cast<Assign>(current);
+    }
+
+    // An expression that may be evaluated even when its branch is not taken: no calls, no short circuit
+    // and no division that could hit a zero divisor
+    static bool isSpeculatable(const shared_ptr<Exp>& exp) {
+        if (dynamic_pointer_cast<Num>(exp) || dynamic_pointer_cast<NumB>(exp)
+            || dynamic_pointer_cast<Bool>(exp) || dynamic_pointer_cast<ID>(exp)) {
+            return true;
+        }
+        if (shared_ptr<BinOp> binOp = dynamic_pointer_cast<BinOp>(exp)) {
+            if (binOp->getOp() == BinOpType::DIV) {
+                shared_ptr<Exp> divisor = binOp->getRight();
+                bool isLiteral = dynamic_pointer_cast<Num>(divisor) || dynamic_pointer_cast<NumB>(divisor);
+                if (!isLiteral || 0 == divisor->getValueInt()) {
+                    return false;
+                }
+            }
+            return isSpeculatable(binOp->getLeft()) && isSpeculatable(binOp->getRight());
+        }
+        if (shared_ptr<RelOp> relOp = dynamic_pointer_cast<RelOp>(exp)) {
+            return isSpeculatable(relOp->getLeft()) && isSpeculatable(relOp->getRight());
+        }
+        if (shared_ptr<Not> notExp = dynamic_pointer_cast<Not>(exp)) {
+            return isSpeculatable(notExp->getExpr());
+        }
+        if (shared_ptr<Cast> cast = dynamic_pointer_cast<Cast>(exp)) {
+            return isSpeculatable(cast->getExpr());
+        }
+        return false;
+    }
+
+    // Value of a variable use. A variable the constant propagation proves constant on every path
+    // is not loaded at all, its value is known like a literal.
+    RegisterStruct loadVariable(Exp& id) {
+        RegisterStruct valueReg{this->codeBuffer.freshVar(), false};
+        const ConstantValue value = this->constants.valueOf(id);
+        if (value.isConstant()) {
+            this->codeBuffer << tabs << valueReg.name << " = add i32 " << value.value << ", 0" << endl;
+            valueReg.setRegisterValue(true, value.value);
+            valueReg.isRegisterValueProven = true;
+        } else {
+            RegisterStruct varReg = this->symbolTable.getRegFromSymTable(id.getValueStr());
+            this->codeBuffer << tabs << valueReg.name << " = load i32, i32* " << varReg.name << endl;
+            valueReg.setRegisterValue(false);
+        }
+        return valueReg;
+    }
+
+    // Register holding the value of an already visited expression, identifiers are loaded first
+    RegisterStruct expressionValue(Exp& exp) {
+        if (NODE_ID != exp.getType()) {
+            return exp.getRegister();
+        }
+        return loadVariable(exp);
+    }
+
+    // Evaluates a boolean expression into an i1 register for a conditional branch
+    // A condition the constant propagation proves constant is known like a literal one
+    RegisterStruct generateCondition(Exp& condition) {
+        RegisterStruct conditionReg{this->codeBuffer.freshVar(), true};
+        condition.accept(*this);
+        RegisterStruct tmpReg = expressionValue(condition);
+        this->codeBuffer << tabs << conditionReg.name << " = trunc i32 " << tmpReg.name << " to i1" << endl;
+        conditionReg.setRegisterValue(tmpReg.isRegisterValueKnown, tmpReg.getRegisterValue());
+        conditionReg.isRegisterValueProven = tmpReg.isRegisterValueProven;
+        const ConstantValue value = this->constants.valueOf(condition);
+        if (value.isConstant()) {
+            conditionReg.setRegisterValue(true, value.value);
+            conditionReg.isRegisterValueProven = true;
+        }
+        return conditionReg;
+    }
+
+    // if (c) x = a; else x = b;  ->  x = select c, a, b
+    // Both values are computed up front, which removes the branches and their mispredictions
+    bool generateSelect(If& node, const RegisterStruct& conditionReg) {
+        if (!this->options.selectConditionalAssign) {
+            return false;
+        }
+        shared_ptr<Assign> thenAssign = singleAssign(node.getThen());
+        shared_ptr<Assign> elseAssign = node.getElse() ? singleAssign(node.getElse()) : nullptr;
+        if (!thenAssign || !isSpeculatable(thenAssign->getAssignExp())) {
+            return false;
+        }
+        if (node.getElse() && (!elseAssign || elseAssign->getValueStr() != thenAssign->getValueStr()
+                               || !isSpeculatable(elseAssign->getAssignExp()))) {
+            return false;
+        }
+
+        RegisterStruct varReg = this->symbolTable.getRegFromSymTable(thenAssign->getValueStr());
+        thenAssign->getAssignExp()->accept(*this);
+        RegisterStruct thenValue = expressionValue(*thenAssign->getAssignExp());
+        RegisterStruct elseValue;
+        if (elseAssign) {
+            elseAssign->getAssignExp()->accept(*this);
+            elseValue = expressionValue(*elseAssign->getAssignExp());
+        } else {
+            // Without an else part the variable keeps its current value
+            elseValue = {this->codeBuffer.freshVar(), false};
+            this->codeBuffer << tabs << elseValue.name << " = load i32, i32* " << varReg.name << endl;
+        }
+
+        RegisterStruct selected{this->codeBuffer.freshVar(), false};
+        this->codeBuffer << tabs << selected.name << " = select i1 " << conditionReg.name << ", i32 " << thenValue.name << ", i32 " << elseValue.name << endl;
+        this->codeBuffer << tabs << "store i32 " << selected.name << ", i32* " << varReg.name << endl;
+        return true;
+    }
+
+    // " nounwind readnone ..." for the definition and the calls of a function of the program,
+    // empty for the runtime helpers
+    string functionAttributes(const string& function) const {
+        if (!this->options.functionAttributes || function == "print" || function == "printi") {
+            return "";
+        }
+        return " " + this->analyses->effects.attributesOf(function, this->analyses->memoization.usesTables(function));
+    }
+
+    // An expression hoisted out of an enclosing loop already has its value in a register
+    bool reuseHoistedValue(Exp& node) {
+        auto hoisted = this->hoistedValues.find(&node);
+        if (hoisted == this->hoistedValues.end()) {
+            return false;
+        }
+        node.setRegister(hoisted->second);
+        return true;
+    }
+
+    bool hasNewInvariants(const LoopInfo& loop) const {
+        for (const shared_ptr<Exp>& invariant : loop.invariants) {
+            if (!this->hoistedValues.count(invariant.get())) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Computes the invariant expressions of a loop not hoisted by an enclosing loop yet.
+    // Returns them, so they can be released once the loop is generated.
+    vector<const Exp*> hoistInvariants(const LoopInfo& loop) {
+        vector<const Exp*> hoisted;
+        for (const shared_ptr<Exp>& invariant : loop.invariants) {
+            if (this->hoistedValues.count(invariant.get())) {
+                continue;
+            }
+            invariant->accept(*this);
+            this->hoistedValues[invariant.get()] = invariant->getRegister();
+            hoisted.push_back(invariant.get());
+        }
+        this->loopAnalyzer.recordHoisted(loop, hoisted.size());
+        return hoisted;
+    }
+
+    void releaseInvariants(const vector<const Exp*>& hoisted) {
+        for (const Exp* invariant : hoisted) {
+            this->hoistedValues.erase(invariant);
+        }
+    }
+
     // Implementations of visit methods
     void visit(Num& node) override { 
         RegisterStruct currVar{this->codeBuffer.freshVar(), 0 == node.getValueInt()};
         currVar.setRegisterValue(true, node.getValueInt());
+        currVar.isRegisterValueProven = true;
 
         this->codeBuffer << tabs << currVar.name << " = add i32 " << node.getValueInt() << ", 0" << endl;
         node.setRegister(currVar);
@@ -114,11 +472,16 @@ public:
         this->codeBuffer << tabs << currVar.name << " = add i32 " << node.getValueInt() << ", 0" << endl;
         RegisterStruct tmpVar = currVar;
         currVar = {this->codeBuffer.freshVar(), tmpVar.isZero};
+        currVar.setRegisterValue(true, tmpVar.getRegisterValue() & 255);
+        currVar.isRegisterValueProven = true;
         this->codeBuffer << tabs << currVar.name << " = and i32 " << tmpVar.name << ", 255" << endl;
         node.setRegister(currVar);
     }
 
     void visit(String& node) override {
+        if (reuseHoistedValue(node)) {
+            return;
+        }
         const int strSize = node.getValueStr().size() + 1;
         const string strIdentifier = this->codeBuffer.emitString(node.getValueStr());
         RegisterStruct currVar{this->codeBuffer.freshVar(), false};
@@ -130,7 +493,8 @@ public:
     void visit(Bool& node) override {
         RegisterStruct currVar = {this->codeBuffer.freshVar(), true};
         int initBoolValue = node.getValueBool() ? 1 : 0;
-        currVar.isZero = !node.getValueBool();
+        currVar.setRegisterValue(true, initBoolValue);
+        currVar.isRegisterValueProven = true;
         this->codeBuffer << tabs << currVar.name << " = add i32 " << initBoolValue << ", 0" << endl;
         node.setRegister(currVar);
     }
@@ -143,85 +507,86 @@ public:
     }
 
     void visit(BinOp& node) override {
+        if (reuseHoistedValue(node)) {
+            return;
+        }
         node.getLeft()->accept(*this);
         node.getRight()->accept(*this);
 
-        RegisterStruct leftReg{"left", false};
-        RegisterStruct rightReg{"right", false};
-        RegisterStruct leftValue;
-        RegisterStruct rightValue;
-
-        if(node.getLeft()->getType() == NODE_ID){
-            leftReg = this->symbolTable.getRegFromSymTable(node.getLeft()->getValueStr());
-            leftValue = {this->codeBuffer.freshVar(), true};
-            this->codeBuffer << tabs << leftValue.name << " = load i32, i32* " << leftReg.name << endl;
-            leftValue.setRegisterValue(leftReg.isRegisterValueKnown, leftReg.getRegisterValue());
-        } else {
-            leftValue = node.getLeft()->getRegister(); // Maybe a result of add leftReg, 0
-        }
-        if(node.getRight()->getType() == NODE_ID){
-            rightReg = this->symbolTable.getRegFromSymTable(node.getRight()->getValueStr());
-            rightValue = {this->codeBuffer.freshVar(), true};
-            this->codeBuffer << tabs << rightValue.name << " = load i32, i32* " << rightReg.name << endl;
-            rightValue.setRegisterValue(rightReg.isRegisterValueKnown, rightReg.getRegisterValue());
-        } else {
-            rightValue = node.getRight()->getRegister(); // Maybe a result of add rightReg, 0
-        }        
+        RegisterStruct leftValue = expressionValue(*node.getLeft());
+        RegisterStruct rightValue = expressionValue(*node.getRight());
 
         RegisterStruct currVar = {this->codeBuffer.freshVar(), true};
-        string resultText = currVar.name;
+        // The instruction is written after the zero check of a division
+        const char* opcode = "add";
+        bool isDivisionByZero = false;
+        int32_t foldedValue = 0;
+        const bool isFolded = leftValue.isRegisterValueKnown && rightValue.isRegisterValueKnown
+            && ConstantPropagation::fold(node.getOp(), leftValue.getRegisterValue(), rightValue.getRegisterValue(), foldedValue);
+        currVar.setRegisterValue(isFolded, foldedValue);
         switch(node.getOp()) {
             case BinOpType::ADD:
                 // if left in numb and right is numb then truncate, else already written 
-                currVar.setRegisterValue((leftValue.isRegisterValueKnown && rightValue.isRegisterValueKnown), leftValue.getRegisterValue() + rightValue.getRegisterValue());
-                resultText += " = add i32 " + leftValue.name + ", " + rightValue.name;
+                opcode = "add";
                 if((leftValue.isZero && rightValue.isZero)){
                     currVar.setRegisterValue(true, 0);
                 }
                 break;
             case BinOpType::SUB:
-                currVar.setRegisterValue((leftValue.isRegisterValueKnown && rightValue.isRegisterValueKnown), leftValue.getRegisterValue() - rightValue.getRegisterValue());
-                resultText += " = sub i32 " + leftValue.name + ", " + rightValue.name;
+                opcode = "sub";
                 if(leftValue.name == rightValue.name){
                     currVar.setRegisterValue(true, 0);
                 }
                 break;
             case BinOpType::MUL:
-                currVar.setRegisterValue((leftValue.isRegisterValueKnown && rightValue.isRegisterValueKnown), leftValue.getRegisterValue() * rightValue.getRegisterValue());
-                resultText += " = mul i32 " + leftValue.name + ", " + rightValue.name;
+                opcode = "mul";
                 if((leftValue.isZero || rightValue.isZero)){
                     currVar.setRegisterValue(true, 0);
                 }
                 break;
             case BinOpType::DIV:
+                // The divisor is zero on every path that reaches the division
                 if (rightValue.isZero) {
-                    const string divisionByZero = "Error division by zero";
-                    const string divZeroIdentifier = this->codeBuffer.emitString(divisionByZero);
-                    const int strSize = divisionByZero.size() + 1;
-                    RegisterStruct currVar{this->codeBuffer.freshVar(), false};
-                    this->codeBuffer << tabs << currVar.name << " = getelementptr [" << strSize << " x i8], [" << strSize << " x i8]* " << divZeroIdentifier << ", i32 0, i32 0" << endl;
-
-                    this->codeBuffer << tabs << "call void @print(i8* " + currVar.name + ")" << endl;
-                    this->codeBuffer << tabs << "call void @exit(i32 0)" << endl;
-                    //FXIME - Check why the fucking exit is still executing commands after it!
-                    resultText += " = sdiv i32 1, 1 ; This is done since exit is not called in some fucking unexplained reason";
-
+                    this->failingDivisions++;
+                    this->codeBuffer << tabs << "br label " << divisionErrorBlock() << endl;
+                    // No path continues after the error, the rest of the block is never reached
+                    this->codeBuffer.emitLabel(this->codeBuffer.freshLabel().block(".after_error"));
+                    isDivisionByZero = true;
                 } else {
-                    resultText += " = sdiv i32 " + leftValue.name + ", " + rightValue.name;
-                    currVar.setRegisterValue((leftValue.isRegisterValueKnown && rightValue.isRegisterValueKnown), leftValue.getRegisterValue() / rightValue.getRegisterValue());
+                    // Without a proof that the divisor is non-zero, a zero divisor branches to the error block
+                    if (rightValue.isRegisterValueKnown && rightValue.isRegisterValueProven) {
+                        this->elidedDivisionGuards++;
+                    } else {
+                        const output::Value isZero = this->codeBuffer.freshVar();
+                        const output::Value divideLabel = this->codeBuffer.freshLabel().block(".divide");
+                        const string weights = this->options.branchHints ? ", !prof " + this->codeBuffer.emitBranchWeights(1, LIKELY_BRANCH_WEIGHT) : "";
+                        this->codeBuffer << tabs << isZero << " = icmp eq i32 " << rightValue.name << ", 0" << endl;
+                        this->codeBuffer << tabs << "br i1 " << isZero << ", label " << divisionErrorBlock() << ", label " << divideLabel << weights << endl;
+                        this->codeBuffer.emitLabel(divideLabel);
+                        this->divisionGuards++;
+                    }
+                    opcode = "sdiv";
                 }
                 if((leftValue.isZero && !rightValue.isZero)){
                     currVar.setRegisterValue(true, 0);
                 }
                 break;
         }
-        this->codeBuffer << tabs << resultText << endl;
-        if (!currVar.isZero) {
+        if (isDivisionByZero) {
+            this->codeBuffer << tabs << currVar.name << " = sdiv i32 1, 1" << endl;
+        } else {
+            this->codeBuffer << tabs << currVar.name << " = " << opcode << " i32 " << leftValue.name << ", " << rightValue.name << endl;
+        }
+        currVar.isRegisterValueProven = currVar.isRegisterValueKnown
+            && leftValue.isRegisterValueProven && rightValue.isRegisterValueProven;
+        // Only a zero that holds on every path skips the mask
+        if (!(currVar.isZero && currVar.isRegisterValueProven)) {
             if(binOp_ResultType(*node.getLeft(), *node.getRight(), this->symbolTable) == BYTE) {
                 RegisterStruct tmpVar = currVar;
                 currVar = {this->codeBuffer.freshVar(), tmpVar.isZero};
-                this->codeBuffer << tabs << currVar.name + " = and i32 " + tmpVar.name + ", 255" << endl;
+                this->codeBuffer << tabs << currVar.name << " = and i32 " << tmpVar.name << ", 255" << endl;
                 currVar.setRegisterValue(tmpVar.isRegisterValueKnown, tmpVar.getRegisterValue() & 255);
+                currVar.isRegisterValueProven = tmpVar.isRegisterValueProven;
             }
         }
 
@@ -229,91 +594,86 @@ public:
     }
 
     void visit(RelOp& node) override {
+        if (reuseHoistedValue(node)) {
+            return;
+        }
         node.getLeft()->accept(*this);
         node.getRight()->accept(*this);
 
-        RegisterStruct leftReg{"Undef", true};
-        RegisterStruct rightReg{"Undef", true};
-        RegisterStruct leftValue;
-        RegisterStruct rightValue;
-
-        if(node.getLeft()->getType() == NODE_ID) {
-            leftReg = this->symbolTable.getRegFromSymTable(node.getLeft()->getValueStr());
-            leftValue = {this->codeBuffer.freshVar(), true};
-            this->codeBuffer << tabs << leftValue.name << " = load i32, i32* " << leftReg.name << endl;
-        } else {
-            leftValue = node.getLeft()->getRegister(); // Maybe a result of add leftReg, 0
-        }
-        if(node.getRight()->getType() == NODE_ID) {
-            rightReg = this->symbolTable.getRegFromSymTable(node.getRight()->getValueStr());
-            rightValue = {this->codeBuffer.freshVar(), true};
-            this->codeBuffer << tabs << rightValue.name << " = load i32, i32* " << rightReg.name << endl;
-        } else {
-            rightValue = node.getRight()->getRegister(); // Maybe a result of add rightReg, 0
-        }
+        RegisterStruct leftValue = expressionValue(*node.getLeft());
+        RegisterStruct rightValue = expressionValue(*node.getRight());
 
         RegisterStruct currVar{this->codeBuffer.freshVar(), true};
-        string resultText = currVar.name;
+        const char* predicate = "eq";
+        const int left = leftValue.getRegisterValue();
+        const int right = rightValue.getRegisterValue();
+        bool result = false;
         switch(node.getOp()) { 
             // TODO - Maybe we will have to jump to labels from here, where this code should be written? here or in the if/else and while
             case RelOpType::EQ:
-                resultText += " = icmp eq i32 " + leftValue.name + ", " + rightValue.name;
+                predicate = "eq";
+                result = left == right;
                 break;
             case RelOpType::NE:
-                resultText += " = icmp ne i32 " + leftValue.name + ", " + rightValue.name;
+                predicate = "ne";
+                result = left != right;
                 break;
             case RelOpType::LT:
-                resultText += " = icmp slt i32 " + leftValue.name + ", " + rightValue.name;
+                predicate = "slt";
+                result = left < right;
                 break;
             case RelOpType::GT:
-                resultText += " = icmp sgt i32 " + leftValue.name + ", " + rightValue.name;
+                predicate = "sgt";
+                result = left > right;
                 break;
             case RelOpType::LE:
-                resultText += " = icmp sle i32 " + leftValue.name + ", " + rightValue.name;
+                predicate = "sle";
+                result = left <= right;
                 break;
             case RelOpType::GE:
-                resultText += " = icmp sge i32 " + leftValue.name + ", " + rightValue.name;
+                predicate = "sge";
+                result = left >= right;
                 break;
         }
-        this->codeBuffer << tabs << resultText << endl;
+        this->codeBuffer << tabs << currVar.name << " = icmp " << predicate << " i32 " << leftValue.name << ", " << rightValue.name << endl;
         RegisterStruct tmpVar = currVar;
         currVar = {this->codeBuffer.freshVar(), tmpVar.isZero};
+        // Only comparisons of literals and proven constants are known
+        const bool isProven = leftValue.isRegisterValueKnown && leftValue.isRegisterValueProven
+            && rightValue.isRegisterValueKnown && rightValue.isRegisterValueProven;
+        currVar.setRegisterValue(isProven, result ? 1 : 0);
+        currVar.isRegisterValueProven = isProven;
         this->codeBuffer << tabs << currVar.name << " = zext i1 " << tmpVar.name << " to i32" << endl;
         node.setRegister(currVar);
         node.setType(NODE_Bool);
     }
 
     void visit(Not& node) override {
+        if (reuseHoistedValue(node)) {
+            return;
+        }
         node.getExpr()->accept(*this);
 
-        RegisterStruct expReg{"Undef", true};
-        RegisterStruct expBoolValue;
-
-        if(node.getExpr()->getType() == NODE_ID) {
-            expReg = this->symbolTable.getRegFromSymTable(node.getExpr()->getValueStr());
-            expBoolValue = {this->codeBuffer.freshVar(), true};
-            this->codeBuffer << tabs << expBoolValue.name << " = load i32, i32* " << expReg.name << endl;
-        } else {
-            expBoolValue = node.getExpr()->getRegister(); // Maybe a result of add leftReg, 0
-        }
+        RegisterStruct expBoolValue = expressionValue(*node.getExpr());
 
         RegisterStruct currVar{this->codeBuffer.freshVar(), true};
+        const bool isProven = expBoolValue.isRegisterValueKnown && expBoolValue.isRegisterValueProven;
+        currVar.setRegisterValue(isProven, expBoolValue.getRegisterValue() ^ 1);
+        currVar.isRegisterValueProven = isProven;
         this->codeBuffer << tabs << currVar.name << " = xor i32 " << expBoolValue.name << ", 1" << endl;
         node.setRegister(currVar);
     }
 
     void visit(And& node) override { 
         // Lazy Evaluation - If Left is False, then Right is not evaluated
-        const string andLabel = this->codeBuffer.freshLabel();
+        const output::Value andLabel = this->codeBuffer.freshLabel();
         // Flow Control Labels
-        const string rightEvaluateLabel = andLabel + ".rightEvaluationSection";
-        const string resultLabel = andLabel + ".resultSection";
+        const output::Value rightEvaluateLabel = andLabel.block(".rightEvaluationSection");
+        const output::Value resultLabel = andLabel.block(".resultSection");
         // Memory Allocation Labels
-        const string leftOperand_ptr = "%allocation_" + andLabel.substr(1) + ".leftOperand";
-        const string rightOperand_ptr = "%allocation_" + andLabel.substr(1) + ".rightOperand";
+        const output::Value leftOperand_ptr = andLabel.operandSlot(".leftOperand");
+        const output::Value rightOperand_ptr = andLabel.operandSlot(".rightOperand");
 
-        RegisterStruct leftReg = {"Undef", true};
-        RegisterStruct rightReg = {"Undef", true};
         RegisterStruct leftBoolValue;
         RegisterStruct rightBoolValue;
 
@@ -325,16 +685,11 @@ public:
 
         // Evaluate Left
         node.getLeft()->accept(*this);
-        if(node.getLeft()->getType() == NODE_ID) {
-            leftReg = this->symbolTable.getRegFromSymTable(node.getLeft()->getValueStr());
-            leftBoolValue = {this->codeBuffer.freshVar(), true};
-            this->codeBuffer << tabs << leftBoolValue.name << " = load i32, i32* " << leftReg.name << endl;
-        } else {
-            leftBoolValue = node.getLeft()->getRegister();
-        }
+        leftBoolValue = expressionValue(*node.getLeft());
         
         // Convert to i1 - The branch instruction requires i1 type
         RegisterStruct tmpVar = leftBoolValue;
+        const RegisterStruct leftKnownValue = tmpVar;
         leftBoolValue = {this->codeBuffer.freshVar(), true};
         this->codeBuffer << tabs << leftBoolValue.name << " = trunc i32 " << tmpVar.name << " to i1" << endl;
         this->codeBuffer << tabs << "store i1 " << leftBoolValue.name << ", i1* " << leftOperand_ptr << endl;
@@ -343,24 +698,19 @@ public:
         this->codeBuffer << tabs << "br i1 " << leftBoolValue.name << ", label " << rightEvaluateLabel << ", label " << resultLabel << endl;
 
         // Evaluate Right
-        this->codeBuffer << "\n" << rightEvaluateLabel.substr(1) << ":" << endl;
+        this->codeBuffer.emitLabel(rightEvaluateLabel);
         node.getRight()->accept(*this);
-        if(node.getRight()->getType() == NODE_ID) {
-            rightReg = this->symbolTable.getRegFromSymTable(node.getRight()->getValueStr());
-            rightBoolValue = {this->codeBuffer.freshVar(), true};
-            this->codeBuffer << tabs << rightBoolValue.name << " = load i32, i32* " << rightReg.name << endl;
-        } else {
-            rightBoolValue = node.getRight()->getRegister();
-        }
+        rightBoolValue = expressionValue(*node.getRight());
 
         // Convert to i1 - The branch instruction requires i1 type
         tmpVar = rightBoolValue;
+        const RegisterStruct rightKnownValue = tmpVar;
         rightBoolValue = {this->codeBuffer.freshVar(), true};
         this->codeBuffer << tabs << rightBoolValue.name << " = trunc i32 " << tmpVar.name << " to i1" << endl;
         this->codeBuffer << tabs << "store i1 " << rightBoolValue.name << ", i1* " << rightOperand_ptr << endl;
 
         this->codeBuffer << tabs << "br label " << resultLabel << endl;
-        this->codeBuffer << "\n" << resultLabel.substr(1) << ":" << endl;
+        this->codeBuffer.emitLabel(resultLabel);
 
         // Evaluate And
         RegisterStruct currVar{this->codeBuffer.freshVar(), true};
@@ -374,21 +724,20 @@ public:
         tmpVar = currVar;
         currVar = {this->codeBuffer.freshVar(), true};
         this->codeBuffer << tabs << currVar.name << " = zext i1 " << tmpVar.name << " to i32" << endl;
+        setLogicalOpKnownValue(currVar, leftKnownValue, rightKnownValue, false);
         node.setRegister(currVar);
     }
 
     void visit(Or& node) override {
         // Lazy Evaluation - If Left is True, then Right is not evaluated
-        const string orLabel = this->codeBuffer.freshLabel();
+        const output::Value orLabel = this->codeBuffer.freshLabel();
         // Flow Control Labels
-        const string rightEvaluateLabel = orLabel + ".rightEvaluationSection";
-        const string resultLabel = orLabel + ".resultSection";
+        const output::Value rightEvaluateLabel = orLabel.block(".rightEvaluationSection");
+        const output::Value resultLabel = orLabel.block(".resultSection");
         // Memory Allocation Labels
-        const string leftOperand_ptr = "%allocation_" + orLabel.substr(1) + ".leftOperand";
-        const string rightOperand_ptr = "%allocation_" + orLabel.substr(1) + ".rightOperand";
+        const output::Value leftOperand_ptr = orLabel.operandSlot(".leftOperand");
+        const output::Value rightOperand_ptr = orLabel.operandSlot(".rightOperand");
 
-        RegisterStruct leftReg{"Undef", true};
-        RegisterStruct rightReg{"Undef", true};
         RegisterStruct leftBoolValue;
         RegisterStruct rightBoolValue;
 
@@ -400,16 +749,11 @@ public:
 
         // Evaluate Left
         node.getLeft()->accept(*this);
-        if(node.getLeft()->getType() == NODE_ID) {
-            leftReg = this->symbolTable.getRegFromSymTable(node.getLeft()->getValueStr());
-            leftBoolValue = {this->codeBuffer.freshVar(), true};
-            this->codeBuffer << tabs << leftBoolValue.name << " = load i32, i32* " << leftReg.name << endl;
-        } else {
-            leftBoolValue = node.getLeft()->getRegister();
-        }
+        leftBoolValue = expressionValue(*node.getLeft());
         
         // Convert to i1 - The branch instruction requires i1 type
         RegisterStruct tmpVar = leftBoolValue;
+        const RegisterStruct leftKnownValue = tmpVar;
         leftBoolValue = {this->codeBuffer.freshVar(), true};
         this->codeBuffer << tabs << leftBoolValue.name << " = trunc i32 " << tmpVar.name << " to i1" << endl;
         this->codeBuffer << tabs << "store i1 " << leftBoolValue.name << ", i1* " << leftOperand_ptr << endl;
@@ -418,24 +762,19 @@ public:
         this->codeBuffer << tabs << "br i1 " << leftBoolValue.name << ", label " << resultLabel << ", label " << rightEvaluateLabel << endl;
 
         // Evaluate Right
-        this->codeBuffer << "\n" << rightEvaluateLabel.substr(1) << ":" << endl;
+        this->codeBuffer.emitLabel(rightEvaluateLabel);
         node.getRight()->accept(*this);
-        if(node.getRight()->getType() == NODE_ID) {
-            rightReg = this->symbolTable.getRegFromSymTable(node.getRight()->getValueStr());
-            rightBoolValue = {this->codeBuffer.freshVar(), true};
-            this->codeBuffer << tabs << rightBoolValue.name << " = load i32, i32* " << rightReg.name << endl;
-        } else {
-            rightBoolValue = node.getRight()->getRegister();
-        }
+        rightBoolValue = expressionValue(*node.getRight());
 
         // Convert to i1 - The branch instruction requires i1 type
         tmpVar = rightBoolValue;
+        const RegisterStruct rightKnownValue = tmpVar;
         rightBoolValue = {this->codeBuffer.freshVar(), true};
         this->codeBuffer << tabs << rightBoolValue.name << " = trunc i32 " << tmpVar.name << " to i1" << endl;
         this->codeBuffer << tabs << "store i1 " << rightBoolValue.name << ", i1* " << rightOperand_ptr << endl;
 
         this->codeBuffer << tabs << "br label " << resultLabel << endl;
-        this->codeBuffer << "\n" << resultLabel.substr(1) << ":" << endl;
+        this->codeBuffer.emitLabel(resultLabel);
 
         // Evaluate Or
         RegisterStruct currVar{this->codeBuffer.freshVar(), true};
@@ -449,6 +788,7 @@ public:
         tmpVar = currVar;
         currVar = {this->codeBuffer.freshVar(), true};
         this->codeBuffer << tabs << currVar.name << " = zext i1 " << tmpVar.name << " to i32" << endl;
+        setLogicalOpKnownValue(currVar, leftKnownValue, rightKnownValue, true);
         node.setRegister(currVar);
     }
 
@@ -457,21 +797,13 @@ public:
     }
 
     void visit(Cast& node) override {
+        if (reuseHoistedValue(node)) {
+            return;
+        }
         node.getExpr()->accept(*this);
         RegisterStruct currVar = {this->codeBuffer.freshVar(), true};
         currVar.setRegisterValue(false, 0);
-        RegisterStruct expReg;
-        RegisterStruct tmpVar{this->codeBuffer.freshVar(), true};
-
-        if(NODE_ID == node.getExpr()->getType()) {
-            expReg = this->symbolTable.getRegFromSymTable(node.getExpr()->getValueStr());
-            this->codeBuffer << tabs << tmpVar.name << " = load i32, i32* " << expReg.name << endl;
-            tmpVar.setRegisterValue(expReg.isRegisterValueKnown, expReg.getRegisterValue());
-        } else {
-            expReg = node.getExpr()->getRegister();
-            this->codeBuffer << tabs << tmpVar.name << " = add i32 " << expReg.name << ", 0" << endl;
-            tmpVar.setRegisterValue(expReg.isRegisterValueKnown, expReg.getRegisterValue());
-        }
+        RegisterStruct tmpVar = expressionValue(*node.getExpr());
 
         if(BYTE == node.getTargetType()) {
             this->codeBuffer << tabs << currVar.name << " = and i32 " << tmpVar.name << ", 255" << endl;
@@ -480,6 +812,7 @@ public:
             this->codeBuffer << tabs << currVar.name << " = add i32 " << tmpVar.name << ", 0" << endl;
             currVar.setRegisterValue(tmpVar.isRegisterValueKnown, tmpVar.getRegisterValue());
         }
+        currVar.isRegisterValueProven = tmpVar.isRegisterValueKnown && tmpVar.isRegisterValueProven;
         node.setRegister(currVar);
     }
 
@@ -493,48 +826,84 @@ public:
     void visit(Call& node) override {
         node.getArgsExp()->accept(*this);
 
+        // A pure call with constant arguments was evaluated at compile time, its arguments are still
+        // generated since they may call functions with effects (as in f(g() * 0))
+        const ConstantValue evaluated = this->constants.valueOf(node);
+        if (evaluated.isConstant()) {
+            RegisterStruct constant = {this->codeBuffer.freshVar(), true};
+            constant.setRegisterValue(true, evaluated.value);
+            constant.isRegisterValueProven = true;
+            this->codeBuffer << tabs << constant.name << " = add i32 " << evaluated.value << ", 0" << endl;
+            node.setRegister(constant);
+            return;
+        }
+
         RegisterStruct regNew = {this->codeBuffer.freshVar(), true};
+        // The returned value is only known at runtime
+        regNew.setRegisterValue(false);
         string callBuffer = "";
         const string funcID = node.getFuncId();
+        this->calledRuntimeFunctions.insert(funcID);
 
         BuiltInType returnType = symbolTable.getFuncSymbol(funcID)->getDataType();
         if (returnType == VOID) {
             callBuffer = "call void ";
         } else {
-            callBuffer = regNew.name + " = call i32 ";
+            callBuffer = regNew.name.str() + " = call i32 ";
         }
         node.setRegister(regNew);
-        callBuffer += "@" + funcID + "(";
 
+        // Constant arguments may redirect the call to a clone of the callee that takes the others only,
+        // the call goes to a placeholder until the module generation decides (see SpecializationRequest)
         vector<shared_ptr<Exp>> params = node.getArgs();
-        for(auto param : params) {
-            RegisterStruct regParam;
-            if (param->getType() == NODE_ID) {
-                regParam = symbolTable.getRegFromSymTable(param->getValueStr());
-                string tempReg = this->codeBuffer.freshVar();
-                this->codeBuffer << tabs << tempReg << " = load i32, i32* " << regParam.name << endl;
-                if (funcID == "print" || funcID == "printf") {
-                    callBuffer += "i8* " + tempReg + ", ";
-                } else {
-                    callBuffer += "i32 " + tempReg + ", ";
-                }
-            } else {
-                regParam = param->getRegister();
-                if (funcID == "print" || funcID == "printf") {
-                    callBuffer += "i8* " + regParam.name + ", ";
-                } else {
-                    callBuffer += "i32 " + regParam.name + ", ";
-                }
+        vector<ConstantValue> argumentValues;
+        if (this->options.specialize) {
+            for (auto param : params) {
+                argumentValues.push_back(this->constants.valueOf(*param));
+            }
+        }
+        const bool mayBeCloned = this->options.specialize && this->analyses->specializer.isCandidate(funcID, argumentValues);
+        SpecializationRequest request;
+        if (mayBeCloned) {
+            request.function = funcID;
+            request.arguments = argumentValues;
+            request.isInLoop = symbolTable.getCurrentScope()->isInLoopScope();
+            request.placeholder = "@" + funcID + ".request" + to_string(this->specializationRequests.size()) + "(";
+        }
+        const string prefix = callBuffer;
+        callBuffer += mayBeCloned ? request.placeholder : "@" + funcID + "(";
+        string unspecializedCall = prefix + "@" + funcID + "(";
+
+        for (size_t i = 0; i < params.size(); ++i) {
+            const string separator = i ? ", " : "";
+            if (mayBeCloned && argumentValues[i].isConstant()) {
+                unspecializedCall += separator + "i32 " + to_string(argumentValues[i].value);
+                continue;
             }
+            RegisterStruct regParam = expressionValue(*params[i]);
+            const string argument = ((funcID == "print" || funcID == "printf") ? "i8* " : "i32 ") + regParam.name.str();
+            // The placeholder takes the non-constant arguments only
+            callBuffer += (callBuffer.back() == '(' ? "" : ", ") + argument;
+            unspecializedCall += separator + argument;
+        }
+        callBuffer += ")" + functionAttributes(funcID);
+        unspecializedCall += ")" + functionAttributes(funcID);
 
+        if (mayBeCloned) {
+            request.operands = output::InstructionRecord::parse(tabs + callBuffer).operands;
+            request.unspecializedOperands = output::InstructionRecord::parse(tabs + unspecializedCall).operands;
+            this->specializationRequests.push_back(request);
         }
-        callBuffer = ((params.size() != 0) ? callBuffer.substr(0, callBuffer.size() - 2) : callBuffer) + ")";
-        
         this->codeBuffer << tabs << callBuffer << endl;
     }
 
     void visit(Statements& node) override {
         for (auto& statement : node.getStatements()) {
+            // No path reaches the statement (it follows a return, break or continue, or a branch that
+            // is never taken), and without labels inside a statement list none reaches the rest either
+            if (!this->constants.isReached(*statement)) {
+                break;
+            }
             if (statement->getType() == NODE_Statements) {
                 CodeGenerator_beginScope();
             }
@@ -547,7 +916,7 @@ public:
 
     void visit(Break& node) override {
         if ((symbolTable.getCurrentScope()->isInLoopScope())) {
-            const string done_label = this->symbolTable.getCurrentScope()->getDoneLabel();
+            const output::Value done_label = this->symbolTable.getCurrentScope()->getDoneLabel();
             //cout << "Break Label: " << done_label << endl;
             this->codeBuffer << tabs << "br label " << done_label << endl;
         }
@@ -555,7 +924,7 @@ public:
 
     void visit(Continue& node) override {
         if ((symbolTable.getCurrentScope()->isInLoopScope())) {
-            const string condition_Label = this->symbolTable.getCurrentScope()->getConditionLabel();
+            const output::Value condition_Label = this->symbolTable.getCurrentScope()->getConditionLabel();
             //cout << "Continue Label: " << condition_Label << endl;
             this->codeBuffer << tabs << "br label " << condition_Label << endl;
         }
@@ -566,55 +935,53 @@ public:
             this->codeBuffer << tabs << "ret void" << endl;
         } else {
             node.getExpr()->accept(*this);
-            if (node.getExpr()->getType() == NODE_ID) {
-                RegisterStruct retReg = this->symbolTable.getRegFromSymTable(node.getExpr()->getValueStr());
-                string tempReg = this->codeBuffer.freshVar();
-                codeBuffer << tabs << tempReg << " = load i32, i32* " << retReg.name << endl;
-                this->codeBuffer << tabs << "ret i32 " << tempReg << endl;
-            } else {
-                RegisterStruct retReg = node.getExpr()->getRegister();
-                this->codeBuffer << tabs << "ret i32 " << retReg.name << endl;
-            }
+            RegisterStruct retReg = expressionValue(*node.getExpr());
+            this->codeBuffer << tabs << "ret i32 " << retReg.name << endl;
         }
       
     }
 
     void visit(If& node) override {
-        const string if_else_Label = this->codeBuffer.freshLabel();
+        const output::Value if_else_Label = this->codeBuffer.freshLabel();
         // Flow Control Labels
-        const string then_Label = if_else_Label + ".then";
-        const string else_Label = if_else_Label + ".else";
-        const string done_Label = if_else_Label + ".finale";
+        const output::Value then_Label = if_else_Label.block(".then");
+        const output::Value else_Label = if_else_Label.block(".else");
+        const output::Value done_Label = if_else_Label.block(".finale");
         CodeGenerator_beginScope();
 
-        RegisterStruct conditionReg{this->codeBuffer.freshVar(), true};
-        node.getCondition()->accept(*this);
-        if(NODE_ID == node.getCondition()->getType()){
-            RegisterStruct condIdReg{this->codeBuffer.freshVar(), true};
-            RegisterStruct tmpReg = this->symbolTable.getRegFromSymTable(node.getCondition()->getValueStr());
-            this->codeBuffer << tabs << condIdReg.name << " = load i32, i32* " << tmpReg.name << endl;
-            this->codeBuffer << tabs << conditionReg.name << " = trunc i32 " << condIdReg.name << " to i1" << endl;
-            conditionReg.setRegisterValue(tmpReg.isRegisterValueKnown, tmpReg.getRegisterValue());
+        RegisterStruct conditionReg = generateCondition(*node.getCondition());
+
+        // A condition proven constant decides the branch here, the dead side is not generated at all
+        const bool isConditionKnown = conditionReg.isRegisterValueKnown && conditionReg.isRegisterValueProven;
+        const bool generateThen = !isConditionKnown || 0 != conditionReg.getRegisterValue();
+        const bool generateElse = node.getElse() && (!isConditionKnown || 0 == conditionReg.getRegisterValue());
+        if (!isConditionKnown && generateSelect(node, conditionReg)) {
+            CodeGenerator_endScope();
+            return;
+        }
+        // Without an else part the false edge goes straight to the end of the if
+        const output::Value false_Label = node.getElse() ? else_Label : done_Label;
+        if (!isConditionKnown) {
+            this->codeBuffer << tabs << "br i1 " << conditionReg.name << ", label " << then_Label << ", label " << false_Label << endl;
         } else {
-            RegisterStruct tmpReg = node.getCondition()->getRegister();
-            this->codeBuffer << tabs << conditionReg.name << " = trunc i32 " << tmpReg.name << " to i1" << endl;
-            conditionReg.setRegisterValue(tmpReg.isRegisterValueKnown, tmpReg.getRegisterValue());
+            this->codeBuffer << tabs << "br label " << (generateThen ? then_Label : false_Label) << endl;
         }
-        this->codeBuffer << tabs << "br i1 " << conditionReg.name << ", label " << then_Label << ", label " << else_Label << endl;
-        this->codeBuffer << "\n" << then_Label.substr(1) << ":" << endl;
 
-        if (node.getThen()->getType() == NODE_Statements) {
-            CodeGenerator_beginScope();
-        }
-        node.getThen()->accept(*this);
-        this->codeBuffer << tabs << "br label " << done_Label << endl;
-        if (node.getThen()->getType() == NODE_Statements) {
-            CodeGenerator_endScope();
+        if (generateThen) {
+            this->codeBuffer.emitLabel(then_Label);
+            if (node.getThen()->getType() == NODE_Statements) {
+                CodeGenerator_beginScope();
+            }
+            node.getThen()->accept(*this);
+            this->codeBuffer << tabs << "br label " << done_Label << endl;
+            if (node.getThen()->getType() == NODE_Statements) {
+                CodeGenerator_endScope();
+            }
         }
         CodeGenerator_endScope();
 
-        this->codeBuffer << "\n" << else_Label.substr(1) << ":" << endl;
-        if (node.getElse()) {
+        if (generateElse) {
+            this->codeBuffer.emitLabel(else_Label);
             CodeGenerator_beginScope();
             if(node.getElse()->getType() == NODE_Statements) {
                 CodeGenerator_beginScope();
@@ -626,88 +993,129 @@ public:
             }
             CodeGenerator_endScope();
         }
-        this->codeBuffer << tabs << "br label " << done_Label << endl;
-        this->codeBuffer << "\n" << done_Label.substr(1) << ":" << endl;
+        this->codeBuffer.emitLabel(done_Label);
     }
 
     void visit(While& node) override {
-        const string while_label = this->codeBuffer.freshLabel();
+        const LoopInfo loop = this->loopAnalyzer.analyze(node, this->constants, this->symbolTable, this->currentFunction);
+        if (LOOP_FULL_UNROLL == loop.action) {
+            // The body runs a known number of times, the copies need neither the condition nor the back edge
+            const vector<const Exp*> hoisted = (loop.unrollFactor > 1) ? hoistInvariants(loop) : vector<const Exp*>();
+            for (int copy = 0; copy < loop.unrollFactor; ++copy) {
+                CodeGenerator_beginScope();
+                node.getBody()->accept(*this);
+                CodeGenerator_endScope();
+            }
+            releaseInvariants(hoisted);
+            return;
+        }
+
+        const output::Value while_label = this->codeBuffer.freshLabel();
         // Flow Control Labels
-        const string condition_Label = while_label + ".while_condition";
-        const string body_Label = while_label + ".while_body";
-        const string done_Label = while_label + ".while_finale";
+        const output::Value condition_Label = while_label.block(".while_condition");
+        const output::Value body_Label = while_label.block(".while_body");
+        const output::Value done_Label = while_label.block(".while_finale");
+        const output::Value preheader_Label = while_label.block(".while_preheader");
+        // Invariant expressions are computed once in a preheader between the guard and the body
+        const output::Value entry_Label = hasNewInvariants(loop) ? preheader_Label : body_Label;
         CodeGenerator_beginScope();
         this->symbolTable.getCurrentScope()->setInLoopScope(true);
         this->symbolTable.getCurrentScope()->setConditionLabel(condition_Label);
         this->symbolTable.getCurrentScope()->setDoneLabel(done_Label);
 
-        this->codeBuffer << tabs << "br label " << condition_Label << endl;
-        this->codeBuffer << "\n" << condition_Label.substr(1) << ":" << endl;  
-        RegisterStruct conditionReg{this->codeBuffer.freshVar(), true};
-        node.getCondition()->accept(*this);
-        if(NODE_ID == node.getCondition()->getType()){
-            RegisterStruct condIdReg{this->codeBuffer.freshVar(), true};
-            RegisterStruct tmpReg = this->symbolTable.getRegFromSymTable(node.getCondition()->getValueStr());
-            this->codeBuffer << tabs << condIdReg.name << " = load i32, i32* " << tmpReg.name << endl;
-            this->codeBuffer << tabs << conditionReg.name << " = trunc i32 " << condIdReg.name << " to i1" << endl;
-            conditionReg.setRegisterValue(tmpReg.isRegisterValueKnown, tmpReg.getRegisterValue());
+        // The loop is rotated into a guarded do-while: the condition is tested once before the loop and
+        // again at the latch, so every iteration ends with a single conditional branch back to the body.
+        // continue jumps to the latch (condition_Label), break jumps to done_Label.
+        const ConstantValue entryCondition = this->constants.entryConditionOf(node);
+        if (LOOP_PARTIAL_UNROLL == loop.action) {
+            // The trip count is a positive multiple of the unroll factor, the guard always enters the loop
+            this->codeBuffer << tabs << "br label " << entry_Label << endl;
+        } else if (entryCondition.isConstant()) {
+            // The condition is known when the loop is entered: the guard either always enters the loop,
+            // or never does and the body is not generated at all
+            if (0 == entryCondition.value) {
+                this->codeBuffer << tabs << "br label " << done_Label << endl;
+                this->codeBuffer.emitLabel(done_Label);
+                CodeGenerator_endScope();
+                return;
+            }
+            this->codeBuffer << tabs << "br label " << entry_Label << endl;
         } else {
-            RegisterStruct tmpReg = node.getCondition()->getRegister();
-            this->codeBuffer << tabs << conditionReg.name << " = trunc i32 " << tmpReg.name << " to i1" << endl;
-            conditionReg.setRegisterValue(tmpReg.isRegisterValueKnown, tmpReg.getRegisterValue());
+            RegisterStruct conditionReg = generateCondition(*node.getCondition());
+            this->codeBuffer << tabs << "br i1 " << conditionReg.name << ", label " << entry_Label << ", label " << done_Label << endl;
         }
-        this->codeBuffer << tabs << "br i1 " << conditionReg.name << ", label " << body_Label << ", label " << done_Label << endl;
-        this->codeBuffer << "\n" << body_Label.substr(1) << ":" << endl;
 
-        if (node.getBody()->getType() == NODE_Statements) {
-            CodeGenerator_beginScope();
+        vector<const Exp*> hoisted;
+        if (entry_Label == preheader_Label) {
+            this->codeBuffer.emitLabel(preheader_Label);
+            hoisted = hoistInvariants(loop);
+            this->codeBuffer << tabs << "br label " << body_Label << endl;
+        }
+
+        this->codeBuffer.emitLabel(body_Label);
+        // Unrolled copies get a scope each, so their declarations do not collide
+        const bool isBodyScoped = node.getBody()->getType() == NODE_Statements || loop.unrollFactor > 1;
+        for (int copy = 0; copy < loop.unrollFactor; ++copy) {
+            if (isBodyScoped) {
+                CodeGenerator_beginScope();
+            }
+            node.getBody()->accept(*this);
+            if (isBodyScoped) {
+                CodeGenerator_endScope();
+            }
         }
-        node.getBody()->accept(*this);
         this->codeBuffer << tabs << "br label " << condition_Label << endl;
-        this->codeBuffer << tabs << "br label " << done_Label << endl;
-        if (node.getBody()->getType() == NODE_Statements) {
-            CodeGenerator_endScope();
+
+        this->codeBuffer.emitLabel(condition_Label);
+        // A condition that holds on every iteration leaves the loop only through break or return
+        const ConstantValue loopCondition = this->constants.valueOf(*node.getCondition());
+        if (!loopCondition.isConstant() || 0 == loopCondition.value) {
+            const string loopMetadata = loop.metadata.empty() ? "" : ", !llvm.loop " + this->codeBuffer.emitLoopMetadata(loop.metadata);
+            RegisterStruct latchConditionReg = generateCondition(*node.getCondition());
+            this->codeBuffer << tabs << "br i1 " << latchConditionReg.name << ", label " << body_Label << ", label " << done_Label << latchWeights(loop) << loopMetadata << endl;
+        } else {
+            this->codeBuffer << tabs << "br label " << body_Label << endl;
         }
-        this->codeBuffer << "\n" << done_Label.substr(1) << ":" << endl;
+        releaseInvariants(hoisted);
+        this->codeBuffer.emitLabel(done_Label);
         CodeGenerator_endScope();
     }
 
+    // The back edge is taken on all but the last iteration, (trip count - 1) times per entry when the
+    // trip count is known and like a likely branch (2000:1, as __builtin_expect) otherwise
+    string latchWeights(const LoopInfo& loop) {
+        if (!this->options.branchHints) {
+            return "";
+        }
+        int64_t backEdges = LIKELY_BRANCH_WEIGHT;
+        if (loop.tripCount > 0) {
+            backEdges = max<int64_t>(loop.tripCount / loop.unrollFactor - 1, 1);
+        }
+        return ", !prof " + this->codeBuffer.emitBranchWeights(static_cast<int>(min<int64_t>(backEdges, INT32_MAX)), 1);
+    }
+
     void visit(VarDecl& node) override {
-        // Define the variable ptr
-        RegisterStruct currVar{this->codeBuffer.freshVar(), true};
-        currVar.setRegisterValue(true, 0);
+        // Define the variable ptr. Its known values are tracked by the constant propagation, not here
+        RegisterStruct currVar{this->codeBuffer.freshVar(), false};
+        currVar.setRegisterValue(false);
         const string varID = node.getVarId()->getValueStr();
 
         // allocate memory for the new variable on the stack
         this->codeBuffer << tabs << currVar.name << " = alloca i32" << endl;
 
         RegisterStruct valueReg{this->codeBuffer.freshVar(), true};
-        valueReg.setRegisterValue(true, 0);
         if(node.getVarInitExp()){
+            // The InitExp is loaded first if it is a variable
             node.getVarInitExp()->accept(*this);
-            RegisterStruct expReg{"Undef", true};
-            if (node.getVarInitExp()->getType() == NODE_ID){
-                // The InitExp is a variable that is stored in the memory and we need to load it
-                expReg = this->symbolTable.getRegFromSymTable(node.getVarInitExp()->getValueStr());
-                this->codeBuffer << tabs << valueReg.name << " = load i32, i32* " << expReg.name << endl;
-            } else {
-                // The InitExp is a constant value
-                expReg = node.getVarInitExp()->getRegister();
-                this->codeBuffer << tabs << valueReg.name << " = add i32 " << expReg.name << ", 0" << endl;
-            }
-            valueReg.isZero = expReg.isZero;
-            valueReg.setRegisterValue(expReg.isRegisterValueKnown, expReg.getRegisterValue());
+            RegisterStruct expReg = expressionValue(*node.getVarInitExp());
+            this->codeBuffer << tabs << valueReg.name << " = add i32 " << expReg.name << ", 0" << endl;
         } else {
             // The InitExp is not defined, so we initialize the variable with 0 which is the default value
             this->codeBuffer << tabs << valueReg.name << " = add i32 0, 0" << endl;
-            valueReg.isZero = true;
-            valueReg.setRegisterValue(true, 0);
         }
 
         // Store the value of the initialization expression in the new variable
         this->codeBuffer << tabs << "store i32 " << valueReg.name << ", i32* " << currVar.name << endl;
-        currVar.isZero = valueReg.isZero;
-        currVar.setRegisterValue(valueReg.isRegisterValueKnown, valueReg.getRegisterValue());
         // Add the new variable to the symbol table
         this->symbolTable.addVariableSymbol(node.getValueStr(), node.getVarType(), node.getLine());
         // Set the register name of the variable in the symbol table
@@ -717,37 +1125,26 @@ public:
 
     void visit(Assign& node) override {
         RegisterStruct currVar = this->symbolTable.getRegFromSymTable(node.getValueStr());
-        RegisterStruct tmpVar = {this->codeBuffer.freshVar(), true};
-        RegisterStruct expReg = {"Undef", false};
 
         node.getAssignExp()->accept(*this);
-
-        if(node.getAssignExp()->getType() == NODE_ID) {
-            expReg = this->symbolTable.getRegFromSymTable(node.getAssignExp()->getValueStr());
-            this->codeBuffer << tabs << tmpVar.name << " = load i32, i32* " << expReg.name << endl;
-            this->codeBuffer << tabs << "store i32 " << tmpVar.name << ", i32* " << currVar.name << endl;
-        } else {
-            expReg = node.getAssignExp()->getRegister();
-            this->codeBuffer << tabs << "store i32 " << expReg.name << ", i32* " << currVar.name << endl;
-        }
-        currVar.isZero = expReg.isZero;
-        currVar.setRegisterValue(expReg.isRegisterValueKnown, expReg.getRegisterValue());
-        // cout << node.getValueStr() << " = " << currVar.getRegisterValue() << endl;
-        // cout << node.getValueStr() << " = " << currVar.isZero << endl;
-        // cout << node.getValueStr() << " = " << expReg.isRegisterValueKnown << endl;
-        this->symbolTable.setRegInSymTable(node.getValueStr(), currVar);
+        RegisterStruct expReg = expressionValue(*node.getAssignExp());
+        this->codeBuffer << tabs << "store i32 " << expReg.name << ", i32* " << currVar.name << endl;
     }
 
     void visit(Formal& node) override {
         symbolTable.addParameterSymbol(node.getFormalId(), node.getFormalType(), node.getLine());
-        Symbol* symbol = symbolTable.getSymbol(node.getFormalId());
         
         RegisterStruct newParam = {this->codeBuffer.freshVar(), false};
         newParam.setRegisterValue(false);
 
-        // Get the parameters offset 
         this->codeBuffer << tabs << newParam.name << " = alloca i32" << endl;
-        this->codeBuffer << tabs << "store i32 %" << (0 - symbol->getOffset() - 1) << ", i32* " << newParam.name << endl;
+        // A parameter bound by a specialization is a constant, the clone does not take it
+        auto bound = this->boundParameters.find(node.getFormalId());
+        if (bound != this->boundParameters.end()) {
+            this->codeBuffer << tabs << "store i32 " << bound->second << ", i32* " << newParam.name << endl;
+        } else {
+            this->codeBuffer << tabs << "store i32 %" << this->nextParameter++ << ", i32* " << newParam.name << endl;
+        }
         symbolTable.setRegInSymTable(node.getFormalId(), newParam);
     }
 
@@ -757,16 +1154,50 @@ public:
         }
     }
 
-    void visit(FuncDecl& node) override {
-        vector<BuiltInType> paramsTypes = node.getFuncParams()->getFormalsType();
+    // The block of the function being generated that prints the division error and exits. It is
+    // generated after the function body, so the error path stays out of the hot code.
+    output::Value divisionErrorBlock() {
+        if (!this->divisionErrorLabel.isDefined()) {
+            this->divisionErrorLabel = this->codeBuffer.freshLabel().block(".division_error");
+        }
+        return this->divisionErrorLabel;
+    }
+
+    // The message itself is emitted once for the module
+    void generateDivisionErrorBlock() {
+        this->usesDivisionError = true;
+        const int strSize = DIVISION_ERROR_MESSAGE.size() + 1;
+        const string cold = this->options.branchHints ? " cold" : "";
+        RegisterStruct message{this->codeBuffer.freshVar(), false};
+        this->codeBuffer.emitLabel(this->divisionErrorLabel);
+        this->codeBuffer << tabs << message.name << " = getelementptr [" << strSize << " x i8], [" << strSize << " x i8]* " << DIVISION_ERROR_STRING << ", i32 0, i32 0" << endl;
+        this->codeBuffer << tabs << "call void @print(i8* " << message.name << ")" << cold << endl;
+        this->codeBuffer << tabs << "call void @exit(i32 0)" << cold << endl;
+        this->codeBuffer << tabs << "unreachable" << endl;
+        this->calledRuntimeFunctions.insert({"print", "exit"});
+    }
+
+    // Generates a function under the given name, with the bound parameters replaced by their values
+    void generateFunction(FuncDecl& node, const string& name, const map<string, int32_t>& boundParameters) {
+        vector<string> paramsIds = node.getFuncParams()->getFormalsIds();
         
         string funcPrototype = "define ";
         funcPrototype += (VOID == node.getFuncReturnType()) ? "void " : "i32 ";
-        funcPrototype += "@" + node.getFuncId() + " (";
-        for(auto param : paramsTypes) funcPrototype += "i32, ";
-        funcPrototype = ((paramsTypes.size() != 0) ? funcPrototype.substr(0, funcPrototype.size() - 2) : funcPrototype) + ") {";
+        funcPrototype += "@" + name + " (";
+        for(auto param : paramsIds) {
+            if (!boundParameters.count(param)) {
+                funcPrototype += "i32, ";
+            }
+        }
+        funcPrototype = ((paramsIds.size() != boundParameters.size()) ? funcPrototype.substr(0, funcPrototype.size() - 2) : funcPrototype) + ")";
+        funcPrototype += functionAttributes(node.getFuncId()) + " {";
         
         this->codeBuffer << tabs << funcPrototype << endl;
+        this->currentFunction = name;
+        this->boundParameters = boundParameters;
+        this->nextParameter = 0;
+        this->divisionErrorLabel = output::Value();
+        this->constants.analyze(node, boundParameters);
         CodeGenerator_beginScope(node.getFuncId(), false);
         // TODO - Each Parameter should be added to the scope as was done in HW_3
         node.getFuncParams()->accept(*this);
@@ -776,31 +1207,301 @@ public:
         } else {
             this->codeBuffer << tabs << "ret i32 0" << endl;
         }
+        if (this->divisionErrorLabel.isDefined()) {
+            generateDivisionErrorBlock();
+        }
         CodeGenerator_endScope();
         this->codeBuffer << tabs << "}\n\n";
     }
 
-    void visit(Funcs& node) override {
-        // // The (this) is the ScopePrinter
+    void visit(FuncDecl& node) override {
+        const bool isMemoized = this->analyses->memoization.isMemoized(node.getFuncId());
+        generateFunction(node, isMemoized ? Memoization::computeName(node.getFuncId()) : node.getFuncId(), {});
+        if (isMemoized) {
+            this->analyses->memoization.emitWrapper(this->codeBuffer, node, functionAttributes(node.getFuncId()));
+        }
+    }
+
+    // Generates one task into a buffer of its own, registers, labels and strings are numbered from 0
+    GeneratedFunction generate(const FunctionTask& task) {
+        this->codeBuffer = output::CodeBuffer(task.name);
+        this->loopAnalyzer = LoopAnalyzer(this->options.unrollBudget, this->options.unroll, this->options.hoistInvariants);
+        this->divisionGuards = 0;
+        this->elidedDivisionGuards = 0;
+        this->failingDivisions = 0;
+        this->usesDivisionError = false;
+        this->calledRuntimeFunctions.clear();
+        this->specializationRequests.clear();
+        this->hoistedValues.clear();
+        if (task.isWrapper) {
+            this->analyses->memoization.emitWrapper(this->codeBuffer, *task.function, functionAttributes(task.function->getFuncId()));
+        } else {
+            generateFunction(*task.function, task.name, task.boundParameters);
+        }
+
+        GeneratedFunction generated;
+        generated.code = move(this->codeBuffer);
+        generated.requests = move(this->specializationRequests);
+        generated.loops = this->loopAnalyzer;
+        generated.divisionGuards = this->divisionGuards;
+        generated.elidedDivisionGuards = this->elidedDivisionGuards;
+        generated.failingDivisions = this->failingDivisions;
+        generated.calledRuntimeFunctions = this->calledRuntimeFunctions;
+        generated.usesDivisionError = this->usesDivisionError;
+        return generated;
+    }
+
+    // Decides the calls of a generated function that may go to clones, in the order they were emitted,
+    // and points each one to its clone or back to the function itself
+    void resolveSpecializations(GeneratedFunction& generated) {
+        if (generated.requests.empty()) {
+            return;
+        }
+        unordered_map<string, string> resolved;
+        for (const SpecializationRequest& request : generated.requests) {
+            Specialization clone;
+            string operands = request.unspecializedOperands;
+            if (this->analyses->specializer.specialize(request.function, request.arguments, request.isInLoop, clone)) {
+                operands = request.operands;
+                operands.replace(operands.find(request.placeholder), request.placeholder.size(), "@" + clone.name + "(");
+            }
+            resolved[request.operands] = operands;
+        }
+        for (output::ModuleEntry& entry : generated.code.getEntries()) {
+            if (!entry.isFunction) {
+                continue;
+            }
+            for (output::BlockRecord& block : entry.function.blocks) {
+                for (output::InstructionRecord& instruction : block.instructions) {
+                    auto call = ("call" == instruction.opcode) ? resolved.find(instruction.operands) : resolved.end();
+                    if (call != resolved.end()) {
+                        instruction.operands = call->second;
+                    }
+                }
+            }
+        }
+    }
+
+    // Generates a batch of tasks in parallel and appends their code to the module in the order of the batch
+    void generateFunctions(const vector<FunctionTask>& tasks, ThreadPool& pool, vector<unique_ptr<CodeGenerator>>& workers) {
+        // Generating a function stores registers in the nodes of its declaration, so the tasks of one
+        // declaration (a function and its wrapper, clones of one function) run one after another
+        vector<vector<size_t>> jobs;
+        map<const FuncDecl*, size_t> jobOf;
+        for (size_t task = 0; task < tasks.size(); ++task) {
+            auto job = jobOf.insert({tasks[task].function, jobs.size()});
+            if (job.second) {
+                jobs.emplace_back();
+            }
+            jobs[job.first->second].push_back(task);
+        }
+        vector<GeneratedFunction> generated(tasks.size());
+        // A task is read back from the incremental state when its function and the functions it calls
+        // did not change, the code is saved as generated, before the calls to clones are settled
+        vector<string> keys(tasks.size());
+        vector<string> savedCode(tasks.size());
+        vector<char> isReused(tasks.size(), false);
+        if (this->incremental) {
+            for (size_t task = 0; task < tasks.size(); ++task) {
+                ostringstream text;
+                text << this->fingerprints[tasks[task].function->getFuncId()] << " " << tasks[task].name << " "
+                     << tasks[task].isWrapper;
+                for (const auto& parameter : tasks[task].boundParameters) {
+                    text << " " << parameter.first << "=" << parameter.second;
+                }
+                keys[task] = this->incremental->key(text.str());
+            }
+        }
+        pool.run(jobs.size(), [&](size_t job, size_t worker) {
+            for (size_t task : jobs[job]) {
+                const string* saved = this->incremental ? this->incremental->find(IncrementalState::GENERATED, keys[task]) : nullptr;
+                if (saved) {
+                    istringstream text(*saved);
+                    isReused[task] = generated[task].load(text);
+                }
+                if (!isReused[task]) {
+                    generated[task] = workers[worker]->generate(tasks[task]);
+                    if (this->incremental) {
+                        ostringstream text;
+                        generated[task].save(text);
+                        savedCode[task] = text.str();
+                    }
+                }
+            }
+        });
+
+        for (size_t task = 0; task < tasks.size(); ++task) {
+            GeneratedFunction& function = generated[task];
+            if (this->incremental) {
+                const string& code = isReused[task] ? *this->incremental->find(IncrementalState::GENERATED, keys[task]) : savedCode[task];
+                this->incremental->keep(IncrementalState::GENERATED, keys[task], code, isReused[task]);
+            }
+            resolveSpecializations(function);
+            this->codeBuffer.append(function.code);
+            this->loopAnalyzer.merge(function.loops);
+            this->divisionGuards += function.divisionGuards;
+            this->elidedDivisionGuards += function.elidedDivisionGuards;
+            this->failingDivisions += function.failingDivisions;
+            this->calledRuntimeFunctions.insert(function.calledRuntimeFunctions.begin(), function.calledRuntimeFunctions.end());
+            this->usesDivisionError |= function.usesDivisionError;
+        }
+    }
+
+    void declareFunctions(const Funcs& program) {
         this->symbolTable.addFunctionSymbol("print", BuiltInType::VOID, {BuiltInType::STRING}, {"str"}, -1);
         this->symbolTable.addFunctionSymbol("printi", BuiltInType::VOID, {BuiltInType::INT}, {"num"}, -1);
         //this->symbolTable.addFunctionSymbol("printf", BuiltInType::INT, {BuiltInType::INT}, {"num"}, -1);
         this->symbolTable.addFunctionSymbol("exit", BuiltInType::VOID, {BuiltInType::INT}, {"code"}, -1);
 
-        this->codeBuffer.emit("declare i32 @printf(i8*, ...)");
-        this->codeBuffer.emit("declare void @exit(i32)");
-        this->codeBuffer.emit(PRINTI_Function);
-        this->codeBuffer.emit(PRINT_Function);
-
-        for (auto& funcDecl : node.getFuncs()) {
+        for (auto& funcDecl : program.getFuncs()) {
             this->symbolTable.addFunctionSymbol(funcDecl->getFuncId(), funcDecl->getFuncReturnType(), funcDecl->getFuncParams()->getFormalsType(), 
                 funcDecl->getFuncParams()->getFormalsIds(), funcDecl->getFuncIdLine());
         }
-        Symbol* main = symbolTable.getFuncSymbol("main");
-      
+    }
+
+    // Ahead-of-time mode: the language has no input, so a run of main in the interpreter prints what every
+    // run of the program prints. When the run ends within the budget, main only writes the recorded output.
+    bool generateRecordedRun(const Funcs& program) {
+        ostringstream recorded;
+        Interpreter interpreter(program, recorded, this->options.aheadOfTimeBudget);
+        int32_t ignored = 0;
+        const InterpreterStatus status = interpreter.run("main", {}, ignored);
+        const string text = recorded.str();
+        // Backslashes in string literals reach the LLVM string constants as they are, so what
+        // they print is only known to the generated code
+        if ((RUN_FINISHED != status && RUN_EXITED != status) || string::npos != text.find('\\')) {
+            return false;
+        }
+
+        this->codeBuffer << tabs << "define void @main () {" << endl;
+        if (!text.empty()) {
+            const string specifier = this->codeBuffer.emitString("%s");
+            const string textIdentifier = this->codeBuffer.emitBytes(text);
+            const output::Value specifierPtr = this->codeBuffer.freshVar();
+            const output::Value textPtr = this->codeBuffer.freshVar();
+            this->codeBuffer << tabs << specifierPtr << " = getelementptr [3 x i8], [3 x i8]* " << specifier << ", i32 0, i32 0" << endl;
+            this->codeBuffer << tabs << textPtr << " = getelementptr [" << text.size() + 1 << " x i8], [" << text.size() + 1 << " x i8]* " << textIdentifier << ", i32 0, i32 0" << endl;
+            this->codeBuffer << tabs << "call i32 (i8*, ...) @printf(i8* " << specifierPtr << ", i8* " << textPtr << ")" << endl;
+        }
+        // The division error was the last output, the program exits as the generated division would
+        if (RUN_EXITED == status) {
+            this->codeBuffer << tabs << "call void @exit(i32 0)" << endl;
+        }
+        this->codeBuffer << tabs << "ret void" << endl;
+        this->codeBuffer << tabs << "}\n\n";
+        this->codeBuffer.emit("declare i32 @printf(i8*, ...)");
+        if (RUN_EXITED == status) {
+            this->codeBuffer.emit("declare void @exit(i32)");
+        }
+        return true;
+    }
+
+    void visit(Funcs& node) override {
+        if (this->options.aheadOfTime && generateRecordedRun(node)) {
+            return;
+        }
+        // Functions main never calls, directly or indirectly, are not generated
+        ProgramAnalyses& program = *this->analyses;
+        program.callGraph.build(node);
+        program.effects.analyze(node, program.callGraph);
+        if (this->options.memoize) {
+            program.memoization.analyze(node, program.callGraph, program.effects);
+        }
+        program.pureCalls.setProgram(node, program.effects.getPureFunctions(), this->options.evaluationBudget);
+        program.specializer.setProgram(node, program.callGraph, program.memoization, this->options.specializeBudget);
+        if (this->incremental) {
+            this->fingerprints = FunctionFingerprint::of(node, program.callGraph, program.effects, program.memoization);
+        }
+        vector<FunctionTask> tasks;
         for(auto& funcDecl : node.getFuncs()) {
-            funcDecl->accept(*this);
+            const string name = funcDecl->getFuncId();
+            if (this->options.removeUnusedFunctions && !program.callGraph.isReachable(name)) {
+                continue;
+            }
+            if (program.memoization.isMemoized(name)) {
+                tasks.push_back({funcDecl.get(), Memoization::computeName(name), {}, false});
+                tasks.push_back({funcDecl.get(), name, {}, true});
+            } else {
+                tasks.push_back({funcDecl.get(), name, {}, false});
+            }
+        }
+
+        // Every function is generated on its own by one of the threads. The buffers are appended in the
+        // order of the tasks, so the module is the same for any number of threads.
+        ThreadPool pool(this->options.threads);
+        vector<unique_ptr<CodeGenerator>> workers;
+        for (size_t worker = 0; worker < pool.size(); ++worker) {
+            workers.push_back(make_unique<CodeGenerator>(this->options, this->analyses, node));
+        }
+        // Clones requested by the call sites follow in the order of the requests, generating a clone may
+        // request more
+        while (!tasks.empty()) {
+            generateFunctions(tasks, pool, workers);
+            tasks.clear();
+            while (program.specializer.hasPending()) {
+                const Specialization clone = program.specializer.takePending();
+                tasks.push_back({const_cast<FuncDecl*>(clone.function), clone.name, clone.boundParameters, false});
+            }
         }
+        if (this->usesDivisionError) {
+            this->codeBuffer.emitString(DIVISION_ERROR_MESSAGE, DIVISION_ERROR_STRING);
+        }
+
+        // The runtime helpers follow the program, only those the generated code calls are needed
+        const bool keepAll = !this->options.removeUnusedFunctions;
+        const bool callsPrint = keepAll || this->calledRuntimeFunctions.count("print");
+        const bool callsPrinti = keepAll || this->calledRuntimeFunctions.count("printi");
+        if (callsPrint || callsPrinti) {
+            this->codeBuffer.emit("declare i32 @printf(i8*, ...)");
+        }
+        if (keepAll || this->calledRuntimeFunctions.count("exit")) {
+            string exitAttributes = this->options.functionAttributes ? " noreturn nounwind" : "";
+            exitAttributes = (this->options.branchHints ? " cold" : "") + exitAttributes;
+            this->codeBuffer.emit("declare void @exit(i32)" + exitAttributes);
+        }
+        if (callsPrinti) {
+            this->codeBuffer.emit(PRINTI_Function);
+        }
+        if (callsPrint) {
+            this->codeBuffer.emit(PRINT_Function);
+        }
+    }
+
+    void setIncrementalState(IncrementalState* state) {
+        this->incremental = state;
+    }
+
+    const LoopAnalyzer& getLoopAnalyzer() const {
+        return this->loopAnalyzer;
+    }
+
+    const CallGraph& getCallGraph() const {
+        return this->analyses->callGraph;
+    }
+
+    const FunctionEffects& getFunctionEffects() const {
+        return this->analyses->effects;
+    }
+
+    void printDivisionReport(ostream& os) const {
+        os << "division guards: " << this->divisionGuards << " emitted, " << this->elidedDivisionGuards
+           << " elided (divisor proven non-zero), " << this->failingDivisions << " always failing (divisor proven zero)" << endl;
+    }
+
+    const FunctionSpecializer& getSpecializer() const {
+        return this->analyses->specializer;
+    }
+
+    const Memoization& getMemoization() const {
+        return this->analyses->memoization;
+    }
+
+    const PureCallEvaluator& getPureCalls() const {
+        return this->analyses->pureCalls;
+    }
+
+    output::CodeBuffer& getCodeBuffer() {
+        return this->codeBuffer;
     }
 
     void printBuffer() {
@@ -0,0 +1,562 @@
+#ifndef ASSEMBLY_GENERATOR_HPP
+#define ASSEMBLY_GENERATOR_HPP
+
+#include "visitor.hpp"
+#include "nodes.hpp"
+#include "bytecode.hpp"
+#include "registerAllocator.hpp"
+#include <string>
+#include <vector>
+#include <set>
+#include <sstream>
+#include <iostream>
+#include <cstdint>
+
+using namespace std;
+using namespace ast;
+
+/* AssemblyGenerator class
+ * Native backend: translates the program to GNU assembler x86-64 for Linux, without LLVM. The program is
+ * lowered to bytecode as for the virtual machine, the registers of every function are placed with the
+ * linear scan allocator, and each instruction becomes a few machine instructions working on 32-bit values.
+ * Functions follow the System V calling convention and are named "fn_" + their name, so they never clash
+ * with the runtime or the C library. The runtime is part of the output: print and printi append to a
+ * buffer that is written with system calls when full and at exit, and the division error exits through it.
+ * The output links with "as" and "ld" (a weak _start calls main) as well as with "cc".
+ */
+class AssemblyGenerator : public Visitor {
+private:
+    struct MachineRegister {
+        const char* name64;
+        const char* name32;
+    };
+
+    // rax, rcx and rdx are scratch registers of the translated instructions and never allocated
+    static constexpr int CALLEE_SAVED_REGISTERS = 5;
+    static constexpr int ALLOCATED_REGISTERS = 11;
+
+    static const MachineRegister& machineRegister(int index) {
+        static const MachineRegister registers[ALLOCATED_REGISTERS] = {
+            {"%rbx", "%ebx"}, {"%r12", "%r12d"}, {"%r13", "%r13d"}, {"%r14", "%r14d"}, {"%r15", "%r15d"},
+            {"%rsi", "%esi"}, {"%rdi", "%edi"}, {"%r8", "%r8d"}, {"%r9", "%r9d"}, {"%r10", "%r10d"}, {"%r11", "%r11d"}
+        };
+        return registers[index];
+    }
+
+    static const char* argumentRegister(int index) {
+        static const char* const registers[] = {"%rdi", "%rsi", "%rdx", "%rcx", "%r8", "%r9"};
+        return registers[index];
+    }
+
+    static constexpr int ARGUMENT_REGISTERS = 6;
+
+    ostringstream text;
+    ostringstream data;
+    BytecodeProgram program;
+    LinearScanAllocator allocator{CALLEE_SAVED_REGISTERS, ALLOCATED_REGISTERS};
+    string functionName;
+    int savedRegisters = 0;
+
+    string label(int32_t instruction) const {
+        return ".L" + functionName + "_" + to_string(instruction);
+    }
+
+    bool inRegister(int bytecodeRegister) const {
+        return Location::MACHINE_REGISTER == allocator.locationOf(bytecodeRegister).kind;
+    }
+
+    bool isDead(int bytecodeRegister) const {
+        return Location::NONE == allocator.locationOf(bytecodeRegister).kind;
+    }
+
+    // Operand of a bytecode register, 32 or 64 bits wide. Stack slots are 8 bytes below the saved registers.
+    string operand(int bytecodeRegister, bool wide = false) const {
+        const Location& location = allocator.locationOf(bytecodeRegister);
+        if (Location::MACHINE_REGISTER == location.kind) {
+            return wide ? machineRegister(location.index).name64 : machineRegister(location.index).name32;
+        }
+        return to_string(-8 * (savedRegisters + location.index + 1)) + "(%rbp)";
+    }
+
+    static string immediate(int32_t value) {
+        return "$" + to_string(value);
+    }
+
+    // k when the value is 2^k, -1 otherwise
+    static int powerOfTwo(int32_t value) {
+        if (value <= 0 || (value & (value - 1))) {
+            return -1;
+        }
+        int shift = 0;
+        while (value >>= 1) {
+            ++shift;
+        }
+        return shift;
+    }
+
+    void emit(const string& instruction) {
+        text << "\t" << instruction << "\n";
+    }
+
+    void move(int target, const string& source) {
+        if (!isDead(target) && source != operand(target)) {
+            if (!inRegister(target) && '%' != source[0] && '$' != source[0]) {
+                emit("movl " + source + ", %eax");
+                emit("movl %eax, " + operand(target));
+            } else {
+                emit("movl " + source + ", " + operand(target));
+            }
+        }
+    }
+
+    // target = left op right for add, sub and imul, in the target register when it does not hold right
+    void arithmetic(const string& mnemonic, const Instruction& instruction, bool isByte) {
+        if (isDead(instruction.a)) {
+            return;
+        }
+        string result = "%eax";
+        if (inRegister(instruction.a) && operand(instruction.a) != operand(instruction.c)) {
+            result = operand(instruction.a);
+        }
+        if (operand(instruction.b) != result) {
+            emit("movl " + operand(instruction.b) + ", " + result);
+        }
+        emit(mnemonic + " " + operand(instruction.c) + ", " + result);
+        if (isByte) {
+            emit("andl $255, " + result);
+        }
+        move(instruction.a, result);
+    }
+
+    void division(const Instruction& instruction, bool isByte) {
+        emit("movl " + operand(instruction.c) + ", %ecx");
+        emit("testl %ecx, %ecx");
+        emit("je hw5_division_error");
+        emit("movl " + operand(instruction.b) + ", %eax");
+        emit("cltd");
+        emit("idivl %ecx");
+        if (isByte) {
+            emit("andl $255, %eax");
+        }
+        move(instruction.a, "%eax");
+    }
+
+    void compareAndBranch(const Instruction& instruction, const string& right) {
+        static const char* const jumps[] = {"je", "jne", "jl", "jg", "jle", "jge"};
+        const bool isImmediate = instruction.opcode >= OP_JUMP_EQ_IMM;
+        const int relation = instruction.opcode - (isImmediate ? OP_JUMP_EQ_IMM : OP_JUMP_EQ);
+        string left = operand(instruction.a);
+        if (!inRegister(instruction.a) && '%' != right[0] && '$' != right[0]) {
+            emit("movl " + left + ", %eax");
+            left = "%eax";
+        }
+        emit("cmpl " + right + ", " + left);
+        emit(string(jumps[relation]) + " " + label(instruction.c));
+    }
+
+    void call(const Instruction& instruction) {
+        const BytecodeFunction& callee = program.functions[instruction.b];
+        const int arguments = callee.parameters;
+        const int stackArguments = max(0, arguments - ARGUMENT_REGISTERS);
+        // The stack stays 16 byte aligned at the call
+        const int padding = (stackArguments % 2) ? 8 : 0;
+        if (padding) {
+            emit("subq $8, %rsp");
+        }
+        for (int i = arguments - 1; i >= 0; --i) {
+            emit("pushq " + operand(instruction.c + i, true));
+        }
+        for (int i = 0; i < min(arguments, ARGUMENT_REGISTERS); ++i) {
+            emit(string("popq ") + argumentRegister(i));
+        }
+        emit("call fn_" + callee.name);
+        if (stackArguments || padding) {
+            emit("addq " + immediate(8 * stackArguments + padding) + ", %rsp");
+        }
+        move(instruction.a, "%eax");
+    }
+
+    void translate(size_t position, const Instruction& instruction, size_t end) {
+        switch (instruction.opcode) {
+            case OP_CONST:
+                move(instruction.a, immediate(instruction.b));
+                break;
+            case OP_MOVE:
+                move(instruction.a, operand(instruction.b));
+                break;
+            case OP_ADD: arithmetic("addl", instruction, false); break;
+            case OP_SUB: arithmetic("subl", instruction, false); break;
+            case OP_MUL: arithmetic("imull", instruction, false); break;
+            case OP_ADD_BYTE: arithmetic("addl", instruction, true); break;
+            case OP_SUB_BYTE: arithmetic("subl", instruction, true); break;
+            case OP_MUL_BYTE: arithmetic("imull", instruction, true); break;
+            case OP_DIV: division(instruction, false); break;
+            case OP_DIV_BYTE: division(instruction, true); break;
+            case OP_ADD_IMM:
+                if (!isDead(instruction.a)) {
+                    if (inRegister(instruction.a) && inRegister(instruction.b)) {
+                        emit("leal " + to_string(instruction.c) + "(" + operand(instruction.b, true) + "), " + operand(instruction.a));
+                    } else {
+                        emit("movl " + operand(instruction.b) + ", %eax");
+                        emit("addl " + immediate(instruction.c) + ", %eax");
+                        move(instruction.a, "%eax");
+                    }
+                }
+                break;
+            case OP_MUL_IMM:
+                if (!isDead(instruction.a)) {
+                    const string result = inRegister(instruction.a) ? operand(instruction.a) : "%eax";
+                    emit("imull " + immediate(instruction.c) + ", " + operand(instruction.b) + ", " + result);
+                    move(instruction.a, result);
+                }
+                break;
+            case OP_DIV_IMM:
+                if (!isDead(instruction.a)) {
+                    emit("movl " + operand(instruction.b) + ", %eax");
+                    const int shift = powerOfTwo(instruction.c);
+                    if (shift > 0) {
+                        // Round toward zero: negative dividends get 2^shift - 1 added before the shift
+                        emit("movl %eax, %edx");
+                        emit("sarl $31, %edx");
+                        emit("shrl $" + to_string(32 - shift) + ", %edx");
+                        emit("addl %edx, %eax");
+                        emit("sarl $" + to_string(shift) + ", %eax");
+                    } else {
+                        emit("movl " + immediate(instruction.c) + ", %ecx");
+                        emit("cltd");
+                        emit("idivl %ecx");
+                    }
+                    move(instruction.a, "%eax");
+                }
+                break;
+            case OP_TRUNC_BYTE:
+                if (!isDead(instruction.a)) {
+                    emit("movzbl " + byteOperand(instruction.b) + ", %eax");
+                    move(instruction.a, "%eax");
+                }
+                break;
+            case OP_JUMP:
+                if (static_cast<size_t>(instruction.a) != position + 1) {
+                    emit("jmp " + label(instruction.a));
+                }
+                break;
+            case OP_JUMP_ZERO:
+            case OP_JUMP_NONZERO:
+                emit("cmpl $0, " + operand(instruction.a));
+                emit(string(OP_JUMP_ZERO == instruction.opcode ? "je " : "jne ") + label(instruction.b));
+                break;
+            case OP_JUMP_EQ: case OP_JUMP_NE: case OP_JUMP_LT: case OP_JUMP_GT: case OP_JUMP_LE: case OP_JUMP_GE:
+                compareAndBranch(instruction, operand(instruction.b));
+                break;
+            case OP_JUMP_EQ_IMM: case OP_JUMP_NE_IMM: case OP_JUMP_LT_IMM:
+            case OP_JUMP_GT_IMM: case OP_JUMP_LE_IMM: case OP_JUMP_GE_IMM:
+                compareAndBranch(instruction, immediate(instruction.b));
+                break;
+            case OP_CALL:
+                call(instruction);
+                break;
+            case OP_RETURN:
+                emit("movl " + operand(instruction.a) + ", %eax");
+                if (position + 1 != end) {
+                    emit("jmp .L" + functionName + "_return");
+                }
+                break;
+            case OP_RETURN_VOID:
+                emit("xorl %eax, %eax");
+                if (position + 1 != end) {
+                    emit("jmp .L" + functionName + "_return");
+                }
+                break;
+            case OP_PRINT:
+                emit("leaq .Lstring" + to_string(instruction.a) + "(%rip), %rdi");
+                emit("call hw5_print");
+                break;
+            case OP_PRINTI:
+                emit("movl " + operand(instruction.a) + ", %edi");
+                emit("call hw5_printi");
+                break;
+            default:
+                break;
+        }
+    }
+
+    // Low byte of a bytecode register, for the zero extension of byte casts
+    string byteOperand(int bytecodeRegister) const {
+        const Location& location = allocator.locationOf(bytecodeRegister);
+        if (Location::MACHINE_REGISTER != location.kind) {
+            return operand(bytecodeRegister);
+        }
+        static const char* const names[ALLOCATED_REGISTERS] = {
+            "%bl", "%r12b", "%r13b", "%r14b", "%r15b", "%sil", "%dil", "%r8b", "%r9b", "%r10b", "%r11b"
+        };
+        return names[location.index];
+    }
+
+    void generateFunction(size_t index) {
+        const BytecodeFunction& function = program.functions[index];
+        const size_t end = program.functionEnd(index);
+        allocator.allocate(program, index);
+        functionName = function.name;
+
+        vector<const char*> saved;
+        for (int m = 0; m < CALLEE_SAVED_REGISTERS; ++m) {
+            if (allocator.isUsed(m)) {
+                saved.push_back(machineRegister(m).name64);
+            }
+        }
+        savedRegisters = saved.size();
+        // rbp and the saved registers, then the stack slots, rounded to keep rsp 16 byte aligned
+        const int frameBytes = 8 * (savedRegisters + allocator.getStackSlots());
+        const int slotBytes = 8 * allocator.getStackSlots() + ((frameBytes % 16) ? 8 : 0);
+
+        text << "\n\t.type fn_" << function.name << ", @function\n";
+        text << "fn_" << function.name << ":\n";
+        emit("pushq %rbp");
+        emit("movq %rsp, %rbp");
+        for (const char* name : saved) {
+            emit(string("pushq ") + name);
+        }
+        if (slotBytes) {
+            emit("subq " + immediate(slotBytes) + ", %rsp");
+        }
+
+        // Incoming arguments: the register ones through the stack, so no argument is overwritten before it is read
+        const int registerParameters = min(function.parameters, ARGUMENT_REGISTERS);
+        for (int i = 0; i < registerParameters; ++i) {
+            emit(string("pushq ") + argumentRegister(i));
+        }
+        for (int i = registerParameters - 1; i >= 0; --i) {
+            emit("popq " + (allocator.isLiveParameter(i) ? operand(i, true) : string("%rax")));
+        }
+        for (int i = ARGUMENT_REGISTERS; i < function.parameters; ++i) {
+            if (allocator.isLiveParameter(i)) {
+                move(i, to_string(16 + 8 * (i - ARGUMENT_REGISTERS)) + "(%rbp)");
+            }
+        }
+
+        set<size_t> targets;
+        for (size_t i = function.entry; i < end; ++i) {
+            const Instruction& instruction = program.code[i];
+            if (OP_JUMP == instruction.opcode) {
+                targets.insert(instruction.a);
+            } else if (OP_JUMP_ZERO == instruction.opcode || OP_JUMP_NONZERO == instruction.opcode) {
+                targets.insert(instruction.b);
+            } else if (instruction.opcode >= OP_JUMP_EQ && instruction.opcode <= OP_JUMP_GE_IMM) {
+                targets.insert(instruction.c);
+            }
+        }
+        for (size_t i = function.entry; i < end; ++i) {
+            if (targets.count(i)) {
+                text << label(i) << ":\n";
+            }
+            translate(i, program.code[i], end);
+        }
+
+        text << ".L" << function.name << "_return:\n";
+        if (savedRegisters) {
+            emit("leaq " + to_string(-8 * savedRegisters) + "(%rbp), %rsp");
+        }
+        for (size_t i = saved.size(); i-- > 0;) {
+            emit(string("popq ") + saved[i]);
+        }
+        emit("popq %rbp");
+        emit("ret");
+        text << "\t.size fn_" << function.name << ", .-fn_" << function.name << "\n";
+    }
+
+    static string escaped(const string& value) {
+        string result;
+        for (char c : value) {
+            if ('"' == c || '\\' == c) {
+                result += '\\';
+            }
+            result += c;
+        }
+        return result;
+    }
+
+    void generateRuntime() {
+        static const char* const runtime = R"(
+	.equ HW5_BUFFER_SIZE, 65536
+
+# Writes the buffered output, preserves every register but rax, rcx, rdx, rsi, rdi and r11
+hw5_flush:
+	movq hw5_buffered(%rip), %rdx
+	leaq hw5_buffer(%rip), %rsi
+.Lhw5_flush_loop:
+	testq %rdx, %rdx
+	jle .Lhw5_flush_done
+	movl $1, %eax
+	movl $1, %edi
+	syscall
+	testq %rax, %rax
+	jle .Lhw5_flush_done
+	addq %rax, %rsi
+	subq %rax, %rdx
+	jmp .Lhw5_flush_loop
+.Lhw5_flush_done:
+	movq $0, hw5_buffered(%rip)
+	ret
+
+# Appends the byte in al to the buffer, preserves every register but rcx and rdx
+hw5_put:
+	movq hw5_buffered(%rip), %rcx
+	cmpq $HW5_BUFFER_SIZE, %rcx
+	jb .Lhw5_put_store
+	pushq %rax
+	pushq %rsi
+	pushq %rdi
+	pushq %r11
+	call hw5_flush
+	popq %r11
+	popq %rdi
+	popq %rsi
+	popq %rax
+	xorl %ecx, %ecx
+.Lhw5_put_store:
+	leaq hw5_buffer(%rip), %rdx
+	movb %al, (%rdx,%rcx)
+	incq %rcx
+	movq %rcx, hw5_buffered(%rip)
+	ret
+
+# print: the string at rdi and a newline
+hw5_print:
+	movb (%rdi), %al
+	testb %al, %al
+	je .Lhw5_print_done
+	call hw5_put
+	incq %rdi
+	jmp hw5_print
+.Lhw5_print_done:
+	movb $10, %al
+	jmp hw5_put
+
+# printi: edi in decimal and a newline
+hw5_printi:
+	subq $24, %rsp
+	movslq %edi, %rax
+	movq %rax, %r8
+	testq %rax, %rax
+	jns .Lhw5_printi_positive
+	negq %rax
+.Lhw5_printi_positive:
+	leaq 16(%rsp), %rsi
+	movq %rsi, %r9
+	movl $10, %ecx
+.Lhw5_printi_digit:
+	xorl %edx, %edx
+	divq %rcx
+	addb $48, %dl
+	decq %rsi
+	movb %dl, (%rsi)
+	testq %rax, %rax
+	jne .Lhw5_printi_digit
+	testq %r8, %r8
+	jns .Lhw5_printi_copy
+	decq %rsi
+	movb $45, (%rsi)
+.Lhw5_printi_copy:
+	cmpq %r9, %rsi
+	je .Lhw5_printi_done
+	movb (%rsi), %al
+	call hw5_put
+	incq %rsi
+	jmp .Lhw5_printi_copy
+.Lhw5_printi_done:
+	addq $24, %rsp
+	movb $10, %al
+	jmp hw5_put
+
+# Flushes the output and exits with status 0
+hw5_exit:
+	call hw5_flush
+	movl $231, %eax
+	xorl %edi, %edi
+	syscall
+
+hw5_division_error:
+	leaq hw5_division_message(%rip), %rdi
+	call hw5_print
+	jmp hw5_exit
+
+	.globl main
+	.type main, @function
+main:
+	pushq %rbp
+	call fn_main
+	call hw5_flush
+	xorl %eax, %eax
+	popq %rbp
+	ret
+
+# Entry point when linked without the C runtime
+	.weak _start
+_start:
+	call main
+	jmp hw5_exit
+
+	.section .rodata
+hw5_division_message:
+	.asciz "Error division by zero"
+
+	.bss
+	.align 8
+hw5_buffered:
+	.zero 8
+hw5_buffer:
+	.zero HW5_BUFFER_SIZE
+
+	.section .note.GNU-stack,"",@progbits
+)";
+        text << runtime;
+    }
+
+public:
+    void visit(Funcs& node) override {
+        program = BytecodeCompiler(false).compile(node);
+        text.str("");
+        text << "\t.text\n";
+        for (size_t i = 0; i < program.functions.size(); ++i) {
+            generateFunction(i);
+        }
+        generateRuntime();
+        data.str("");
+        data << "\t.section .rodata\n";
+        for (size_t i = 0; i < program.strings.size(); ++i) {
+            data << ".Lstring" << i << ":\n\t.asciz \"" << escaped(program.strings[i]) << "\"\n";
+        }
+    }
+
+    void print(ostream& os) const {
+        os << text.str() << "\n" << data.str();
+    }
+
+    void visit(Num& node) override {}
+    void visit(NumB& node) override {}
+    void visit(String& node) override {}
+    void visit(Bool& node) override {}
+    void visit(ID& node) override {}
+    void visit(BinOp& node) override {}
+    void visit(RelOp& node) override {}
+    void visit(Not& node) override {}
+    void visit(And& node) override {}
+    void visit(Or& node) override {}
+    void visit(Type& node) override {}
+    void visit(Cast& node) override {}
+    void visit(ExpList& node) override {}
+    void visit(Call& node) override {}
+    void visit(Statements& node) override {}
+    void visit(Break& node) override {}
+    void visit(Continue& node) override {}
+    void visit(Return& node) override {}
+    void visit(If& node) override {}
+    void visit(While& node) override {}
+    void visit(VarDecl& node) override {}
+    void visit(Assign& node) override {}
+    void visit(Formal& node) override {}
+    void visit(Formals& node) override {}
+    void visit(FuncDecl& node) override {}
+};
+
+#endif // ASSEMBLY_GENERATOR_HPP
@@ -0,0 +1,1227 @@
+#ifndef BITCODE_WRITER_HPP
+#define BITCODE_WRITER_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <sstream>
+#include <ostream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdint>
+#include <cctype>
+
+using namespace std;
+
+/* BitstreamWriter class
+ * The container format of LLVM bitcode: fixed width fields and variable width (VBR) integers packed LSB
+ * first into 32-bit little endian words, and nested blocks whose length in words is patched in when they
+ * end. Records are written unabbreviated, except blobs, which only an abbreviation can carry.
+ */
+class BitstreamWriter {
+private:
+    static constexpr unsigned END_BLOCK = 0;
+    static constexpr unsigned ENTER_SUBBLOCK = 1;
+    static constexpr unsigned DEFINE_ABBREV = 2;
+    static constexpr unsigned UNABBREV_RECORD = 3;
+    static constexpr unsigned FIRST_ABBREVIATION = 4;
+    static constexpr unsigned BLOB_ENCODING = 5;
+
+    struct OpenBlock {
+        size_t lengthWord;
+        unsigned outerWidth;
+        unsigned outerAbbreviations;
+    };
+
+    vector<uint32_t> words;
+    // Bits that do not fill a word yet
+    uint64_t pending = 0;
+    unsigned pendingBits = 0;
+    // Abbreviation id width and abbreviations defined in the current block
+    unsigned width = 2;
+    unsigned abbreviations = 0;
+    vector<OpenBlock> blocks;
+
+public:
+    void emit(uint64_t value, unsigned bits) {
+        pending |= (value & ((uint64_t(1) << bits) - 1)) << pendingBits;
+        pendingBits += bits;
+        while (pendingBits >= 32) {
+            words.push_back(static_cast<uint32_t>(pending));
+            pending >>= 32;
+            pendingBits -= 32;
+        }
+    }
+
+    void emitVBR(uint64_t value, unsigned bits) {
+        const uint64_t continuation = uint64_t(1) << (bits - 1);
+        while (value >= continuation) {
+            emit((value & (continuation - 1)) | continuation, bits);
+            value >>= bits - 1;
+        }
+        emit(value, bits);
+    }
+
+    void alignToWord() {
+        if (pendingBits) {
+            emit(0, 32 - pendingBits);
+        }
+    }
+
+    void enterBlock(unsigned id, unsigned blockWidth = 4) {
+        emit(ENTER_SUBBLOCK, width);
+        emitVBR(id, 8);
+        emitVBR(blockWidth, 4);
+        alignToWord();
+        blocks.push_back({words.size(), width, abbreviations});
+        emit(0, 32);
+        width = blockWidth;
+        abbreviations = 0;
+    }
+
+    void exitBlock() {
+        emit(END_BLOCK, width);
+        alignToWord();
+        const OpenBlock block = blocks.back();
+        blocks.pop_back();
+        words[block.lengthWord] = static_cast<uint32_t>(words.size() - block.lengthWord - 1);
+        width = block.outerWidth;
+        abbreviations = block.outerAbbreviations;
+    }
+
+    void record(unsigned code, const vector<uint64_t>& operands) {
+        emit(UNABBREV_RECORD, width);
+        emitVBR(code, 6);
+        emitVBR(operands.size(), 6);
+        for (uint64_t operand : operands) {
+            emitVBR(operand, 6);
+        }
+    }
+
+    // Record of a literal code and a blob, through an abbreviation defined for it on the spot
+    void blobRecord(unsigned code, const string& blob) {
+        emit(DEFINE_ABBREV, width);
+        emitVBR(2, 5);
+        emit(1, 1);
+        emitVBR(code, 8);
+        emit(0, 1);
+        emit(BLOB_ENCODING, 3);
+        emit(FIRST_ABBREVIATION + abbreviations++, width);
+        emitVBR(blob.size(), 6);
+        alignToWord();
+        for (unsigned char c : blob) {
+            emit(c, 8);
+        }
+        alignToWord();
+    }
+
+    // The stream so far, complete once every block is closed
+    string bytes() const {
+        string result;
+        for (uint32_t word : words) {
+            for (int shift = 0; shift < 32; shift += 8) {
+                result += static_cast<char>((word >> shift) & 255);
+            }
+        }
+        return result;
+    }
+};
+
+/* BitcodeWriter class
+ * Writes the LLVM IR text hw5 generates as an LLVM 14 bitcode module, without linking against LLVM. It reads
+ * the subset of the textual IR the code generator, the passes and the runtime emit: string constants and
+ * zero initialized tables, declarations and definitions with function attributes, the instructions alloca,
+ * load, store, the integer binary operators, icmp, trunc, zext, sext, select, getelementptr, call, br, ret
+ * and unreachable, and metadata nodes attached to instructions (branch weights, loop hints).
+ * Global names go to the string table, local value and block names to the function symbol tables, so
+ * llvm-dis prints the same module as for the text. Anything outside the subset throws a runtime_error.
+ */
+class BitcodeWriter {
+private:
+    // Block ids, record codes and enumerations of the LLVM 14 bitcode format
+    enum BlockId {
+        MODULE_BLOCK = 8, PARAMATTR_BLOCK = 9, PARAMATTR_GROUP_BLOCK = 10, CONSTANTS_BLOCK = 11,
+        FUNCTION_BLOCK = 12, IDENTIFICATION_BLOCK = 13, VALUE_SYMTAB_BLOCK = 14, METADATA_BLOCK = 15,
+        METADATA_ATTACHMENT_BLOCK = 16, TYPE_BLOCK = 17, METADATA_KIND_BLOCK = 22, STRTAB_BLOCK = 23
+    };
+    enum RecordCode {
+        IDENTIFICATION_STRING = 1, IDENTIFICATION_EPOCH = 2,
+        MODULE_VERSION = 1, MODULE_GLOBALVAR = 7, MODULE_FUNCTION = 8,
+        PARAMATTR_ENTRY = 2, PARAMATTR_GROUP_ENTRY = 3,
+        TYPE_NUMENTRY = 1, TYPE_VOID = 2, TYPE_LABEL = 5, TYPE_INTEGER = 7, TYPE_POINTER = 8, TYPE_ARRAY = 11,
+        TYPE_METADATA = 16, TYPE_FUNCTION = 21,
+        CONSTANT_SETTYPE = 1, CONSTANT_NULL = 2, CONSTANT_INTEGER = 4, CONSTANT_STRING = 8, CONSTANT_CSTRING = 9,
+        METADATA_STRING = 1, METADATA_VALUE = 2, METADATA_NODE = 3, METADATA_DISTINCT_NODE = 5, METADATA_KIND = 6,
+        METADATA_ATTACHMENT = 11,
+        FUNCTION_DECLAREBLOCKS = 1, INST_BINOP = 2, INST_CAST = 3, INST_RET = 10, INST_BR = 11,
+        INST_UNREACHABLE = 15, INST_ALLOCA = 19, INST_LOAD = 20, INST_CMP2 = 28, INST_VSELECT = 29,
+        INST_CALL = 34, INST_GEP = 43, INST_STORE = 44,
+        VST_ENTRY = 1, VST_BBENTRY = 2,
+        STRTAB_BLOB = 1
+    };
+    static constexpr uint64_t FUNCTION_ATTRIBUTES_INDEX = 0xFFFFFFFF;
+    static constexpr uint64_t CALL_EXPLICIT_TYPE = uint64_t(1) << 15;
+    static constexpr uint64_t ALLOCA_EXPLICIT_TYPE = uint64_t(1) << 6;
+
+    struct Type {
+        enum Kind { VOID, INTEGER, POINTER, ARRAY, FUNCTION, LABEL, METADATA };
+        Kind kind = VOID;
+        uint64_t size = 0;  // Bits of an integer, elements of an array
+        int element = -1;   // Pointee, array element or return type
+        vector<int> parameters;
+        bool vararg = false;
+    };
+
+    struct Operand {
+        enum Kind { LOCAL, GLOBAL, CONSTANT };
+        Kind kind = CONSTANT;
+        string name;
+        int64_t value = 0;
+        int type = -1;
+    };
+
+    struct Instruction {
+        string result;
+        string opcode;
+        // Allocated, loaded, cast destination, GEP source element or called function type
+        int type = -1;
+        vector<Operand> operands;
+        vector<string> targets;
+        uint64_t code = 0;
+        bool inbounds = false;
+        string attributes;
+        vector<pair<string, string>> attachments;
+    };
+
+    struct Block {
+        string name;
+        vector<Instruction> instructions;
+    };
+
+    struct Function {
+        string name;
+        int type = -1;
+        bool defined = false;
+        string attributes;
+        vector<string> parameterNames;
+        vector<Block> blocks;
+    };
+
+    struct Global {
+        string name;
+        int type = -1;
+        bool constant = false;
+        uint64_t linkage = 0;
+        int initializer = -1;
+    };
+
+    struct Constant {
+        enum Kind { INTEGER, STRING, ZERO };
+        Kind kind = INTEGER;
+        int type = -1;
+        int64_t value = 0;
+        string bytes;
+    };
+
+    struct MetadataElement {
+        enum Kind { NODE, STRING, VALUE };
+        Kind kind = NODE;
+        string text;  // Node name or string
+        int type = -1;
+        int64_t value = 0;
+    };
+
+    struct MetadataNode {
+        string name;
+        bool distinct = false;
+        vector<MetadataElement> elements;
+    };
+
+    // Tokens of one line, with the position of the next one
+    struct Cursor {
+        vector<string> tokens;
+        size_t position = 0;
+        string line;
+
+        bool atEnd() const {
+            return position >= tokens.size();
+        }
+
+        const string& peek() const {
+            static const string end;
+            return atEnd() ? end : tokens[position];
+        }
+
+        string next() {
+            if (atEnd()) {
+                throw runtime_error("unexpected end of line in '" + line + "'");
+            }
+            return tokens[position++];
+        }
+
+        void expect(const string& token) {
+            if (next() != token) {
+                throw runtime_error("expected '" + token + "' in '" + line + "'");
+            }
+        }
+
+        bool accept(const string& token) {
+            if (peek() != token) {
+                return false;
+            }
+            ++position;
+            return true;
+        }
+    };
+
+    vector<Type> types;
+    map<string, int> typeIds;
+    vector<Global> globals;
+    vector<Function> functions;
+    vector<Constant> constants;
+    map<pair<int, int64_t>, int> integerConstants;
+    vector<MetadataNode> metadataNodes;
+
+    static bool isNameChar(char c) {
+        return isalnum(static_cast<unsigned char>(c)) || '.' == c || '_' == c || '-' == c || '$' == c;
+    }
+
+    static vector<string> tokenize(const string& line) {
+        vector<string> tokens;
+        size_t i = 0;
+        while (i < line.size()) {
+            const char c = line[i];
+            if (isspace(static_cast<unsigned char>(c))) {
+                ++i;
+            } else if (';' == c) {
+                break;
+            } else if ('"' == c || (i + 1 < line.size() && line[i + 1] == '"' && ('c' == c || '!' == c))) {
+                const size_t open = line.find('"', i);
+                const size_t close = line.find('"', open + 1);
+                if (close == string::npos) {
+                    throw runtime_error("unterminated string in '" + line + "'");
+                }
+                tokens.push_back(line.substr(i, close + 1 - i));
+                i = close + 1;
+            } else if ('!' == c && i + 1 < line.size() && '{' == line[i + 1]) {
+                tokens.push_back("!{");
+                i += 2;
+            } else if (('%' == c || '@' == c || '!' == c || isNameChar(c))) {
+                size_t end = i + 1;
+                while (end < line.size() && isNameChar(line[end])) {
+                    ++end;
+                }
+                tokens.push_back(line.substr(i, end - i));
+                i = end;
+            } else {
+                tokens.push_back(string(1, c));
+                ++i;
+            }
+        }
+        return tokens;
+    }
+
+    // The bytes of a quoted string token (c"..." or !"..."), with LLVM's \XX and \\ escapes resolved
+    static string unescape(const string& token) {
+        const size_t open = token.find('"');
+        const string body = token.substr(open + 1, token.size() - open - 2);
+        string bytes;
+        for (size_t i = 0; i < body.size(); ++i) {
+            if ('\\' == body[i] && i + 1 < body.size() && '\\' == body[i + 1]) {
+                bytes += '\\';
+                ++i;
+            } else if ('\\' == body[i] && i + 2 < body.size() && isxdigit(static_cast<unsigned char>(body[i + 1]))
+                       && isxdigit(static_cast<unsigned char>(body[i + 2]))) {
+                bytes += static_cast<char>(stoi(body.substr(i + 1, 2), nullptr, 16));
+                i += 2;
+            } else {
+                bytes += body[i];
+            }
+        }
+        return bytes;
+    }
+
+    static bool isInteger(const string& token) {
+        const size_t digits = ('-' == token[0]) ? 1 : 0;
+        return token.size() > digits && token.find_first_not_of("0123456789", digits) == string::npos;
+    }
+
+    int internType(const Type& type) {
+        string key = to_string(type.kind) + ":" + to_string(type.size) + ":" + to_string(type.element) + ":"
+                     + to_string(type.vararg);
+        for (int parameter : type.parameters) {
+            key += "," + to_string(parameter);
+        }
+        auto existing = typeIds.find(key);
+        if (existing != typeIds.end()) {
+            return existing->second;
+        }
+        types.push_back(type);
+        typeIds[key] = static_cast<int>(types.size()) - 1;
+        return static_cast<int>(types.size()) - 1;
+    }
+
+    int integerType(uint64_t bits) {
+        Type type;
+        type.kind = Type::INTEGER;
+        type.size = bits;
+        return internType(type);
+    }
+
+    int pointerType(int pointee) {
+        Type type;
+        type.kind = Type::POINTER;
+        type.element = pointee;
+        return internType(type);
+    }
+
+    // Types as written in the IR; a parameter list after a type makes it a function type (call i32 (i8*, ...))
+    int parseType(Cursor& cursor) {
+        const string token = cursor.next();
+        Type type;
+        if ("void" == token) {
+            type.kind = Type::VOID;
+        } else if ("label" == token) {
+            type.kind = Type::LABEL;
+        } else if ("metadata" == token) {
+            type.kind = Type::METADATA;
+        } else if (token.size() > 1 && 'i' == token[0] && isInteger(token.substr(1))) {
+            type.kind = Type::INTEGER;
+            type.size = stoull(token.substr(1));
+        } else if ("[" == token) {
+            type.kind = Type::ARRAY;
+            type.size = stoull(cursor.next());
+            cursor.expect("x");
+            type.element = parseType(cursor);
+            cursor.expect("]");
+        } else {
+            throw runtime_error("unsupported type '" + token + "' in '" + cursor.line + "'");
+        }
+        int id = internType(type);
+        while (true) {
+            if (cursor.accept("*")) {
+                id = pointerType(id);
+            } else if ("(" == cursor.peek()) {
+                cursor.next();
+                Type function;
+                function.kind = Type::FUNCTION;
+                function.element = id;
+                while (!cursor.accept(")")) {
+                    if (cursor.accept("...")) {
+                        function.vararg = true;
+                    } else {
+                        function.parameters.push_back(parseType(cursor));
+                    }
+                    cursor.accept(",");
+                }
+                id = internType(function);
+            } else {
+                return id;
+            }
+        }
+    }
+
+    Operand parseValue(Cursor& cursor, int type) {
+        const string token = cursor.next();
+        Operand operand;
+        operand.type = type;
+        if ('%' == token[0]) {
+            operand.kind = Operand::LOCAL;
+            operand.name = token;
+        } else if ('@' == token[0]) {
+            operand.kind = Operand::GLOBAL;
+            operand.name = token;
+        } else if ("true" == token || "false" == token) {
+            operand.value = ("true" == token) ? 1 : 0;
+        } else if (isInteger(token)) {
+            operand.value = stoll(token);
+        } else {
+            throw runtime_error("unsupported value '" + token + "' in '" + cursor.line + "'");
+        }
+        return operand;
+    }
+
+    Operand parseTypedValue(Cursor& cursor) {
+        const int type = parseType(cursor);
+        return parseValue(cursor, type);
+    }
+
+    // Attribute words up to the end of the line or an opening brace, in a canonical order
+    static string parseAttributes(Cursor& cursor) {
+        vector<string> words;
+        while (!cursor.atEnd() && "{" != cursor.peek()) {
+            words.push_back(cursor.next());
+        }
+        sort(words.begin(), words.end());
+        string attributes;
+        for (const string& word : words) {
+            attributes += (attributes.empty() ? "" : " ") + word;
+        }
+        return attributes;
+    }
+
+    // "declare/define RET @name(TYPE [%name], ...) ATTRIBUTES [{]"
+    void parseFunctionHeader(Cursor& cursor, bool defined) {
+        Function function;
+        function.defined = defined;
+        Type type;
+        type.kind = Type::FUNCTION;
+        type.element = parseType(cursor);
+        function.name = cursor.next();
+        cursor.expect("(");
+        while (!cursor.accept(")")) {
+            if (cursor.accept("...")) {
+                type.vararg = true;
+            } else {
+                type.parameters.push_back(parseType(cursor));
+                function.parameterNames.push_back('%' == cursor.peek()[0] ? cursor.next() : "");
+            }
+            cursor.accept(",");
+        }
+        function.type = internType(type);
+        function.attributes = parseAttributes(cursor);
+        functions.push_back(function);
+    }
+
+    // "@name = [linkage] constant/global TYPE INITIALIZER", a declaration ("external") has no initializer
+    void parseGlobal(Cursor& cursor) {
+        Global global;
+        global.name = cursor.next();
+        cursor.expect("=");
+        static const map<string, uint64_t> linkages = {{"external", 0}, {"internal", 3}, {"private", 9}};
+        auto linkage = linkages.find(cursor.peek());
+        if (linkage != linkages.end()) {
+            global.linkage = linkage->second;
+            cursor.next();
+        }
+        const string kind = cursor.next();
+        if ("constant" != kind && "global" != kind) {
+            throw runtime_error("unsupported global in '" + cursor.line + "'");
+        }
+        global.constant = ("constant" == kind);
+        global.type = parseType(cursor);
+        if (cursor.atEnd()) {
+            globals.push_back(global);
+            return;
+        }
+        const string initializer = cursor.next();
+        Constant constant;
+        constant.type = global.type;
+        if ("zeroinitializer" == initializer) {
+            constant.kind = Constant::ZERO;
+        } else if ('c' == initializer[0] && initializer.size() > 1 && '"' == initializer[1]) {
+            constant.kind = Constant::STRING;
+            constant.bytes = unescape(initializer);
+        } else if (isInteger(initializer)) {
+            constant.value = stoll(initializer);
+        } else {
+            throw runtime_error("unsupported initializer in '" + cursor.line + "'");
+        }
+        global.initializer = static_cast<int>(constants.size());
+        constants.push_back(constant);
+        globals.push_back(global);
+    }
+
+    // "!N = [distinct] !{ELEMENT, ...}" with nodes, strings and typed constants as elements
+    void parseMetadata(Cursor& cursor) {
+        MetadataNode node;
+        node.name = cursor.next();
+        cursor.expect("=");
+        node.distinct = cursor.accept("distinct");
+        cursor.expect("!{");
+        while (!cursor.accept("}")) {
+            MetadataElement element;
+            const string& token = cursor.peek();
+            if (token.size() > 1 && '!' == token[0] && '"' == token[1]) {
+                element.kind = MetadataElement::STRING;
+                element.text = unescape(cursor.next());
+            } else if ('!' == token[0]) {
+                element.kind = MetadataElement::NODE;
+                element.text = cursor.next();
+            } else {
+                element.kind = MetadataElement::VALUE;
+                const Operand value = parseTypedValue(cursor);
+                if (Operand::CONSTANT != value.kind) {
+                    throw runtime_error("unsupported metadata value in '" + cursor.line + "'");
+                }
+                element.type = value.type;
+                element.value = value.value;
+            }
+            node.elements.push_back(element);
+            cursor.accept(",");
+        }
+        metadataNodes.push_back(node);
+    }
+
+    Instruction parseInstruction(Cursor& cursor) {
+        static const map<string, uint64_t> binaryOperators = {
+            {"add", 0}, {"sub", 1}, {"mul", 2}, {"udiv", 3}, {"sdiv", 4}, {"urem", 5}, {"srem", 6},
+            {"shl", 7}, {"lshr", 8}, {"ashr", 9}, {"and", 10}, {"or", 11}, {"xor", 12}
+        };
+        static const map<string, uint64_t> casts = {{"trunc", 0}, {"zext", 1}, {"sext", 2}};
+        static const map<string, uint64_t> predicates = {
+            {"eq", 32}, {"ne", 33}, {"ugt", 34}, {"uge", 35}, {"ult", 36}, {"ule", 37},
+            {"sgt", 38}, {"sge", 39}, {"slt", 40}, {"sle", 41}
+        };
+
+        Instruction instruction;
+        if (cursor.tokens.size() > 1 && "=" == cursor.tokens[1]) {
+            instruction.result = cursor.next();
+            cursor.next();
+        }
+        instruction.opcode = cursor.next();
+        const string& opcode = instruction.opcode;
+        if (binaryOperators.count(opcode)) {
+            instruction.code = binaryOperators.at(opcode);
+            const Operand left = parseTypedValue(cursor);
+            cursor.expect(",");
+            instruction.operands = {left, parseValue(cursor, left.type)};
+        } else if ("icmp" == opcode) {
+            const string predicate = cursor.next();
+            if (!predicates.count(predicate)) {
+                throw runtime_error("unsupported predicate in '" + cursor.line + "'");
+            }
+            instruction.code = predicates.at(predicate);
+            const Operand left = parseTypedValue(cursor);
+            cursor.expect(",");
+            instruction.operands = {left, parseValue(cursor, left.type)};
+        } else if (casts.count(opcode)) {
+            instruction.code = casts.at(opcode);
+            instruction.operands = {parseTypedValue(cursor)};
+            cursor.expect("to");
+            instruction.type = parseType(cursor);
+        } else if ("select" == opcode) {
+            instruction.operands.push_back(parseTypedValue(cursor));
+            cursor.expect(",");
+            instruction.operands.push_back(parseTypedValue(cursor));
+            cursor.expect(",");
+            instruction.operands.push_back(parseTypedValue(cursor));
+        } else if ("alloca" == opcode) {
+            instruction.type = parseType(cursor);
+        } else if ("load" == opcode) {
+            instruction.type = parseType(cursor);
+            cursor.expect(",");
+            instruction.operands = {parseTypedValue(cursor)};
+        } else if ("store" == opcode) {
+            instruction.operands.push_back(parseTypedValue(cursor));
+            cursor.expect(",");
+            instruction.operands.push_back(parseTypedValue(cursor));
+        } else if ("getelementptr" == opcode) {
+            instruction.inbounds = cursor.accept("inbounds");
+            instruction.type = parseType(cursor);
+            while (cursor.accept(",")) {
+                instruction.operands.push_back(parseTypedValue(cursor));
+            }
+        } else if ("call" == opcode) {
+            // The type is the return type, or the function type for variadic callees
+            instruction.type = parseType(cursor);
+            instruction.operands.push_back(parseValue(cursor, -1));
+            cursor.expect("(");
+            while (!cursor.accept(")")) {
+                instruction.operands.push_back(parseTypedValue(cursor));
+                cursor.accept(",");
+            }
+            instruction.attributes = parseAttributes(cursor);
+        } else if ("br" == opcode) {
+            if (cursor.accept("label")) {
+                instruction.targets.push_back(cursor.next());
+            } else {
+                instruction.operands = {parseTypedValue(cursor)};
+                cursor.expect(",");
+                cursor.expect("label");
+                instruction.targets.push_back(cursor.next());
+                cursor.expect(",");
+                cursor.expect("label");
+                instruction.targets.push_back(cursor.next());
+            }
+        } else if ("ret" == opcode) {
+            if (!cursor.accept("void")) {
+                instruction.operands = {parseTypedValue(cursor)};
+            }
+        } else if ("unreachable" != opcode) {
+            throw runtime_error("unsupported instruction '" + opcode + "' in '" + cursor.line + "'");
+        }
+        while (cursor.accept(",")) {
+            const string kind = cursor.next();
+            if ("align" == kind) {
+                // The records carry the ABI alignment, which is the only one hw5 writes
+                cursor.next();
+            } else if ('!' == kind[0]) {
+                instruction.attachments.push_back({kind.substr(1), cursor.next()});
+            } else {
+                throw runtime_error("unexpected '" + kind + "' in '" + cursor.line + "'");
+            }
+        }
+        if (!cursor.atEnd()) {
+            throw runtime_error("unexpected '" + cursor.peek() + "' in '" + cursor.line + "'");
+        }
+        return instruction;
+    }
+
+    static bool isTerminator(const Block& block) {
+        if (block.instructions.empty()) {
+            return false;
+        }
+        const string& opcode = block.instructions.back().opcode;
+        return "br" == opcode || "ret" == opcode || "unreachable" == opcode;
+    }
+
+    void parseModule(const string& text) {
+        stringstream lines(text);
+        string line;
+        bool insideFunction = false;
+        while (getline(lines, line)) {
+            Cursor cursor;
+            cursor.tokens = tokenize(line);
+            cursor.line = line;
+            if (cursor.tokens.empty()) {
+                continue;
+            }
+            const string& first = cursor.tokens[0];
+            if (insideFunction) {
+                Function& function = functions.back();
+                if ("}" == first) {
+                    insideFunction = false;
+                } else if (2 == cursor.tokens.size() && ":" == cursor.tokens[1]) {
+                    function.blocks.push_back({first, {}});
+                } else {
+                    // Code after a terminator starts an unnamed block, as in the entry
+                    if (function.blocks.empty() || isTerminator(function.blocks.back())) {
+                        function.blocks.push_back({"", {}});
+                    }
+                    function.blocks.back().instructions.push_back(parseInstruction(cursor));
+                }
+            } else if ("define" == first || "declare" == first) {
+                cursor.next();
+                parseFunctionHeader(cursor, "define" == first);
+                insideFunction = ("define" == first);
+            } else if ('@' == first[0]) {
+                parseGlobal(cursor);
+            } else if ('!' == first[0]) {
+                parseMetadata(cursor);
+            } else {
+                throw runtime_error("unsupported line '" + line + "'");
+            }
+        }
+    }
+
+    static int64_t signExtend(int64_t value, uint64_t bits) {
+        if (bits >= 64) {
+            return value;
+        }
+        const uint64_t mask = (uint64_t(1) << bits) - 1;
+        const uint64_t sign = uint64_t(1) << (bits - 1);
+        const uint64_t truncated = static_cast<uint64_t>(value) & mask;
+        return static_cast<int64_t>((truncated ^ sign) - sign);
+    }
+
+    // Signed integers put the sign in the lowest bit, so small negative values stay short
+    static uint64_t signRotated(int64_t value) {
+        return value >= 0 ? static_cast<uint64_t>(value) << 1 : (static_cast<uint64_t>(-value) << 1) | 1;
+    }
+
+    // Alignment the IR parser gives loads, stores and allocas without one (log2 + 1 in the records)
+    uint64_t encodedAlignment(int type) const {
+        const Type& t = types[type];
+        if (Type::ARRAY == t.kind) {
+            return encodedAlignment(t.element);
+        }
+        uint64_t bytes = 8;
+        if (Type::INTEGER == t.kind) {
+            bytes = t.size <= 8 ? 1 : t.size <= 16 ? 2 : t.size <= 32 ? 4 : 8;
+        }
+        uint64_t encoded = 1;
+        while (bytes > 1) {
+            bytes >>= 1;
+            ++encoded;
+        }
+        return encoded;
+    }
+
+    // Every instruction with a non-void type defines a value, also calls whose result is not named
+    bool definesValue(const Instruction& instruction) const {
+        if ("call" == instruction.opcode) {
+            const Type& type = types[instruction.type];
+            return Type::VOID != types[Type::FUNCTION == type.kind ? type.element : instruction.type].kind;
+        }
+        return "store" != instruction.opcode && "br" != instruction.opcode && "ret" != instruction.opcode
+               && "unreachable" != instruction.opcode;
+    }
+
+    int constantOf(int type, int64_t value) {
+        value = signExtend(value, types[type].size);
+        auto existing = integerConstants.find({type, value});
+        if (existing != integerConstants.end()) {
+            return existing->second;
+        }
+        Constant constant;
+        constant.type = type;
+        constant.value = value;
+        constants.push_back(constant);
+        integerConstants[{type, value}] = static_cast<int>(constants.size()) - 1;
+        return static_cast<int>(constants.size()) - 1;
+    }
+
+    static vector<uint64_t> characters(const string& text, vector<uint64_t> prefix = {}) {
+        for (unsigned char c : text) {
+            prefix.push_back(c);
+        }
+        return prefix;
+    }
+
+    void writeConstants(BitstreamWriter& stream, const vector<Constant>& block) {
+        if (block.empty()) {
+            return;
+        }
+        stream.enterBlock(CONSTANTS_BLOCK);
+        int currentType = -1;
+        for (const Constant& constant : block) {
+            if (constant.type != currentType) {
+                stream.record(CONSTANT_SETTYPE, {static_cast<uint64_t>(constant.type)});
+                currentType = constant.type;
+            }
+            if (Constant::ZERO == constant.kind) {
+                stream.record(CONSTANT_NULL, {});
+            } else if (Constant::INTEGER == constant.kind) {
+                stream.record(CONSTANT_INTEGER, {signRotated(constant.value)});
+            } else if (!constant.bytes.empty() && '\0' == constant.bytes.back()
+                       && constant.bytes.find('\0') == constant.bytes.size() - 1) {
+                stream.record(CONSTANT_CSTRING, characters(constant.bytes.substr(0, constant.bytes.size() - 1)));
+            } else {
+                stream.record(CONSTANT_STRING, characters(constant.bytes));
+            }
+        }
+        stream.exitBlock();
+    }
+
+    void writeFunction(BitstreamWriter& stream, const Function& function, uint64_t firstLocal,
+                       const map<string, uint64_t>& globalIds, const map<string, int>& functionTypes,
+                       const map<string, uint64_t>& attributeLists, const map<string, uint64_t>& metadataIds,
+                       const map<string, uint64_t>& metadataKinds) {
+        stream.enterBlock(FUNCTION_BLOCK);
+        stream.record(FUNCTION_DECLAREBLOCKS, {function.blocks.size()});
+
+        map<string, uint64_t> localIds;
+        map<string, uint64_t> blockIds;
+        uint64_t nextId = firstLocal;
+        for (size_t i = 0; i < function.parameterNames.size(); ++i) {
+            const string& name = function.parameterNames[i];
+            localIds[name.empty() ? "%" + to_string(i) : name] = nextId++;
+        }
+        for (size_t i = 0; i < function.blocks.size(); ++i) {
+            if (!function.blocks[i].name.empty()) {
+                blockIds["%" + function.blocks[i].name] = i;
+            }
+        }
+
+        // Integer constants of the function, grouped by type
+        const int i32 = integerType(32);
+        vector<pair<int, int64_t>> used;
+        for (const Block& block : function.blocks) {
+            for (const Instruction& instruction : block.instructions) {
+                if ("alloca" == instruction.opcode) {
+                    used.push_back({i32, 1});
+                }
+                for (const Operand& operand : instruction.operands) {
+                    if (Operand::CONSTANT == operand.kind) {
+                        used.push_back({operand.type, signExtend(operand.value, types[operand.type].size)});
+                    }
+                }
+            }
+        }
+        sort(used.begin(), used.end());
+        used.erase(unique(used.begin(), used.end()), used.end());
+        map<pair<int, int64_t>, uint64_t> constantIds;
+        vector<Constant> localConstants;
+        for (const auto& constant : used) {
+            constantIds[constant] = nextId++;
+            Constant local;
+            local.type = constant.first;
+            local.value = constant.second;
+            localConstants.push_back(local);
+        }
+        writeConstants(stream, localConstants);
+
+        for (const Block& block : function.blocks) {
+            for (const Instruction& instruction : block.instructions) {
+                if (definesValue(instruction)) {
+                    if (!instruction.result.empty()) {
+                        localIds[instruction.result] = nextId;
+                    }
+                    ++nextId;
+                }
+            }
+        }
+
+        auto valueId = [&](const Operand& operand) -> uint64_t {
+            if (Operand::CONSTANT == operand.kind) {
+                return constantIds.at({operand.type, signExtend(operand.value, types[operand.type].size)});
+            }
+            const map<string, uint64_t>& ids = (Operand::LOCAL == operand.kind) ? localIds : globalIds;
+            auto found = ids.find(operand.name);
+            if (found == ids.end()) {
+                throw runtime_error("undefined value " + operand.name + " in @" + function.name.substr(1));
+            }
+            return found->second;
+        };
+        auto blockId = [&](const string& label) -> uint64_t {
+            auto found = blockIds.find(label);
+            if (found == blockIds.end()) {
+                throw runtime_error("undefined label " + label + " in @" + function.name.substr(1));
+            }
+            return found->second;
+        };
+
+        // Operands are relative to the number of the instruction; forward references also carry their type
+        uint64_t instructionNumber = firstLocal + function.parameterNames.size() + localConstants.size();
+        auto relative = [&](vector<uint64_t>& record, const Operand& operand) {
+            record.push_back(static_cast<uint32_t>(instructionNumber - valueId(operand)));
+        };
+        auto relativeTyped = [&](vector<uint64_t>& record, const Operand& operand) {
+            const uint64_t id = valueId(operand);
+            record.push_back(static_cast<uint32_t>(instructionNumber - id));
+            if (id >= instructionNumber) {
+                record.push_back(static_cast<uint64_t>(operand.type));
+            }
+        };
+
+        vector<vector<uint64_t>> attachments;
+        uint64_t instructionIndex = 0;
+        for (const Block& block : function.blocks) {
+            for (const Instruction& instruction : block.instructions) {
+                const string& opcode = instruction.opcode;
+                const vector<Operand>& operands = instruction.operands;
+                vector<uint64_t> record;
+                unsigned code = 0;
+                if ("icmp" == opcode) {
+                    code = INST_CMP2;
+                    relativeTyped(record, operands[0]);
+                    relative(record, operands[1]);
+                    record.push_back(instruction.code);
+                } else if ("trunc" == opcode || "zext" == opcode || "sext" == opcode) {
+                    code = INST_CAST;
+                    relativeTyped(record, operands[0]);
+                    record.push_back(static_cast<uint64_t>(instruction.type));
+                    record.push_back(instruction.code);
+                } else if ("select" == opcode) {
+                    code = INST_VSELECT;
+                    relativeTyped(record, operands[1]);
+                    relative(record, operands[2]);
+                    relativeTyped(record, operands[0]);
+                } else if ("alloca" == opcode) {
+                    code = INST_ALLOCA;
+                    record = {static_cast<uint64_t>(instruction.type), static_cast<uint64_t>(i32),
+                              constantIds.at({i32, 1}), encodedAlignment(instruction.type) | ALLOCA_EXPLICIT_TYPE};
+                } else if ("load" == opcode) {
+                    code = INST_LOAD;
+                    relativeTyped(record, operands[0]);
+                    record.push_back(static_cast<uint64_t>(instruction.type));
+                    record.push_back(encodedAlignment(instruction.type));
+                    record.push_back(0);
+                } else if ("store" == opcode) {
+                    code = INST_STORE;
+                    relativeTyped(record, operands[1]);
+                    relativeTyped(record, operands[0]);
+                    record.push_back(encodedAlignment(operands[0].type));
+                    record.push_back(0);
+                } else if ("getelementptr" == opcode) {
+                    code = INST_GEP;
+                    record = {instruction.inbounds ? 1u : 0u, static_cast<uint64_t>(instruction.type)};
+                    for (const Operand& operand : operands) {
+                        relativeTyped(record, operand);
+                    }
+                } else if ("call" == opcode) {
+                    code = INST_CALL;
+                    int type = instruction.type;
+                    if (Type::FUNCTION != types[type].kind) {
+                        auto callee = functionTypes.find(operands[0].name);
+                        if (callee == functionTypes.end()) {
+                            throw runtime_error("call of undeclared " + operands[0].name);
+                        }
+                        type = callee->second;
+                    }
+                    const size_t fixed = types[type].parameters.size();
+                    record.push_back(instruction.attributes.empty() ? 0 : attributeLists.at(instruction.attributes));
+                    record.push_back(CALL_EXPLICIT_TYPE);
+                    record.push_back(static_cast<uint64_t>(type));
+                    relative(record, operands[0]);
+                    for (size_t i = 1; i < operands.size(); ++i) {
+                        if (i <= fixed) {
+                            relative(record, operands[i]);
+                        } else {
+                            relativeTyped(record, operands[i]);
+                        }
+                    }
+                } else if ("br" == opcode) {
+                    code = INST_BR;
+                    for (const string& target : instruction.targets) {
+                        record.push_back(blockId(target));
+                    }
+                    if (!operands.empty()) {
+                        relative(record, operands[0]);
+                    }
+                } else if ("ret" == opcode) {
+                    code = INST_RET;
+                    if (!operands.empty()) {
+                        relativeTyped(record, operands[0]);
+                    }
+                } else if ("unreachable" == opcode) {
+                    code = INST_UNREACHABLE;
+                } else {
+                    code = INST_BINOP;
+                    relativeTyped(record, operands[0]);
+                    relative(record, operands[1]);
+                    record.push_back(instruction.code);
+                }
+                stream.record(code, record);
+
+                if (!instruction.attachments.empty()) {
+                    vector<uint64_t> attachment = {instructionIndex};
+                    for (const auto& kindAndNode : instruction.attachments) {
+                        auto node = metadataIds.find(kindAndNode.second);
+                        if (node == metadataIds.end()) {
+                            throw runtime_error("undefined metadata " + kindAndNode.second);
+                        }
+                        attachment.push_back(metadataKinds.at(kindAndNode.first));
+                        attachment.push_back(node->second);
+                    }
+                    attachments.push_back(attachment);
+                }
+                if (definesValue(instruction)) {
+                    ++instructionNumber;
+                }
+                ++instructionIndex;
+            }
+        }
+
+        // Numbered values (%0, %1, ...) and the entry block stay unnamed
+        stream.enterBlock(VALUE_SYMTAB_BLOCK);
+        for (const auto& local : localIds) {
+            if (!isInteger(local.first.substr(1))) {
+                stream.record(VST_ENTRY, characters(local.first.substr(1), {local.second}));
+            }
+        }
+        for (size_t i = 0; i < function.blocks.size(); ++i) {
+            if (!function.blocks[i].name.empty()) {
+                stream.record(VST_BBENTRY, characters(function.blocks[i].name, {i}));
+            }
+        }
+        stream.exitBlock();
+
+        if (!attachments.empty()) {
+            stream.enterBlock(METADATA_ATTACHMENT_BLOCK);
+            for (const vector<uint64_t>& attachment : attachments) {
+                stream.record(METADATA_ATTACHMENT, attachment);
+            }
+            stream.exitBlock();
+        }
+        stream.exitBlock();
+    }
+
+public:
+    // Bitcode of an IR module as printed by CodeBuffer. Throws runtime_error for IR outside the subset.
+    string write(const string& text) {
+        parseModule(text);
+
+        // Attribute sets, one group and one list each, numbered from 1
+        static const map<string, uint64_t> attributeKinds = {
+            {"alwaysinline", 2}, {"noinline", 14}, {"noreturn", 17}, {"nounwind", 18}, {"readnone", 20},
+            {"readonly", 21}, {"cold", 36}, {"argmemonly", 45}, {"norecurse", 48}, {"willreturn", 61},
+            {"nofree", 62}, {"nosync", 63}
+        };
+        map<string, uint64_t> attributeLists;
+        vector<string> attributeSets;
+        auto addAttributes = [&](const string& attributes) {
+            if (!attributes.empty() && !attributeLists.count(attributes)) {
+                attributeSets.push_back(attributes);
+                attributeLists[attributes] = attributeSets.size();
+            }
+        };
+        for (const Function& function : functions) {
+            addAttributes(function.attributes);
+            for (const Block& block : function.blocks) {
+                for (const Instruction& instruction : block.instructions) {
+                    addAttributes(instruction.attributes);
+                }
+            }
+        }
+
+        // Value ids: global variables, functions, then the module constants
+        map<string, uint64_t> globalIds;
+        map<string, int> functionTypes;
+        for (const Global& global : globals) {
+            globalIds[global.name] = globalIds.size();
+        }
+        for (const Function& function : functions) {
+            globalIds[function.name] = globalIds.size();
+            functionTypes[function.name] = function.type;
+        }
+
+        // Metadata ids: strings, constants, then the nodes
+        map<string, uint64_t> metadataStrings;
+        vector<string> strings;
+        map<pair<int, int64_t>, uint64_t> metadataValues;
+        vector<int> values;
+        for (const MetadataNode& node : metadataNodes) {
+            for (const MetadataElement& element : node.elements) {
+                if (MetadataElement::STRING == element.kind && !metadataStrings.count(element.text)) {
+                    metadataStrings[element.text] = strings.size();
+                    strings.push_back(element.text);
+                } else if (MetadataElement::VALUE == element.kind && !metadataValues.count({element.type, element.value})) {
+                    metadataValues[{element.type, element.value}] = values.size();
+                    values.push_back(constantOf(element.type, element.value));
+                }
+            }
+        }
+        map<string, uint64_t> metadataIds;
+        for (size_t i = 0; i < metadataNodes.size(); ++i) {
+            metadataIds[metadataNodes[i].name] = strings.size() + values.size() + i;
+        }
+        map<string, uint64_t> metadataKinds;
+        for (const Function& function : functions) {
+            for (const Block& block : function.blocks) {
+                for (const Instruction& instruction : block.instructions) {
+                    for (const auto& attachment : instruction.attachments) {
+                        if (!metadataKinds.count(attachment.first)) {
+                            metadataKinds[attachment.first] = metadataKinds.size();
+                        }
+                    }
+                }
+            }
+        }
+        // Before the type table is written, so every type a function needs is in it
+        integerType(32);
+
+        string strtab;
+        BitstreamWriter stream;
+        for (char c : string("BC")) {
+            stream.emit(static_cast<unsigned char>(c), 8);
+        }
+        for (unsigned nibble : {0x0u, 0xCu, 0xEu, 0xDu}) {
+            stream.emit(nibble, 4);
+        }
+
+        stream.enterBlock(IDENTIFICATION_BLOCK, 5);
+        stream.record(IDENTIFICATION_STRING, characters("hw5"));
+        stream.record(IDENTIFICATION_EPOCH, {0});
+        stream.exitBlock();
+
+        stream.enterBlock(MODULE_BLOCK);
+        stream.record(MODULE_VERSION, {2});
+
+        if (!attributeSets.empty()) {
+            stream.enterBlock(PARAMATTR_GROUP_BLOCK);
+            for (size_t i = 0; i < attributeSets.size(); ++i) {
+                vector<uint64_t> record = {i + 1, FUNCTION_ATTRIBUTES_INDEX};
+                stringstream words(attributeSets[i]);
+                string word;
+                while (words >> word) {
+                    auto kind = attributeKinds.find(word);
+                    if (kind == attributeKinds.end()) {
+                        throw runtime_error("unsupported attribute '" + word + "'");
+                    }
+                    record.push_back(0);
+                    record.push_back(kind->second);
+                }
+                stream.record(PARAMATTR_GROUP_ENTRY, record);
+            }
+            stream.exitBlock();
+            stream.enterBlock(PARAMATTR_BLOCK);
+            for (size_t i = 0; i < attributeSets.size(); ++i) {
+                stream.record(PARAMATTR_ENTRY, {i + 1});
+            }
+            stream.exitBlock();
+        }
+
+        stream.enterBlock(TYPE_BLOCK);
+        stream.record(TYPE_NUMENTRY, {types.size()});
+        for (const Type& type : types) {
+            switch (type.kind) {
+                case Type::VOID: stream.record(TYPE_VOID, {}); break;
+                case Type::LABEL: stream.record(TYPE_LABEL, {}); break;
+                case Type::METADATA: stream.record(TYPE_METADATA, {}); break;
+                case Type::INTEGER: stream.record(TYPE_INTEGER, {type.size}); break;
+                case Type::POINTER: stream.record(TYPE_POINTER, {static_cast<uint64_t>(type.element), 0}); break;
+                case Type::ARRAY: stream.record(TYPE_ARRAY, {type.size, static_cast<uint64_t>(type.element)}); break;
+                case Type::FUNCTION: {
+                    vector<uint64_t> record = {type.vararg ? 1u : 0u, static_cast<uint64_t>(type.element)};
+                    for (int parameter : type.parameters) {
+                        record.push_back(static_cast<uint64_t>(parameter));
+                    }
+                    stream.record(TYPE_FUNCTION, record);
+                    break;
+                }
+            }
+        }
+        stream.exitBlock();
+
+        const uint64_t firstConstant = globals.size() + functions.size();
+        for (const Global& global : globals) {
+            const string name = global.name.substr(1);
+            stream.record(MODULE_GLOBALVAR, {strtab.size(), name.size(), static_cast<uint64_t>(global.type),
+                                             2u | (global.constant ? 1u : 0u),
+                                             global.initializer < 0 ? 0 : firstConstant + global.initializer + 1, global.linkage, 0, 0});
+            strtab += name;
+        }
+        for (const Function& function : functions) {
+            const string name = function.name.substr(1);
+            const uint64_t attributes = function.attributes.empty() ? 0 : attributeLists.at(function.attributes);
+            stream.record(MODULE_FUNCTION, {strtab.size(), name.size(), static_cast<uint64_t>(function.type), 0,
+                                            function.defined ? 0u : 1u, 0, attributes, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                            0, 0, 0});
+            strtab += name;
+        }
+        writeConstants(stream, constants);
+
+        if (!metadataKinds.empty()) {
+            stream.enterBlock(METADATA_KIND_BLOCK);
+            for (const auto& kind : metadataKinds) {
+                stream.record(METADATA_KIND, characters(kind.first, {kind.second}));
+            }
+            stream.exitBlock();
+        }
+        if (!metadataNodes.empty()) {
+            stream.enterBlock(METADATA_BLOCK);
+            for (const string& value : strings) {
+                stream.record(METADATA_STRING, characters(value));
+            }
+            for (int constant : values) {
+                stream.record(METADATA_VALUE, {static_cast<uint64_t>(constants[constant].type), firstConstant + constant});
+            }
+            for (const MetadataNode& node : metadataNodes) {
+                vector<uint64_t> record;
+                for (const MetadataElement& element : node.elements) {
+                    uint64_t id = 0;
+                    if (MetadataElement::STRING == element.kind) {
+                        id = metadataStrings.at(element.text);
+                    } else if (MetadataElement::VALUE == element.kind) {
+                        id = strings.size() + metadataValues.at({element.type, element.value});
+                    } else if (metadataIds.count(element.text)) {
+                        id = metadataIds.at(element.text);
+                    } else {
+                        throw runtime_error("undefined metadata " + element.text);
+                    }
+                    record.push_back(id + 1);
+                }
+                stream.record(node.distinct ? METADATA_DISTINCT_NODE : METADATA_NODE, record);
+            }
+            stream.exitBlock();
+        }
+
+        const uint64_t firstLocal = firstConstant + constants.size();
+        for (const Function& function : functions) {
+            if (function.defined) {
+                writeFunction(stream, function, firstLocal, globalIds, functionTypes, attributeLists, metadataIds,
+                              metadataKinds);
+            }
+        }
+        stream.exitBlock();
+
+        stream.enterBlock(STRTAB_BLOCK);
+        stream.blobRecord(STRTAB_BLOB, strtab);
+        stream.exitBlock();
+        return stream.bytes();
+    }
+};
+
+#endif // BITCODE_WRITER_HPP
@@ -0,0 +1,524 @@
+#ifndef BYTECODE_HPP
+#define BYTECODE_HPP
+
+#include "visitor.hpp"
+#include "nodes.hpp"
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <cstdint>
+
+using namespace std;
+using namespace ast;
+
+/* Opcode enum
+ * Instructions of the bytecode. Unless noted otherwise the operands a, b and c are registers of the current
+ * frame; imm is an immediate value and target the index of an instruction. The comparisons are in RelOpType order.
+ */
+enum Opcode {
+    OP_CONST,                                    // a = imm b
+    OP_MOVE,                                     // a = b
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV,              // a = b op c, wrapping around at 32 bits
+    OP_ADD_IMM,                                  // a = b + imm c
+    OP_MUL_IMM,                                  // a = b * imm c
+    OP_DIV_IMM,                                  // a = b / imm c, c is neither 0 nor -1
+    OP_ADD_BYTE, OP_SUB_BYTE, OP_MUL_BYTE, OP_DIV_BYTE,  // a = (b op c) & 255
+    OP_TRUNC_BYTE,                               // a = b & 255
+    OP_JUMP,                                     // goto target a
+    OP_JUMP_ZERO, OP_JUMP_NONZERO,               // if a == 0 (a != 0) goto target b
+    OP_JUMP_EQ, OP_JUMP_NE, OP_JUMP_LT, OP_JUMP_GT, OP_JUMP_LE, OP_JUMP_GE,   // if a rel b goto target c
+    OP_JUMP_EQ_IMM, OP_JUMP_NE_IMM, OP_JUMP_LT_IMM,
+    OP_JUMP_GT_IMM, OP_JUMP_LE_IMM, OP_JUMP_GE_IMM,                           // if a rel imm b goto target c
+    OP_CALL,                                     // a = call of function b, its frame starts at register c
+    OP_RETURN,                                   // return a
+    OP_RETURN_VOID,                              // return 0
+    OP_PRINT,                                    // print string a of the string table
+    OP_PRINTI,                                   // print a
+    OPCODE_COUNT
+};
+
+/* OpcodeInfo struct
+ * Mnemonic of an opcode and the kinds of its operands, for listings: r register, i immediate,
+ * t target, f function, s string.
+ */
+struct OpcodeInfo {
+    const char* name;
+    const char* operands;
+};
+
+static const OpcodeInfo OPCODE_INFO[OPCODE_COUNT] = {
+    {"const", "ri"}, {"move", "rr"},
+    {"add", "rrr"}, {"sub", "rrr"}, {"mul", "rrr"}, {"div", "rrr"},
+    {"add.imm", "rri"}, {"mul.imm", "rri"}, {"div.imm", "rri"},
+    {"add.byte", "rrr"}, {"sub.byte", "rrr"}, {"mul.byte", "rrr"}, {"div.byte", "rrr"},
+    {"trunc.byte", "rr"},
+    {"jump", "t"}, {"jump.zero", "rt"}, {"jump.nonzero", "rt"},
+    {"jump.eq", "rrt"}, {"jump.ne", "rrt"}, {"jump.lt", "rrt"}, {"jump.gt", "rrt"}, {"jump.le", "rrt"}, {"jump.ge", "rrt"},
+    {"jump.eq.imm", "rit"}, {"jump.ne.imm", "rit"}, {"jump.lt.imm", "rit"},
+    {"jump.gt.imm", "rit"}, {"jump.le.imm", "rit"}, {"jump.ge.imm", "rit"},
+    {"call", "rfr"}, {"return", "r"}, {"return.void", ""},
+    {"print", "s"}, {"printi", "r"}
+};
+
+struct Instruction {
+    Opcode opcode;
+    int32_t a = 0;
+    int32_t b = 0;
+    int32_t c = 0;
+};
+
+/* BytecodeFunction struct
+ * The registers of a frame are the parameters, then the local variables, then the temporaries.
+ * A call places the arguments in consecutive registers of the caller, and the callee frame starts at the
+ * first of them, so the arguments already are the parameters of the callee.
+ */
+struct BytecodeFunction {
+    string name;
+    size_t entry = 0;
+    int parameters = 0;
+    int frameSize = 0;
+};
+
+struct BytecodeProgram {
+    vector<Instruction> code;
+    vector<BytecodeFunction> functions;
+    vector<string> strings;
+    int mainFunction = -1;
+
+    // Index one past the last instruction of a function, functions are laid out in order
+    size_t functionEnd(size_t function) const {
+        return function + 1 < functions.size() ? functions[function + 1].entry : code.size();
+    }
+
+    void disassemble(ostream& os) const {
+        for (size_t index = 0; index < functions.size(); ++index) {
+            const BytecodeFunction& function = functions[index];
+            const size_t end = functionEnd(index);
+            os << "function " << function.name << " (" << function.parameters << " parameters, "
+               << function.frameSize << " registers)" << endl;
+            for (size_t i = function.entry; i < end; ++i) {
+                const Instruction& instruction = code[i];
+                const OpcodeInfo& info = OPCODE_INFO[instruction.opcode];
+                os << setw(6) << i << "  " << info.name;
+                if (info.operands[0]) {
+                    os << string(max<size_t>(1, 13 - string(info.name).size()), ' ');
+                }
+                const int32_t operands[] = {instruction.a, instruction.b, instruction.c};
+                for (int operand = 0; info.operands[operand]; ++operand) {
+                    os << (operand ? ", " : "");
+                    switch (info.operands[operand]) {
+                        case 'r': os << "r" << operands[operand]; break;
+                        case 't': os << "@" << operands[operand]; break;
+                        case 'f': os << functions[operands[operand]].name; break;
+                        case 's': os << "\"" << strings[operands[operand]] << "\""; break;
+                        default: os << operands[operand]; break;
+                    }
+                }
+                os << endl;
+            }
+        }
+    }
+};
+
+/* BytecodeCompiler class
+ * Lowers an analyzed program to bytecode. Variables live in fixed registers numbered from their Symbol::offset
+ * (parameters -1, -2, ... become registers 0, 1, ...; locals follow them), so variables of disjoint scopes
+ * share registers the same way they share offsets. Temporaries are allocated above the locals and, unless the
+ * compiler is asked to keep them apart, released after every statement. Conditions compile to
+ * compare-and-branch instructions, and boolean values are only materialized where they are stored, passed
+ * or returned.
+ */
+class BytecodeCompiler : public Visitor {
+private:
+    BytecodeProgram program;
+    map<string, int> functionIndices;
+
+    // Whether temporaries are released after every statement, or each gets a register of its own
+    bool reuseTemporaries;
+
+    int parameters = 0;
+    int firstTemporary = 0;
+    int nextTemporary = 0;
+    int frameSize = 0;
+
+    // Register an expression should be computed into (-1 for any) and the register it was computed into
+    int requested = -1;
+    int result = -1;
+
+    // Instruction index per label of the current function, and the jump operands waiting for them
+    vector<int32_t> labels;
+    vector<pair<size_t, int32_t Instruction::*>> jumps;
+    // Continue and break labels of the enclosing loops
+    vector<pair<int, int>> loops;
+
+    static bool isLiteral(const shared_ptr<Exp>& exp) {
+        return dynamic_pointer_cast<Num>(exp) || dynamic_pointer_cast<NumB>(exp);
+    }
+
+    // Largest offset of a local declared in a statement tree, -1 without locals
+    static int maxLocalOffset(const shared_ptr<Statement>& statement) {
+        if (!statement) {
+            return -1;
+        }
+        if (shared_ptr<VarDecl> declaration = dynamic_pointer_cast<VarDecl>(statement)) {
+            return declaration->getVarId()->offset;
+        }
+        if (shared_ptr<Statements> block = dynamic_pointer_cast<Statements>(statement)) {
+            int offset = -1;
+            for (const shared_ptr<Statement>& inner : block->getStatements()) {
+                offset = max(offset, maxLocalOffset(inner));
+            }
+            return offset;
+        }
+        if (shared_ptr<If> conditional = dynamic_pointer_cast<If>(statement)) {
+            return max(maxLocalOffset(conditional->getThen()), maxLocalOffset(conditional->getElse()));
+        }
+        if (shared_ptr<While> loop = dynamic_pointer_cast<While>(statement)) {
+            return maxLocalOffset(loop->getBody());
+        }
+        return -1;
+    }
+
+    int registerOf(const ID& variable) const {
+        return variable.offset < 0 ? -variable.offset - 1 : parameters + variable.offset;
+    }
+
+    int temporary() {
+        frameSize = max(frameSize, nextTemporary + 1);
+        return nextTemporary++;
+    }
+
+    // The requested register, or a new temporary when any register will do
+    int destination() {
+        return requested >= 0 ? requested : temporary();
+    }
+
+    void emit(Opcode opcode, int32_t a = 0, int32_t b = 0, int32_t c = 0) {
+        program.code.push_back({opcode, a, b, c});
+    }
+
+    // A jump whose target operand is the label, resolved at the end of the function
+    void emitJump(Opcode opcode, int32_t Instruction::* target, int label, int32_t a = 0, int32_t b = 0) {
+        emit(opcode, a, b);
+        jumps.push_back({program.code.size() - 1, target});
+        program.code.back().*target = label;
+    }
+
+    int newLabel() {
+        labels.push_back(-1);
+        return labels.size() - 1;
+    }
+
+    void bindLabel(int label) {
+        labels[label] = program.code.size();
+    }
+
+    int lower(const shared_ptr<Exp>& exp, int target = -1) {
+        requested = target;
+        exp->accept(*this);
+        return result;
+    }
+
+    // Statements start without live temporaries, and a call statement computes its unused result anywhere
+    void lowerStatement(const shared_ptr<Statement>& statement) {
+        if (reuseTemporaries) {
+            nextTemporary = firstTemporary;
+        }
+        requested = -1;
+        statement->accept(*this);
+    }
+
+    void lowerInto(const shared_ptr<Exp>& exp, int target) {
+        const int computed = lower(exp, target);
+        if (computed != target) {
+            emit(OP_MOVE, target, computed);
+        }
+    }
+
+    // A boolean value: 0, then 1 unless the condition is false. Always a new temporary, since the
+    // requested register may be a variable the condition still reads.
+    void materialize(Exp& condition) {
+        const int value = temporary();
+        const int done = newLabel();
+        emit(OP_CONST, value, 0);
+        branch(condition, false, done);
+        emit(OP_CONST, value, 1);
+        bindLabel(done);
+        result = value;
+    }
+
+    static RelOpType inverted(RelOpType relation) {
+        switch (relation) {
+            case RelOpType::EQ: return RelOpType::NE;
+            case RelOpType::NE: return RelOpType::EQ;
+            case RelOpType::LT: return RelOpType::GE;
+            case RelOpType::GT: return RelOpType::LE;
+            case RelOpType::LE: return RelOpType::GT;
+            default: return RelOpType::LT;
+        }
+    }
+
+    // Jumps to the label when the condition evaluates to jumpWhen, falls through otherwise
+    void branch(Exp& condition, bool jumpWhen, int label) {
+        if (RelOp* relOp = dynamic_cast<RelOp*>(&condition)) {
+            const RelOpType relation = jumpWhen ? relOp->getOp() : inverted(relOp->getOp());
+            const int left = lower(relOp->getLeft());
+            if (isLiteral(relOp->getRight())) {
+                emitJump(static_cast<Opcode>(OP_JUMP_EQ_IMM + relation), &Instruction::c, label,
+                         left, relOp->getRight()->getValueInt());
+            } else {
+                const int right = lower(relOp->getRight());
+                emitJump(static_cast<Opcode>(OP_JUMP_EQ + relation), &Instruction::c, label, left, right);
+            }
+        } else if (Not* notExp = dynamic_cast<Not*>(&condition)) {
+            branch(*notExp->getExpr(), !jumpWhen, label);
+        } else if (And* andExp = dynamic_cast<And*>(&condition)) {
+            if (jumpWhen) {
+                const int skip = newLabel();
+                branch(*andExp->getLeft(), false, skip);
+                branch(*andExp->getRight(), true, label);
+                bindLabel(skip);
+            } else {
+                branch(*andExp->getLeft(), false, label);
+                branch(*andExp->getRight(), false, label);
+            }
+        } else if (Or* orExp = dynamic_cast<Or*>(&condition)) {
+            if (jumpWhen) {
+                branch(*orExp->getLeft(), true, label);
+                branch(*orExp->getRight(), true, label);
+            } else {
+                const int skip = newLabel();
+                branch(*orExp->getLeft(), true, skip);
+                branch(*orExp->getRight(), false, label);
+                bindLabel(skip);
+            }
+        } else if (Bool* literal = dynamic_cast<Bool*>(&condition)) {
+            if (literal->getValueBool() == jumpWhen) {
+                emitJump(OP_JUMP, &Instruction::a, label);
+            }
+        } else {
+            requested = -1;
+            condition.accept(*this);
+            emitJump(jumpWhen ? OP_JUMP_NONZERO : OP_JUMP_ZERO, &Instruction::b, label, result);
+        }
+    }
+
+    void compileFunction(FuncDecl& function) {
+        BytecodeFunction& compiled = program.functions[functionIndices[function.getFuncId()]];
+        compiled.entry = program.code.size();
+        parameters = compiled.parameters;
+        firstTemporary = parameters + maxLocalOffset(function.getFuncBody()) + 1;
+        nextTemporary = firstTemporary;
+        frameSize = firstTemporary;
+        labels.clear();
+        jumps.clear();
+        loops.clear();
+
+        function.getFuncBody()->accept(*this);
+        // A function that ends without a return statement returns 0, as the generated code does
+        emit(OP_RETURN_VOID);
+
+        for (const auto& jump : jumps) {
+            Instruction& instruction = program.code[jump.first];
+            instruction.*jump.second = labels[instruction.*jump.second];
+        }
+        compiled.frameSize = frameSize;
+    }
+
+public:
+    // The virtual machine wants small frames; a register allocator separates temporaries better when
+    // they are not shared between statements
+    explicit BytecodeCompiler(bool reuseTemporaries = true) : reuseTemporaries(reuseTemporaries) {}
+
+    BytecodeProgram compile(Funcs& node) {
+        program = BytecodeProgram();
+        functionIndices.clear();
+        for (const shared_ptr<FuncDecl>& function : node.getFuncs()) {
+            functionIndices[function->getFuncId()] = program.functions.size();
+            BytecodeFunction compiled;
+            compiled.name = function->getFuncId();
+            compiled.parameters = function->getFuncParams()->getFormals().size();
+            program.functions.push_back(compiled);
+        }
+        program.mainFunction = functionIndices["main"];
+        for (const shared_ptr<FuncDecl>& function : node.getFuncs()) {
+            compileFunction(*function);
+        }
+        return program;
+    }
+
+    void visit(Num& node) override {
+        result = destination();
+        emit(OP_CONST, result, node.getValueInt());
+    }
+
+    void visit(NumB& node) override {
+        result = destination();
+        emit(OP_CONST, result, node.getValueInt() & 255);
+    }
+
+    void visit(Bool& node) override {
+        result = destination();
+        emit(OP_CONST, result, node.getValueBool() ? 1 : 0);
+    }
+
+    void visit(ID& node) override {
+        result = registerOf(node);
+    }
+
+    void visit(BinOp& node) override {
+        const int target = destination();
+        const bool isByte = BYTE == node.resultType;
+        const int left = lower(node.getLeft());
+        const shared_ptr<Exp> right = node.getRight();
+        const int32_t literal = isLiteral(right) ? right->getValueInt() : 0;
+        if (!isByte && isLiteral(right) && (BinOpType::ADD == node.getOp() || BinOpType::SUB == node.getOp())) {
+            const uint32_t addend = BinOpType::ADD == node.getOp() ? literal : 0u - static_cast<uint32_t>(literal);
+            emit(OP_ADD_IMM, target, left, static_cast<int32_t>(addend));
+        } else if (!isByte && isLiteral(right) && BinOpType::MUL == node.getOp()) {
+            emit(OP_MUL_IMM, target, left, literal);
+        } else if (!isByte && isLiteral(right) && BinOpType::DIV == node.getOp() && 0 != literal && -1 != literal) {
+            emit(OP_DIV_IMM, target, left, literal);
+        } else {
+            const int rightRegister = lower(right);
+            const Opcode base = isByte ? OP_ADD_BYTE : OP_ADD;
+            emit(static_cast<Opcode>(base + node.getOp()), target, left, rightRegister);
+        }
+        result = target;
+    }
+
+    void visit(RelOp& node) override {
+        materialize(node);
+    }
+
+    void visit(Not& node) override {
+        materialize(node);
+    }
+
+    void visit(And& node) override {
+        materialize(node);
+    }
+
+    void visit(Or& node) override {
+        materialize(node);
+    }
+
+    void visit(Cast& node) override {
+        if (BYTE == node.getTargetType()) {
+            const int target = destination();
+            emit(OP_TRUNC_BYTE, target, lower(node.getExpr()));
+            result = target;
+        } else {
+            result = lower(node.getExpr(), requested);
+        }
+    }
+
+    void visit(Call& node) override {
+        const string function = node.getFuncId();
+        if ("print" == function) {
+            program.strings.push_back(node.getArgs().front()->getValueStr());
+            emit(OP_PRINT, program.strings.size() - 1);
+            result = -1;
+            return;
+        }
+        if ("printi" == function) {
+            emit(OP_PRINTI, lower(node.getArgs().front()));
+            result = -1;
+            return;
+        }
+
+        const int target = destination();
+        const vector<shared_ptr<Exp>> arguments = node.getArgs();
+        const int first = nextTemporary;
+        for (size_t i = 0; i < arguments.size(); ++i) {
+            temporary();
+        }
+        for (size_t i = 0; i < arguments.size(); ++i) {
+            lowerInto(arguments[i], first + i);
+        }
+        emit(OP_CALL, target, functionIndices[function], first);
+        result = target;
+    }
+
+    void visit(Statements& node) override {
+        for (auto& statement : node.getStatements()) {
+            lowerStatement(statement);
+        }
+    }
+
+    void visit(Break& node) override {
+        emitJump(OP_JUMP, &Instruction::a, loops.back().second);
+    }
+
+    void visit(Continue& node) override {
+        emitJump(OP_JUMP, &Instruction::a, loops.back().first);
+    }
+
+    void visit(Return& node) override {
+        if (node.getExpr()) {
+            emit(OP_RETURN, lower(node.getExpr()));
+        } else {
+            emit(OP_RETURN_VOID);
+        }
+    }
+
+    void visit(If& node) override {
+        const int otherwise = newLabel();
+        branch(*node.getCondition(), false, otherwise);
+        lowerStatement(node.getThen());
+        if (node.getElse()) {
+            const int done = newLabel();
+            emitJump(OP_JUMP, &Instruction::a, done);
+            bindLabel(otherwise);
+            lowerStatement(node.getElse());
+            bindLabel(done);
+        } else {
+            bindLabel(otherwise);
+        }
+    }
+
+    // The condition is placed after the body, so an iteration takes a single compare-and-branch
+    void visit(While& node) override {
+        const int body = newLabel();
+        const int condition = newLabel();
+        const int done = newLabel();
+        emitJump(OP_JUMP, &Instruction::a, condition);
+        bindLabel(body);
+        loops.push_back({condition, done});
+        lowerStatement(node.getBody());
+        loops.pop_back();
+        bindLabel(condition);
+        if (reuseTemporaries) {
+            nextTemporary = firstTemporary;
+        }
+        branch(*node.getCondition(), true, body);
+        bindLabel(done);
+    }
+
+    void visit(VarDecl& node) override {
+        const int variable = registerOf(*node.getVarId());
+        if (node.getVarInitExp()) {
+            lowerInto(node.getVarInitExp(), variable);
+        } else {
+            emit(OP_CONST, variable, 0);
+        }
+    }
+
+    void visit(Assign& node) override {
+        lowerInto(node.getAssignExp(), registerOf(*node.id));
+    }
+
+    void visit(String& node) override {}
+    void visit(Type& node) override {}
+    void visit(ExpList& node) override {}
+    void visit(Formal& node) override {}
+    void visit(Formals& node) override {}
+    void visit(FuncDecl& node) override {}
+    void visit(Funcs& node) override {}
+};
+
+#endif // BYTECODE_HPP
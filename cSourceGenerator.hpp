@@ -0,0 +1,462 @@
+#ifndef C_SOURCE_GENERATOR_HPP
+#define C_SOURCE_GENERATOR_HPP
+
+#include "visitor.hpp"
+#include "nodes.hpp"
+#include <string>
+#include <vector>
+#include <set>
+#include <memory>
+#include <sstream>
+#include <iostream>
+#include <cstdint>
+
+using namespace std;
+using namespace ast;
+
+/* CSourceGenerator class
+ * C backend: translates the analyzed AST to C99 that any C compiler builds, so programs compile with
+ * "cc -O2" where LLVM is not installed. Types map to bool, uint8_t and int32_t, if and while stay
+ * structured, and variables keep their names. Functions are named "fn_" + their name and every name the
+ * generator adds contains an underscore, which source identifiers never do, so nothing clashes.
+ * C leaves signed overflow undefined and the order of operands unspecified, while the language wraps and
+ * evaluates left to right: int arithmetic goes through small wrapping helpers, and when several operands
+ * of an expression call a function or may divide by zero, all but the last are sequenced into temporaries
+ * with the comma operator. The print runtime and the checked division are part of the output.
+ */
+class CSourceGenerator : public Visitor {
+private:
+    stringstream prototypes;
+    stringstream definitions;
+
+    // Body and temporaries of the function being generated
+    stringstream body;
+    int indentation = 0;
+    int temporaries = 0;
+
+    // Text of the last visited expression, whether it needs no parentheses as an operand, and whether it
+    // is a comma expression
+    string result;
+    bool atomic = false;
+    bool sequenced = false;
+
+    static const char* typeName(BuiltInType type) {
+        switch (type) {
+            case BOOL: return "bool";
+            case BYTE: return "uint8_t";
+            case INT: return "int32_t";
+            default: return "void";
+        }
+    }
+
+    // Source identifiers have no underscore; the few that C or the included headers reserve get one appended
+    static string variableName(const string& name) {
+        static const set<string> reserved = {
+            "auto", "break", "case", "char", "const", "continue", "default", "do", "double", "else", "enum",
+            "extern", "float", "for", "goto", "if", "inline", "int", "long", "register", "restrict", "return",
+            "short", "signed", "sizeof", "static", "struct", "switch", "typedef", "union", "unsigned", "void",
+            "volatile", "while", "bool", "true", "false", "stdin", "stdout", "stderr", "EOF", "NULL", "BUFSIZ",
+            "unix", "linux"
+        };
+        return reserved.count(name) ? name + "_" : name;
+    }
+
+    static string functionName(const string& name) {
+        return "fn_" + name;
+    }
+
+    // The language keeps string literals as written; C only needs quotes, backslashes and '?' (trigraphs) escaped
+    static string quoted(const string& value) {
+        string text = "\"";
+        for (unsigned char c : value) {
+            if ('"' == c || '\\' == c || '?' == c) {
+                text += '\\';
+                text += static_cast<char>(c);
+            } else if (c < 32 || c > 126) {
+                const char octal[] = {'\\', static_cast<char>('0' + (c >> 6)), static_cast<char>('0' + ((c >> 3) & 7)),
+                                      static_cast<char>('0' + (c & 7)), 0};
+                text += octal;
+            } else {
+                text += static_cast<char>(c);
+            }
+        }
+        return text + "\"";
+    }
+
+    static bool isNonZeroLiteral(const shared_ptr<Exp>& exp) {
+        return (dynamic_pointer_cast<Num>(exp) || dynamic_pointer_cast<NumB>(exp)) && 0 != exp->getValueInt();
+    }
+
+    // Whether evaluating the expression can be observed: a call may print, a division may exit
+    static bool hasEffects(const shared_ptr<Exp>& exp) {
+        if (dynamic_pointer_cast<Call>(exp)) {
+            return true;
+        }
+        if (auto binOp = dynamic_pointer_cast<BinOp>(exp)) {
+            return (BinOpType::DIV == binOp->getOp() && !isNonZeroLiteral(binOp->getRight()))
+                   || hasEffects(binOp->getLeft()) || hasEffects(binOp->getRight());
+        }
+        if (auto relOp = dynamic_pointer_cast<RelOp>(exp)) {
+            return hasEffects(relOp->getLeft()) || hasEffects(relOp->getRight());
+        }
+        if (auto andExp = dynamic_pointer_cast<And>(exp)) {
+            return hasEffects(andExp->getLeft()) || hasEffects(andExp->getRight());
+        }
+        if (auto orExp = dynamic_pointer_cast<Or>(exp)) {
+            return hasEffects(orExp->getLeft()) || hasEffects(orExp->getRight());
+        }
+        if (auto notExp = dynamic_pointer_cast<Not>(exp)) {
+            return hasEffects(notExp->getExpr());
+        }
+        if (auto cast = dynamic_pointer_cast<Cast>(exp)) {
+            return hasEffects(cast->getExpr());
+        }
+        return false;
+    }
+
+    string translate(const shared_ptr<Exp>& exp) {
+        exp->accept(*this);
+        return result;
+    }
+
+    // The expression as an operand of a C operator
+    string operand(const shared_ptr<Exp>& exp) {
+        const string text = translate(exp);
+        return atomic ? text : "(" + text + ")";
+    }
+
+    // The expression as the value of an assignment, where a comma expression needs parentheses
+    string assigned(const shared_ptr<Exp>& exp) {
+        const string text = translate(exp);
+        return sequenced ? "(" + text + ")" : text;
+    }
+
+    void setResult(const string& text, bool isAtomic) {
+        result = text;
+        atomic = isAtomic;
+        sequenced = false;
+    }
+
+    // Translates the operands in order. The ones with effects, except the last, are assigned to temporaries
+    // first; the assignments are returned as the prefix of a comma expression.
+    string sequence(const vector<shared_ptr<Exp>>& operands, vector<string>& translated) {
+        size_t last = operands.size();
+        int effectful = 0;
+        for (size_t i = 0; i < operands.size(); ++i) {
+            if (hasEffects(operands[i])) {
+                last = i;
+                ++effectful;
+            }
+        }
+        string prefix;
+        translated.clear();
+        for (size_t i = 0; i < operands.size(); ++i) {
+            if (effectful > 1 && i < last && hasEffects(operands[i])) {
+                const string temporary = "t_" + to_string(temporaries++);
+                prefix += temporary + " = " + assigned(operands[i]) + ", ";
+                translated.push_back(temporary);
+            } else {
+                translated.push_back(operand(operands[i]));
+            }
+        }
+        return prefix;
+    }
+
+    void setSequencedResult(const string& prefix, const string& text, bool isAtomic) {
+        if (prefix.empty()) {
+            setResult(text, isAtomic);
+        } else {
+            setResult(prefix + text, false);
+            sequenced = true;
+        }
+    }
+
+    void line(const string& text) {
+        body << string(4 * indentation, ' ') << text << "\n";
+    }
+
+    // Bodies of if and while always get braces, a declaration alone is no statement in C
+    void block(const shared_ptr<Statement>& statement) {
+        ++indentation;
+        if (auto statements = dynamic_pointer_cast<Statements>(statement)) {
+            statementsOf(*statements);
+        } else {
+            translateStatement(statement);
+        }
+        --indentation;
+    }
+
+    void statementsOf(Statements& statements) {
+        for (auto& nested : statements.getStatements()) {
+            translateStatement(nested);
+        }
+    }
+
+    // A call is an expression as well, visiting it only translates it
+    void translateStatement(const shared_ptr<Statement>& statement) {
+        if (auto call = dynamic_pointer_cast<Call>(statement)) {
+            line(translate(call) + ";");
+        } else {
+            statement->accept(*this);
+        }
+    }
+
+    void generateRuntime(ostream& os) const {
+        os << "#include <stdbool.h>\n"
+              "#include <stdint.h>\n"
+              "#include <stdio.h>\n"
+              "#include <stdlib.h>\n"
+              "\n"
+              "static inline void hw5_print(const char *text) {\n"
+              "    printf(\"%s\\n\", text);\n"
+              "}\n"
+              "\n"
+              "static inline void hw5_printi(int32_t value) {\n"
+              "    printf(\"%d\\n\", value);\n"
+              "}\n"
+              "\n"
+              "/* int arithmetic wraps around */\n"
+              "static inline int32_t hw5_add(int32_t left, int32_t right) {\n"
+              "    return (int32_t)((uint32_t)left + (uint32_t)right);\n"
+              "}\n"
+              "\n"
+              "static inline int32_t hw5_sub(int32_t left, int32_t right) {\n"
+              "    return (int32_t)((uint32_t)left - (uint32_t)right);\n"
+              "}\n"
+              "\n"
+              "static inline int32_t hw5_mul(int32_t left, int32_t right) {\n"
+              "    return (int32_t)((uint32_t)left * (uint32_t)right);\n"
+              "}\n"
+              "\n"
+              "static inline int32_t hw5_div(int32_t dividend, int32_t divisor) {\n"
+              "    if (0 == divisor) {\n"
+              "        hw5_print(\"Error division by zero\");\n"
+              "        exit(0);\n"
+              "    }\n"
+              "    return dividend / divisor;\n"
+              "}\n";
+    }
+
+public:
+    void print(ostream& os) const {
+        generateRuntime(os);
+        os << "\n" << prototypes.str() << definitions.str()
+           << "\nint main(void) {\n    fn_main();\n    return 0;\n}\n";
+    }
+
+    void visit(Num& node) override {
+        setResult(to_string(node.getValueInt()), true);
+    }
+
+    void visit(NumB& node) override {
+        setResult(to_string(node.getValueInt() & 255), true);
+    }
+
+    void visit(String& node) override {
+        setResult(quoted(node.getValueStr()), true);
+    }
+
+    void visit(Bool& node) override {
+        setResult(node.getValueBool() ? "true" : "false", true);
+    }
+
+    void visit(ID& node) override {
+        setResult(variableName(node.getValueStr()), true);
+    }
+
+    void visit(BinOp& node) override {
+        vector<string> operands;
+        const string prefix = sequence({node.getLeft(), node.getRight()}, operands);
+        const string& left = operands[0];
+        const string& right = operands[1];
+        if (BYTE == node.resultType) {
+            // Both operands are bytes, so the int arithmetic C promotes them to cannot overflow
+            switch (node.getOp()) {
+                case BinOpType::ADD: setSequencedResult(prefix, "(uint8_t)(" + left + " + " + right + ")", false); return;
+                case BinOpType::SUB: setSequencedResult(prefix, "(uint8_t)(" + left + " - " + right + ")", false); return;
+                case BinOpType::MUL: setSequencedResult(prefix, "(uint8_t)(" + left + " * " + right + ")", false); return;
+                default: break;
+            }
+        }
+        string text;
+        switch (node.getOp()) {
+            case BinOpType::ADD: text = "hw5_add(" + left + ", " + right + ")"; break;
+            case BinOpType::SUB: text = "hw5_sub(" + left + ", " + right + ")"; break;
+            case BinOpType::MUL: text = "hw5_mul(" + left + ", " + right + ")"; break;
+            case BinOpType::DIV:
+                // Literals are never negative, so a literal divisor needs neither the zero check nor the overflow case
+                if (isNonZeroLiteral(node.getRight())) {
+                    text = left + " / " + right;
+                    if (BYTE == node.resultType) {
+                        text = "(uint8_t)(" + text + ")";
+                    }
+                    setSequencedResult(prefix, text, false);
+                    return;
+                }
+                text = "hw5_div(" + left + ", " + right + ")";
+                if (BYTE == node.resultType) {
+                    setSequencedResult(prefix, "(uint8_t)" + text, false);
+                    return;
+                }
+                break;
+            default: break;
+        }
+        setSequencedResult(prefix, text, true);
+    }
+
+    void visit(RelOp& node) override {
+        static const char* const operators[] = {"==", "!=", "<", ">", "<=", ">="};
+        vector<string> operands;
+        const string prefix = sequence({node.getLeft(), node.getRight()}, operands);
+        string op = "==";
+        switch (node.getOp()) {
+            case RelOpType::EQ: op = operators[0]; break;
+            case RelOpType::NE: op = operators[1]; break;
+            case RelOpType::LT: op = operators[2]; break;
+            case RelOpType::GT: op = operators[3]; break;
+            case RelOpType::LE: op = operators[4]; break;
+            case RelOpType::GE: op = operators[5]; break;
+            default: break;
+        }
+        setSequencedResult(prefix, operands[0] + " " + op + " " + operands[1], false);
+    }
+
+    void visit(Not& node) override {
+        setResult("!" + operand(node.getExpr()), true);
+    }
+
+    void visit(And& node) override {
+        const string left = operand(node.getLeft());
+        setResult(left + " && " + operand(node.getRight()), false);
+    }
+
+    void visit(Or& node) override {
+        const string left = operand(node.getLeft());
+        setResult(left + " || " + operand(node.getRight()), false);
+    }
+
+    void visit(Type& node) override {}
+
+    void visit(Cast& node) override {
+        if (BYTE == node.getTargetType()) {
+            setResult("(uint8_t)" + operand(node.getExpr()), false);
+        } else {
+            node.getExpr()->accept(*this);
+        }
+    }
+
+    void visit(ExpList& node) override {}
+
+    void visit(Call& node) override {
+        const string function = node.getFuncId();
+        vector<string> arguments;
+        const string prefix = sequence(node.getArgs(), arguments);
+        string text = ("print" == function || "printi" == function) ? "hw5_" + function : functionName(function);
+        text += "(";
+        for (size_t i = 0; i < arguments.size(); ++i) {
+            text += (i ? ", " : "") + arguments[i];
+        }
+        setSequencedResult(prefix, text + ")", true);
+    }
+
+    void visit(Statements& node) override {
+        line("{");
+        ++indentation;
+        statementsOf(node);
+        --indentation;
+        line("}");
+    }
+
+    void visit(Break& node) override {
+        line("break;");
+    }
+
+    void visit(Continue& node) override {
+        line("continue;");
+    }
+
+    void visit(Return& node) override {
+        if (node.getExpr()) {
+            line("return " + translate(node.getExpr()) + ";");
+        } else {
+            line("return;");
+        }
+    }
+
+    void visit(If& node) override {
+        line("if (" + translate(node.getCondition()) + ") {");
+        block(node.getThen());
+        shared_ptr<Statement> otherwise = node.getElse();
+        // else if chains stay flat
+        while (auto elseIf = dynamic_pointer_cast<If>(otherwise)) {
+            line("} else if (" + translate(elseIf->getCondition()) + ") {");
+            block(elseIf->getThen());
+            otherwise = elseIf->getElse();
+        }
+        if (otherwise) {
+            line("} else {");
+            block(otherwise);
+        }
+        line("}");
+    }
+
+    void visit(While& node) override {
+        line("while (" + translate(node.getCondition()) + ") {");
+        block(node.getBody());
+        line("}");
+    }
+
+    void visit(VarDecl& node) override {
+        const string initial = node.getVarInitExp() ? assigned(node.getVarInitExp())
+                                                    : (BOOL == node.getVarType() ? "false" : "0");
+        line(string(typeName(node.getVarType())) + " " + variableName(node.getValueStr()) + " = " + initial + ";");
+    }
+
+    void visit(Assign& node) override {
+        line(variableName(node.getValueStr()) + " = " + assigned(node.getAssignExp()) + ";");
+    }
+
+    void visit(Formal& node) override {}
+    void visit(Formals& node) override {}
+
+    void visit(FuncDecl& node) override {
+        string signature = string("static ") + typeName(node.getFuncReturnType()) + " " + functionName(node.getFuncId()) + "(";
+        const vector<shared_ptr<Formal>> formals = node.getFuncParams()->getFormals();
+        for (size_t i = 0; i < formals.size(); ++i) {
+            signature += (i ? ", " : "") + string(typeName(formals[i]->getFormalType())) + " "
+                         + variableName(formals[i]->getFormalId());
+        }
+        signature += formals.empty() ? "void)" : ")";
+        prototypes << signature << ";\n";
+
+        body.str("");
+        indentation = 0;
+        temporaries = 0;
+        const vector<shared_ptr<Statement>> statements = node.getFuncBody()->getStatements();
+        block(node.getFuncBody());
+        // Falling off the end of a function with a value returns 0, as in the generated LLVM IR
+        if (VOID != node.getFuncReturnType() && (statements.empty() || !dynamic_pointer_cast<Return>(statements.back()))) {
+            ++indentation;
+            line("return 0;");
+            --indentation;
+        }
+
+        definitions << "\n" << signature << " {\n";
+        if (temporaries) {
+            definitions << "    int32_t";
+            for (int i = 0; i < temporaries; ++i) {
+                definitions << (i ? ", t_" : " t_") << i;
+            }
+            definitions << ";\n";
+        }
+        definitions << body.str() << "}\n";
+    }
+
+    void visit(Funcs& node) override {
+        for (auto& function : node.getFuncs()) {
+            function->accept(*this);
+        }
+    }
+};
+
+#endif // C_SOURCE_GENERATOR_HPP
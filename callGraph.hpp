@@ -0,0 +1,172 @@
+#ifndef CALL_GRAPH_HPP
+#define CALL_GRAPH_HPP
+
+#include "nodes.hpp"
+#include "loopAnalyzer.hpp"
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <iostream>
+
+using namespace std;
+using namespace ast;
+
+/* CallGraph class
+ * The functions every function of the program calls, and the functions reachable from the root (main).
+ * Functions main never reaches are not generated. The built-in print and printi appear as callees
+ * like any other function.
+ */
+class CallGraph {
+private:
+    // Functions in the order they are defined
+    vector<string> functions;
+    map<string, set<string>> callees;
+    set<string> reachable;
+    // Functions on a cycle of calls, found once so that the question costs nothing per call site
+    set<string> recursive;
+    // The strongly connected components, every one after the components it calls
+    vector<vector<string>> components;
+
+    // Strongly connected components of the defined functions (Tarjan, with an explicit stack so that long
+    // call chains do not exhaust the native one). Every function of a component with a cycle is recursive.
+    void findRecursive() {
+        map<string, size_t> index;
+        map<string, size_t> lowLink;
+        vector<string> component;
+        set<string> onComponent;
+        for (const string& root : functions) {
+            if (index.count(root)) {
+                continue;
+            }
+            // (function, callees not yet visited)
+            vector<pair<string, set<string>::const_iterator>> path;
+            auto enter = [&](const string& function) {
+                const size_t order = index.size();
+                index[function] = order;
+                lowLink[function] = order;
+                component.push_back(function);
+                onComponent.insert(function);
+                path.push_back({function, calleesOf(function).begin()});
+            };
+            enter(root);
+            while (!path.empty()) {
+                const string function = path.back().first;
+                auto& next = path.back().second;
+                if (next != calleesOf(function).end()) {
+                    const string callee = *next++;
+                    if (!callees.count(callee)) {
+                        continue;
+                    }
+                    if (!index.count(callee)) {
+                        enter(callee);
+                    } else if (onComponent.count(callee)) {
+                        lowLink[function] = min(lowLink[function], index[callee]);
+                    }
+                    continue;
+                }
+                path.pop_back();
+                if (!path.empty()) {
+                    lowLink[path.back().first] = min(lowLink[path.back().first], lowLink[function]);
+                }
+                if (lowLink[function] != index[function]) {
+                    continue;
+                }
+                vector<string> members;
+                do {
+                    members.push_back(component.back());
+                    onComponent.erase(component.back());
+                    component.pop_back();
+                } while (members.back() != function);
+                if (members.size() > 1 || calleesOf(function).count(function)) {
+                    recursive.insert(members.begin(), members.end());
+                }
+                components.push_back(members);
+            }
+        }
+    }
+
+public:
+    void build(const Funcs& program, const string& root = "main") {
+        functions.clear();
+        callees.clear();
+        reachable.clear();
+        recursive.clear();
+        components.clear();
+        for (const shared_ptr<FuncDecl>& function : program.getFuncs()) {
+            LoopBodyScanner scanner;
+            function->getFuncBody()->accept(scanner);
+            functions.push_back(function->getFuncId());
+            callees[function->getFuncId()] = scanner.calledFunctions;
+        }
+
+        vector<string> worklist{root};
+        while (!worklist.empty()) {
+            const string function = worklist.back();
+            worklist.pop_back();
+            if (!reachable.insert(function).second) {
+                continue;
+            }
+            auto called = callees.find(function);
+            if (called != callees.end()) {
+                worklist.insert(worklist.end(), called->second.begin(), called->second.end());
+            }
+        }
+        findRecursive();
+    }
+
+    bool isReachable(const string& function) const {
+        return reachable.count(function) > 0;
+    }
+
+    // Functions called directly by a defined function, empty for built-ins
+    const set<string>& calleesOf(const string& function) const {
+        static const set<string> none;
+        auto called = callees.find(function);
+        return (called == callees.end()) ? none : called->second;
+    }
+
+    // Whether a call of from can lead to a call of to, through at least one call
+    bool reaches(const string& from, const string& to) const {
+        set<string> visited;
+        vector<string> worklist(calleesOf(from).begin(), calleesOf(from).end());
+        while (!worklist.empty()) {
+            const string function = worklist.back();
+            worklist.pop_back();
+            if (function == to) {
+                return true;
+            }
+            if (visited.insert(function).second) {
+                worklist.insert(worklist.end(), calleesOf(function).begin(), calleesOf(function).end());
+            }
+        }
+        return false;
+    }
+
+    bool isRecursive(const string& function) const {
+        return recursive.count(function) > 0;
+    }
+
+    // Functions that call each other, directly or not, callees before their callers
+    const vector<vector<string>>& stronglyConnectedComponents() const {
+        return components;
+    }
+
+    // Defined functions in definition order
+    const vector<string>& definedFunctions() const {
+        return functions;
+    }
+
+    void printReport(ostream& os) const {
+        os << "call graph:" << endl;
+        for (const string& function : functions) {
+            os << "  " << function << " ->";
+            for (const string& callee : calleesOf(function)) {
+                os << " " << callee;
+            }
+            os << (isReachable(function) ? "" : " (unreachable)") << endl;
+        }
+    }
+};
+
+#endif // CALL_GRAPH_HPP
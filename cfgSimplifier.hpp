@@ -0,0 +1,258 @@
+#ifndef CFG_SIMPLIFIER_HPP
+#define CFG_SIMPLIFIER_HPP
+
+#include "output.hpp"
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <iostream>
+
+using namespace std;
+using namespace output;
+
+/* CfgSimplifier class
+ * Simplifies the control flow graph of every function record:
+ *  - drops the instructions after the first terminator of a block (the branch emitted after a break or continue),
+ *  - folds conditional branches on constant conditions (and on two equal targets),
+ *  - threads jumps through blocks that contain nothing but an unconditional branch,
+ *  - removes blocks that cannot be reached from the entry block,
+ *  - merges a block into its only predecessor when that predecessor jumps straight to it.
+ */
+class CfgSimplifier {
+private:
+    map<string, int> counts;
+
+    static const int MAX_ITERATIONS = 16;
+
+    static string labelName(const BlockRecord &block) {
+        return "%" + block.label;
+    }
+
+    // The passes below read the edges of a block from its last instruction, so everything after its first
+    // terminator has to go before they run. The blocks only that dead tail branched to are removed with the
+    // other unreachable blocks, taking any use of a value the tail defined with them.
+    bool removeDeadTails(FunctionRecord &function) {
+        bool changed = false;
+        for (BlockRecord &block : function.blocks) {
+            for (size_t i = 0; i + 1 < block.instructions.size(); ++i) {
+                if (block.instructions[i].isTerminator()) {
+                    counts["dead-instruction"] += block.instructions.size() - i - 1;
+                    block.instructions.erase(block.instructions.begin() + i + 1, block.instructions.end());
+                    changed = true;
+                    break;
+                }
+            }
+        }
+        return changed;
+    }
+
+    // "br i1 true, label %a, label %b" -> "br label %a"
+    bool foldConstantBranches(FunctionRecord &function) {
+        bool changed = false;
+        for (BlockRecord &block : function.blocks) {
+            if (block.instructions.empty() || block.instructions.back().opcode != "br") {
+                continue;
+            }
+            InstructionRecord &branch = block.instructions.back();
+            vector<string> targets = block.successors();
+            if (targets.size() != 2) {
+                continue;
+            }
+            const string condition = branch.operands.substr(3, branch.operands.find(',') - 3);
+            string target;
+            if (condition == "true" || condition == "1") {
+                target = targets[0];
+            } else if (condition == "false" || condition == "0") {
+                target = targets[1];
+            } else if (targets[0] == targets[1]) {
+                target = targets[0];
+            } else {
+                continue;
+            }
+            branch.operands = "label " + target;
+            counts["constant-branch"]++;
+            changed = true;
+        }
+        return changed;
+    }
+
+    // A block holding only "br label %X" can be bypassed by every branch that targets it
+    bool threadJumps(FunctionRecord &function) {
+        unordered_map<string, string> forwards;
+        for (size_t i = 1; i < function.blocks.size(); ++i) {
+            const BlockRecord &block = function.blocks[i];
+            if (block.instructions.size() == 1 && block.instructions[0].opcode == "br"
+                && block.successors().size() == 1 && block.successors()[0] != labelName(block)) {
+                forwards[labelName(block)] = block.successors()[0];
+            }
+        }
+        if (forwards.empty()) {
+            return false;
+        }
+        // Follow chains of empty blocks, stopping on cycles of empty blocks
+        for (auto &forward : forwards) {
+            string target = forward.second;
+            for (size_t steps = 0; forwards.count(target) && steps < forwards.size(); ++steps) {
+                target = forwards[target];
+            }
+            forward.second = target;
+        }
+
+        bool changed = false;
+        for (BlockRecord &block : function.blocks) {
+            if (block.instructions.empty() || block.instructions.back().opcode != "br") {
+                continue;
+            }
+            InstructionRecord &branch = block.instructions.back();
+            for (const string &target : block.successors()) {
+                auto forward = forwards.find(target);
+                if (forward != forwards.end() && forward->second != target) {
+                    string replaced;
+                    size_t pos = branch.operands.find("label " + target);
+                    while (pos != string::npos) {
+                        size_t end = pos + 6 + target.size();
+                        bool wholeLabel = end == branch.operands.size() || branch.operands[end] == ',';
+                        if (wholeLabel) {
+                            branch.operands.replace(pos + 6, target.size(), forward->second);
+                            counts["jump-threading"]++;
+                            changed = true;
+                        }
+                        pos = branch.operands.find("label " + target, pos + 1);
+                    }
+                }
+            }
+        }
+        return changed;
+    }
+
+    bool removeUnreachableBlocks(FunctionRecord &function) {
+        unordered_map<string, size_t> blockIndex;
+        for (size_t i = 0; i < function.blocks.size(); ++i) {
+            blockIndex[labelName(function.blocks[i])] = i;
+        }
+        vector<bool> reachable(function.blocks.size(), false);
+        vector<size_t> worklist = {0};
+        reachable[0] = true;
+        while (!worklist.empty()) {
+            size_t current = worklist.back();
+            worklist.pop_back();
+            for (const string &target : function.blocks[current].successors()) {
+                auto it = blockIndex.find(target);
+                if (it != blockIndex.end() && !reachable[it->second]) {
+                    reachable[it->second] = true;
+                    worklist.push_back(it->second);
+                }
+            }
+        }
+
+        vector<BlockRecord> kept;
+        for (size_t i = 0; i < function.blocks.size(); ++i) {
+            if (reachable[i]) {
+                kept.push_back(function.blocks[i]);
+            } else {
+                counts["unreachable-block"]++;
+            }
+        }
+        bool changed = kept.size() != function.blocks.size();
+        function.blocks = kept;
+        return changed;
+    }
+
+    bool mergeStraightLineBlocks(FunctionRecord &function) {
+        bool changed = false;
+        bool merged = true;
+        while (merged) {
+            merged = false;
+            unordered_map<string, int> predecessors;
+            unordered_map<string, size_t> blockIndex;
+            for (size_t i = 0; i < function.blocks.size(); ++i) {
+                blockIndex[labelName(function.blocks[i])] = i;
+                for (const string &target : function.blocks[i].successors()) {
+                    predecessors[target]++;
+                }
+            }
+            for (size_t i = 0; i < function.blocks.size() && !merged; ++i) {
+                BlockRecord &block = function.blocks[i];
+                vector<string> targets = block.successors();
+                if (targets.size() != 1 || predecessors[targets[0]] != 1) {
+                    continue;
+                }
+                auto successor = blockIndex.find(targets[0]);
+                if (successor == blockIndex.end() || successor->second == i || successor->second == 0) {
+                    continue;
+                }
+                BlockRecord next = function.blocks[successor->second];
+                // A block ending in unreachable is an error path the generator placed at the end of the
+                // function, the merged block takes its place there (the entry block has to stay first)
+                const bool isErrorPath = i != 0 && !next.instructions.empty() && next.instructions.back().opcode == "unreachable";
+                block.instructions.pop_back();
+                block.instructions.insert(block.instructions.end(), next.instructions.begin(), next.instructions.end());
+                function.blocks.erase(function.blocks.begin() + successor->second);
+                if (isErrorPath) {
+                    const size_t position = (successor->second > i) ? successor->second - 1 : successor->second;
+                    BlockRecord moved = function.blocks[i];
+                    function.blocks.erase(function.blocks.begin() + i);
+                    function.blocks.insert(function.blocks.begin() + position, moved);
+                }
+                counts["block-merge"]++;
+                merged = true;
+                changed = true;
+            }
+        }
+        return changed;
+    }
+
+public:
+    CfgSimplifier() = default;
+
+    // Returns true if the function was changed
+    bool run(FunctionRecord &function) {
+        bool changed = false;
+        if (function.blocks.empty()) {
+            return false;
+        }
+        // Merging blocks removes the branch between them, so no pass below leaves a terminator mid-block
+        changed |= removeDeadTails(function);
+        for (int iteration = 0; iteration < MAX_ITERATIONS; ++iteration) {
+            bool iterationChanged = false;
+            iterationChanged |= foldConstantBranches(function);
+            iterationChanged |= threadJumps(function);
+            iterationChanged |= removeUnreachableBlocks(function);
+            iterationChanged |= mergeStraightLineBlocks(function);
+            if (!iterationChanged) {
+                break;
+            }
+            changed = true;
+        }
+        return changed;
+    }
+
+    bool run(vector<ModuleEntry> &entries) {
+        bool changed = false;
+        for (ModuleEntry &entry : entries) {
+            if (entry.isFunction) {
+                changed |= run(entry.function);
+            }
+        }
+        return changed;
+    }
+
+    // Adds the simplifications another simplifier (of other functions) applied
+    void merge(const CfgSimplifier &other) {
+        for (const auto &simplification : other.counts) {
+            counts[simplification.first] += simplification.second;
+        }
+    }
+
+    void printReport(ostream &os) const {
+        static const vector<string> names = {"dead-instruction", "constant-branch", "jump-threading", "unreachable-block", "block-merge"};
+        os << "cfg simplifications:" << endl;
+        for (const string &name : names) {
+            auto it = counts.find(name);
+            os << "  " << name << ": " << (it == counts.end() ? 0 : it->second) << endl;
+        }
+    }
+};
+
+#endif // CFG_SIMPLIFIER_HPP
@@ -0,0 +1,255 @@
+#!/bin/bash
+# Checks what hw5 generates where the .out files cannot tell: the tests of an optimization print the same
+# with the optimization off, and two modules that print the same may still differ. Every check of a feature
+# that has an option to turn it off is paired with one showing that the option changes what is checked.
+#   ir       the LLVM IR of the tests of the call graph, effect, branch weight and division guard passes
+#   threads  every test and a generated program of 200 functions compile to the same bytes with
+#            --threads=8 as with --threads=1
+#   cache    a miss and a hit of the compilation cache exit and write what hw5 does without it, for every
+#            test including the rejected ones, racing writers leave whole entries, and the least recently
+#            used entries are evicted
+#   incremental  compiles with a state, again unchanged, and after edits to the bodies and the signature of
+#            callees write the module of a full compilation and reuse the functions the edits did not reach,
+#            a damaged state is discarded
+# Prints the failing checks and the totals, the exit status is 1 if a check failed.
+# usage: ./check_features.sh [path to hw5] [section, default all]
+
+HW5=${1:-./hw5}
+SECTION=${2:-all}
+TESTS_DIR=$(dirname "$0")
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+passed=0
+failed=0
+
+# Runs the command after the description, the check passes if it succeeds
+check() {
+    local description=$1
+    shift
+    if "$@" > /dev/null 2>&1; then
+        passed=$((passed + 1))
+    else
+        failed=$((failed + 1))
+        echo "FAIL $description"
+    fi
+}
+
+# Writes the LLVM IR of the test of Our_Tests (name without .in) compiled with the options after it
+compile() {
+    local test=$1
+    shift
+    "$HW5" "$@" < "$TESTS_DIR/Our_Tests/$test.in"
+}
+
+# Whether a line of the IR of the test matches the pattern, options for hw5 follow the pattern
+ir_has() {
+    compile "$1" "${@:3}" | grep -qE "$2"
+}
+
+ir_lacks() {
+    ! ir_has "$@"
+}
+
+# Whether hw5 writes the same output and diagnostics for the program with either option given after it
+same_output() {
+    cmp -s <("$HW5" "$2" < "$1" 2>&1) <("$HW5" "$3" < "$1" 2>&1)
+}
+
+# Writes the exit status, the output and the diagnostics of hw5 for the program given second with the options
+# after it, the output is kept in the file given first
+result() {
+    local output=$1 program=$2
+    shift 2
+    "$HW5" "$@" < "$program" > "$output" 2> "$output.diagnostics"
+    echo "status $?"
+    cat "$output"
+    echo "diagnostics:"
+    cat "$output.diagnostics"
+}
+
+# Whether hw5 exits, writes and reports the same for the program with the options after it as without them
+same_result() {
+    cmp -s <(result "$WORK_DIR/expected" "$1") <(result "$WORK_DIR/actual" "$@")
+}
+
+# Whether the cache statistics after compiling the program with the cache directory and size limit (MiB)
+# given second and third start with the counts given last
+cache_counts_are() {
+    "$HW5" --cache-dir="$2" --cache-size="$3" --cache-stats < "$1" 2>&1 > /dev/null \
+        | grep -q "^compilation cache $2: $4"
+}
+
+# Compiles the program with the incremental state given second, keeps the module and the statistics
+compile_incrementally() {
+    "$HW5" --incremental="$2" --incremental-stats < "$1" > "$WORK_DIR/incremental.ll" 2> "$WORK_DIR/incremental.txt"
+}
+
+# Whether the last block of the function (name without @) in the IR of the test matches the pattern
+last_block_has() {
+    compile "$1" "${@:4}" | awk -v header="^define [^@]*@$2 [(]" '
+        $0 ~ header { inside = 1 }
+        inside && /^[A-Za-z0-9_.]+:$/ { block = "" }
+        inside { block = block $0 "\n" }
+        inside && /^}/ { printf "%s", block; exit }' | grep -qE "$3"
+}
+
+check_ir() {
+    local unused=Our_Test_t060_UnusedFunctions
+    check "$unused: unused is not defined" ir_lacks $unused '^define .*@unused '
+    check "$unused: unused is defined with --keep-unused-functions" \
+        ir_has $unused '^define .*@unused ' --keep-unused-functions
+
+    # square in t060 and scale in t061 are pure leaves, report prints, countdown may recurse without end
+    local effects=Our_Test_t061_FunctionEffects
+    check "$unused: square is readnone willreturn" ir_has $unused '^define i32 @square \(.*\) nounwind readnone willreturn \{'
+    check "$effects: scale is readnone willreturn" ir_has $effects '^define i32 @scale \(.*\) nounwind readnone willreturn \{'
+    check "$effects: report is not readnone" ir_has $effects '^define void @report \(.*\) nounwind willreturn \{'
+    check "$effects: countdown is not willreturn" ir_has $effects '^define i32 @countdown \(.*\) nounwind readnone \{'
+    check "$effects: no attributes with --no-function-attributes" \
+        ir_has $effects '^define i32 @scale \(i32, i32\) \{' --no-function-attributes
+
+    # The loop latches of t064 are weighted, its division error path is cold and placed after the body
+    local cold=Our_Test_t064_ColdErrorPath
+    check "$cold: loop latch has !prof" ir_has $cold '^\s*br i1 .*, !prof ![0-9]+'
+    check "$cold: no !prof with --no-branch-hints" ir_lacks $cold '!prof' --no-branch-hints
+    check "$cold: the error calls are cold" ir_has $cold 'call void @exit\(i32 0\) cold'
+    check "$cold: no cold calls with --no-branch-hints" ir_lacks $cold ' cold$' --no-branch-hints
+    check "$cold: the error block of scaled is its last block" last_block_has $cold scaled '@\.division_error'
+
+    # The divisions of t065 by runtime values branch to the error block with 1:2000 weights
+    local guard=Our_Test_t065_RuntimeDivisionGuard
+    check "$guard: the guard branch has !prof" ir_has $guard 'br i1 .*, label %[a-z_0-9]+\.division_error, label .*, !prof'
+    check "$guard: the guard weights are 1:2000" ir_has $guard '= !\{!"branch_weights", i32 1, i32 2000\}'
+    check "$guard: the error block of ratio is its last block" last_block_has $guard ratio '@\.division_error'
+    check "$guard: no guard weights with --no-branch-hints" ir_lacks $guard '!prof' --no-branch-hints
+}
+
+# Functions are generated in parallel into their own buffers, the numbering must not depend on the order
+check_threads() {
+    local test
+    for test in "$TESTS_DIR"/Our_Tests/*.in "$TESTS_DIR"/Staff_Tests/*.in; do
+        check "$(basename "$test" .in): --threads=8 writes the module of --threads=1" \
+            same_output "$test" --threads=1 --threads=8
+    done
+    "$TESTS_DIR/Benchmarks/generate_program.sh" 200 > "$WORK_DIR/Generated_200_Functions.in"
+    check "Generated_200_Functions: --threads=8 writes the module of --threads=1" \
+        same_output "$WORK_DIR/Generated_200_Functions.in" --threads=1 --threads=8
+}
+
+check_cache() {
+    local test tests=0 cache="$WORK_DIR/cache"
+    for test in "$TESTS_DIR"/Our_Tests/*.in "$TESTS_DIR"/Staff_Tests/*.in; do
+        check "$(basename "$test" .in): a miss writes what hw5 writes without the cache" \
+            same_result "$test" --cache-dir="$cache"
+        check "$(basename "$test" .in): a hit writes what hw5 writes without the cache" \
+            same_result "$test" --cache-dir="$cache"
+        tests=$((tests + 1))
+    done
+    # Tests with the same text share an entry
+    local distinct
+    distinct=$(sha256sum "$TESTS_DIR"/Our_Tests/*.in "$TESTS_DIR"/Staff_Tests/*.in | cut -d' ' -f1 | sort -u | wc -l)
+    check "the corpus missed once per distinct test and hit otherwise" \
+        cache_counts_are "$TESTS_DIR/Our_Tests/Our_Test_t060_UnusedFunctions.in" "$cache" 256 \
+        "$((2 * tests - distinct + 1)) hits, $distinct misses, 0 evictions, $distinct entries"
+
+    # Writers of the same entry race on the rename into place, each one still writes the whole result
+    local writer racing="$WORK_DIR/racing" program="$TESTS_DIR/Our_Tests/Our_Test_t061_FunctionEffects.in"
+    for writer in 1 2 3 4 5 6 7 8; do
+        "$HW5" --cache-dir="$racing" < "$program" > "$WORK_DIR/racing.$writer.ll" &
+    done
+    wait
+    for writer in 1 2 3 4 5 6 7 8; do
+        check "racing writer $writer writes the module" cmp -s <("$HW5" < "$program") "$WORK_DIR/racing.$writer.ll"
+    done
+    check "racing writers leave no temporary files" \
+        test -z "$(find "$racing" -name '.tmp.*')"
+    check "a hit after racing writers writes the module" same_result "$program" --cache-dir="$racing"
+
+    # With 1 MiB, A (200 functions, about 450 KB) and B (100 functions) fit, C (201 functions) only fits
+    # after evicting the least recently used entry. A is used again before C is stored, so B goes.
+    local lru="$WORK_DIR/lru" count
+    for count in 200 100 201; do
+        "$TESTS_DIR/Benchmarks/generate_program.sh" $count > "$WORK_DIR/Generated_${count}_Functions.in"
+    done
+    local a="$WORK_DIR/Generated_200_Functions.in" b="$WORK_DIR/Generated_100_Functions.in"
+    local c="$WORK_DIR/Generated_201_Functions.in"
+    check "A is a miss" cache_counts_are "$a" "$lru" 1 "0 hits, 1 misses, 0 evictions, 1 entries"
+    check "A and B fit in 1 MiB" cache_counts_are "$b" "$lru" 1 "0 hits, 2 misses, 0 evictions, 2 entries"
+    check "A is a hit" cache_counts_are "$a" "$lru" 1 "1 hits, 2 misses, 0 evictions, 2 entries"
+    check "storing C evicts one entry" cache_counts_are "$c" "$lru" 1 "1 hits, 3 misses, 1 evictions, 2 entries"
+    check "A, used after B, is kept" cache_counts_are "$a" "$lru" 1 "2 hits, 3 misses, 1 evictions"
+    check "B, the least recently used, was evicted" cache_counts_are "$b" "$lru" 1 "2 hits, 4 misses"
+}
+
+# Damages to the state file given first: an instruction of a saved function, a state cut short, a file of
+# another kind (the program given second)
+change_instruction() {
+    sed -i '0,/ = add i32 %/s// = mul i32 %/' "$1"
+}
+
+cut_short() {
+    truncate -s 200 "$1"
+}
+
+replace_with_source() {
+    cp "$2" "$1"
+}
+
+# The functions of t061 are generated as 8 (scale has clones for its constant arguments) and optimized as 10
+check_incremental() {
+    local program="$TESTS_DIR/Our_Tests/Our_Test_t061_FunctionEffects.in" state="$WORK_DIR/state"
+    # report prints, an edit of its body does not reach its callers, scale is pure, its callers fold its calls
+    sed 's/printi(x);/printi(x + 1);/' "$program" > "$WORK_DIR/report_body.in"
+    sed 's/x \* factor + 1/x * factor + 2/' "$WORK_DIR/report_body.in" > "$WORK_DIR/scale_body.in"
+    sed 's/int factor)/int factor, int offset)/; s/x \* factor + 2/x * factor + offset/; /^int scale/!s/scale(\([^()]*\))/scale(\1, 2)/g' \
+        "$WORK_DIR/scale_body.in" > "$WORK_DIR/scale_signature.in"
+
+    local step source description counts steps=(
+        "$program|no state|0 functions reused, 8 generated, 0 optimized functions reused, 10 optimized"
+        "$program|unchanged|8 functions reused, 0 generated, 10 optimized functions reused, 0 optimized"
+        "$WORK_DIR/report_body.in|report body edited|7 functions reused, 1 generated, 9 optimized functions reused, 1 optimized"
+        "$WORK_DIR/scale_body.in|scale body edited|4 functions reused, 4 generated, 7 optimized functions reused, 3 optimized"
+        "$WORK_DIR/scale_signature.in|scale signature edited|3 functions reused, 6 generated, 5 optimized functions reused, 6 optimized")
+    for step in "${steps[@]}"; do
+        IFS='|' read -r source description counts <<< "$step"
+        compile_incrementally "$source" "$state"
+        check "$description: writes the module of a full compilation" \
+            cmp -s <("$HW5" < "$source") "$WORK_DIR/incremental.ll"
+        check "$description: $counts" grep -qx "incremental state $state: $counts" "$WORK_DIR/incremental.txt"
+    done
+
+    local damage
+    for damage in change_instruction cut_short replace_with_source; do
+        compile_incrementally "$program" "$state"
+        $damage "$state" "$program"
+        compile_incrementally "$program" "$state"
+        check "$damage: writes the module of a full compilation" \
+            cmp -s <("$HW5" < "$program") "$WORK_DIR/incremental.ll"
+        check "$damage: the state is discarded" grep -q ": 0 functions reused, 8 generated, 0 optimized functions reused" \
+            "$WORK_DIR/incremental.txt"
+    done
+    compile_incrementally "$program" "$state"
+    check "a damaged state is replaced" grep -q ": 8 functions reused, 0 generated" "$WORK_DIR/incremental.txt"
+}
+
+case "$SECTION" in
+    ir)
+        check_ir ;;
+    threads)
+        check_threads ;;
+    cache)
+        check_cache ;;
+    incremental)
+        check_incremental ;;
+    all)
+        check_ir
+        check_threads
+        check_cache
+        check_incremental ;;
+    *)
+        echo "unknown section '$SECTION'" >&2
+        exit 2 ;;
+esac
+echo "$SECTION: $passed passed, $failed failed"
+[ "$failed" -eq 0 ]
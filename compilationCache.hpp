@@ -0,0 +1,327 @@
+#ifndef COMPILATION_CACHE_HPP
+#define COMPILATION_CACHE_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <filesystem>
+#include <algorithm>
+#include <cstdint>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Identifies the compiler build in the cache keys. The Makefile passes a hash of the sources,
+// other builds fall back to their build time.
+#ifndef HW5_BUILD_ID
+#define HW5_BUILD_ID __DATE__ " " __TIME__
+#endif
+
+/* Sha256 class
+ * The SHA-256 digest of a text as 64 hexadecimal digits, it names the cache entries.
+ */
+class Sha256 {
+private:
+    uint32_t state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+    static uint32_t rotateRight(uint32_t value, int bits) {
+        return (value >> bits) | (value << (32 - bits));
+    }
+
+    void compress(const unsigned char* block) {
+        static const uint32_t ROUND_CONSTANTS[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+        uint32_t words[64];
+        for (int i = 0; i < 16; ++i) {
+            words[i] = (uint32_t(block[4 * i]) << 24) | (uint32_t(block[4 * i + 1]) << 16)
+                | (uint32_t(block[4 * i + 2]) << 8) | uint32_t(block[4 * i + 3]);
+        }
+        for (int i = 16; i < 64; ++i) {
+            const uint32_t s0 = rotateRight(words[i - 15], 7) ^ rotateRight(words[i - 15], 18) ^ (words[i - 15] >> 3);
+            const uint32_t s1 = rotateRight(words[i - 2], 17) ^ rotateRight(words[i - 2], 19) ^ (words[i - 2] >> 10);
+            words[i] = words[i - 16] + s0 + words[i - 7] + s1;
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; ++i) {
+            const uint32_t s1 = rotateRight(e, 6) ^ rotateRight(e, 11) ^ rotateRight(e, 25);
+            const uint32_t choice = (e & f) ^ (~e & g);
+            const uint32_t first = h + s1 + choice + ROUND_CONSTANTS[i] + words[i];
+            const uint32_t s0 = rotateRight(a, 2) ^ rotateRight(a, 13) ^ rotateRight(a, 22);
+            const uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+            h = g;
+            g = f;
+            f = e;
+            e = d + first;
+            d = c;
+            c = b;
+            b = a;
+            a = first + s0 + majority;
+        }
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+    }
+
+public:
+    static string digest(const string& text) {
+        Sha256 hash;
+        size_t offset = 0;
+        for (; offset + 64 <= text.size(); offset += 64) {
+            hash.compress(reinterpret_cast<const unsigned char*>(text.data()) + offset);
+        }
+        // The rest, a 1 bit, zeros and the length in bits fill the last one or two blocks
+        unsigned char tail[128] = {0};
+        const size_t rest = text.size() - offset;
+        copy(text.begin() + offset, text.end(), tail);
+        tail[rest] = 0x80;
+        const size_t tailSize = (rest < 56) ? 64 : 128;
+        const uint64_t bits = uint64_t(text.size()) * 8;
+        for (int i = 0; i < 8; ++i) {
+            tail[tailSize - 1 - i] = static_cast<unsigned char>(bits >> (8 * i));
+        }
+        for (size_t block = 0; block < tailSize; block += 64) {
+            hash.compress(tail + block);
+        }
+        static const char* hexDigits = "0123456789abcdef";
+        string hex;
+        for (uint32_t word : hash.state) {
+            for (int shift = 28; shift >= 0; shift -= 4) {
+                hex += hexDigits[(word >> shift) & 15];
+            }
+        }
+        return hex;
+    }
+};
+
+/* CachedResult struct
+ * What a compilation wrote to stdout (the module or the diagnostic line) and to stderr, and its exit status.
+ */
+struct CachedResult {
+    int status = 0;
+    string output;
+    string diagnostics;
+};
+
+/* CompilationCache class
+ * A directory of compilation results named by the digest of the source, the compiler build and the
+ * options. Entries are written to a temporary file and renamed into place, so concurrent compilers only
+ * ever see complete entries, and the same key always has the same content. The modification time of an
+ * entry is its last use: when the entries exceed the size limit, the least recently used are removed.
+ * The hit and miss counters live in the stats file, they and the eviction are updated under a lock file.
+ */
+class CompilationCache {
+private:
+    filesystem::path directory;
+    uintmax_t maxBytes;
+
+    static constexpr const char* ENTRY_HEADER = "hw5-cache 1";
+
+    // Holds the lock file of the cache directory while it lives
+    class DirectoryLock {
+    private:
+        int descriptor;
+
+    public:
+        explicit DirectoryLock(const filesystem::path& directory) {
+            descriptor = open((directory / "lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+            if (descriptor >= 0) {
+                flock(descriptor, LOCK_EX);
+            }
+        }
+
+        ~DirectoryLock() {
+            if (descriptor >= 0) {
+                close(descriptor);
+            }
+        }
+
+        DirectoryLock(const DirectoryLock&) = delete;
+        DirectoryLock& operator=(const DirectoryLock&) = delete;
+    };
+
+    filesystem::path entryPath(const string& key) const {
+        return directory / "entries" / key;
+    }
+
+public:
+    // The file helpers are shared with the incremental state
+
+    // Writes the text to a file of its own and renames it to the path, which replaces the old file at once
+    static bool writeAtomically(const filesystem::path& path, const string& text) {
+        const filesystem::path temporary = path.parent_path() / (".tmp." + to_string(getpid()) + "." + path.filename().string());
+        {
+            ofstream file(temporary, ios::binary | ios::trunc);
+            file << text;
+            if (!file) {
+                error_code ignored;
+                filesystem::remove(temporary, ignored);
+                return false;
+            }
+        }
+        error_code error;
+        filesystem::rename(temporary, path, error);
+        if (error) {
+            filesystem::remove(temporary, error);
+            return false;
+        }
+        return true;
+    }
+
+    static bool readFile(const filesystem::path& path, string& text) {
+        ifstream file(path, ios::binary);
+        if (!file) {
+            return false;
+        }
+        ostringstream contents;
+        contents << file.rdbuf();
+        text = contents.str();
+        return true;
+    }
+
+private:
+    // hits, misses and evictions
+    vector<uint64_t> readCounters() const {
+        vector<uint64_t> counters(3, 0);
+        ifstream file(directory / "stats");
+        string name;
+        for (uint64_t& counter : counters) {
+            file >> name >> counter;
+        }
+        return counters;
+    }
+
+    void addToCounters(uint64_t hits, uint64_t misses, uint64_t evictions) {
+        vector<uint64_t> counters = readCounters();
+        ostringstream text;
+        text << "hits " << counters[0] + hits << "\nmisses " << counters[1] + misses
+             << "\nevictions " << counters[2] + evictions << "\n";
+        writeAtomically(directory / "stats", text.str());
+    }
+
+    // Removes the least recently used entries until the rest fits the size limit, the lock is held
+    uint64_t evict() {
+        struct Entry {
+            filesystem::path path;
+            filesystem::file_time_type lastUse;
+            uintmax_t size;
+        };
+        vector<Entry> entries;
+        uintmax_t totalSize = 0;
+        error_code error;
+        for (const auto& file : filesystem::directory_iterator(directory / "entries", error)) {
+            if (file.path().filename().string()[0] == '.') {
+                continue;
+            }
+            error_code fileError;
+            const uintmax_t size = file.file_size(fileError);
+            const filesystem::file_time_type lastUse = file.last_write_time(fileError);
+            if (!fileError) {
+                entries.push_back({file.path(), lastUse, size});
+                totalSize += size;
+            }
+        }
+        if (totalSize <= maxBytes) {
+            return 0;
+        }
+        sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+            return a.lastUse < b.lastUse || (a.lastUse == b.lastUse && a.path < b.path);
+        });
+        uint64_t evicted = 0;
+        for (const Entry& entry : entries) {
+            if (totalSize <= maxBytes) {
+                break;
+            }
+            if (filesystem::remove(entry.path, error)) {
+                totalSize -= entry.size;
+                evicted++;
+            }
+        }
+        return evicted;
+    }
+
+public:
+    CompilationCache(const string& directory, uintmax_t maxBytes) : directory(directory), maxBytes(maxBytes) {
+        error_code ignored;
+        filesystem::create_directories(this->directory / "entries", ignored);
+    }
+
+    // The key of a compilation: whatever changes the result changes the key
+    static string key(const string& source, const string& options) {
+        return Sha256::digest(string(ENTRY_HEADER) + '\0' + HW5_BUILD_ID + '\0' + options + '\0' + source);
+    }
+
+    // Returns true and the stored result if the cache has the key, a hit makes the entry the most recently used
+    bool lookup(const string& key, CachedResult& result) {
+        const filesystem::path path = entryPath(key);
+        string text;
+        bool isHit = readFile(path, text);
+        if (isHit) {
+            // "hw5-cache 1\n<status> <output size> <diagnostics size>\n<output><diagnostics>"
+            istringstream header(text);
+            string line;
+            size_t outputSize = 0;
+            size_t diagnosticsSize = 0;
+            getline(header, line);
+            isHit = line == ENTRY_HEADER && (header >> result.status >> outputSize >> diagnosticsSize)
+                && header.get() == '\n';
+            const size_t start = isHit ? static_cast<size_t>(header.tellg()) : 0;
+            isHit = isHit && start + outputSize + diagnosticsSize == text.size();
+            if (isHit) {
+                result.output = text.substr(start, outputSize);
+                result.diagnostics = text.substr(start + outputSize);
+            }
+        }
+        error_code ignored;
+        DirectoryLock lock(directory);
+        if (isHit) {
+            filesystem::last_write_time(path, filesystem::file_time_type::clock::now(), ignored);
+        }
+        addToCounters(isHit ? 1 : 0, isHit ? 0 : 1, 0);
+        return isHit;
+    }
+
+    void store(const string& key, const CachedResult& result) {
+        ostringstream text;
+        text << ENTRY_HEADER << "\n" << result.status << " " << result.output.size() << " "
+             << result.diagnostics.size() << "\n" << result.output << result.diagnostics;
+        if (!writeAtomically(entryPath(key), text.str())) {
+            return;
+        }
+        DirectoryLock lock(directory);
+        const uint64_t evicted = evict();
+        if (evicted) {
+            addToCounters(0, 0, evicted);
+        }
+    }
+
+    void printStatistics(ostream& os) const {
+        const vector<uint64_t> counters = readCounters();
+        uint64_t entries = 0;
+        uintmax_t bytes = 0;
+        error_code error;
+        for (const auto& file : filesystem::directory_iterator(directory / "entries", error)) {
+            error_code fileError;
+            const uintmax_t size = file.file_size(fileError);
+            if (file.path().filename().string()[0] != '.' && !fileError) {
+                entries++;
+                bytes += size;
+            }
+        }
+        os << "compilation cache " << directory.string() << ": " << counters[0] << " hits, " << counters[1]
+           << " misses, " << counters[2] << " evictions, " << entries << " entries, " << bytes << " of "
+           << maxBytes << " bytes" << endl;
+    }
+};
+
+#endif // COMPILATION_CACHE_HPP
@@ -0,0 +1,251 @@
+#ifndef COMPILER_OPTIONS_HPP
+#define COMPILER_OPTIONS_HPP
+
+#include <string>
+#include <set>
+#include <sstream>
+#include <iostream>
+#include <cstdlib>
+#include <thread>
+#include <algorithm>
+
+/* CompilerOptions struct
+ * Holds the command line configuration of hw5. The source program is always read from stdin,
+ * the generated code is written to stdout and reports are written to stderr.
+ */
+struct CompilerOptions {
+    // Peephole pass over the emitted instruction records
+    bool peephole = true;
+    std::set<std::string> disabledPeepholeRules;
+    bool peepholeStats = false;
+    // Control flow graph simplification over the emitted blocks
+    bool cfgSimplify = true;
+    bool cfgStats = false;
+    // Conditional assignments become a select instead of branches
+    bool selectConditionalAssign = true;
+    // Unrolling of while loops with a known trip count
+    bool unroll = true;
+    int unrollBudget = 128;
+    bool loopReport = false;
+    // Loop invariant expressions are computed once in a preheader block
+    bool hoistInvariants = true;
+    // Only functions reachable from main and the runtime helpers they call are emitted
+    bool removeUnusedFunctions = true;
+    bool callGraphReport = false;
+    // LLVM attributes (readnone, willreturn, ...) from the function effect analysis
+    bool functionAttributes = true;
+    // Steps the interpreter may spend on one call of a pure function with constant arguments
+    int evaluationBudget = 1000000;
+    bool divisionStats = false;
+    // Branch weights on loop latches and error branches, error paths marked cold
+    bool branchHints = true;
+    // Calls with constant arguments go to clones of the callee with those parameters bound
+    bool specialize = true;
+    int specializeBudget = 256;
+    // Pure recursive functions cache their results in a table
+    bool memoize = false;
+    // The analyzed program is interpreted instead of compiled
+    bool run = false;
+    // The analyzed program is lowered to bytecode and run in the virtual machine instead of compiled
+    bool virtualMachine = false;
+    // The bytecode listing is printed instead of the LLVM IR
+    bool bytecodeListing = false;
+    // Output language: "llvm" (LLVM IR), "x86-64" (GNU assembler for Linux) or "c" (C99)
+    std::string target = "llvm";
+    // main runs at compile time and the program only writes its output, when the run ends within the budget
+    bool aheadOfTime = false;
+    int aheadOfTimeBudget = 10000000;
+    // The module is written as a header module and up to this many shards into the shard directory
+    int shards = 0;
+    std::string shardDirectory = "shards";
+    // Threads generating the functions of the program, the generated code does not depend on the number
+    int threads = defaultThreads();
+    // Compilation results are looked up in and stored to the cache in this directory, none when empty
+    std::string cacheDirectory;
+    int cacheSizeMegabytes = 256;
+    bool cacheStats = false;
+    // Functions that did not change since the last compilation are read back from this state file, none when empty
+    std::string incrementalFile;
+    bool incrementalStats = false;
+
+    static int defaultThreads() {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    static void printUsage(std::ostream &os) {
+        os << "usage: hw5 [options] < program" << std::endl
+           << "  --no-peephole                 do not run the peephole pass" << std::endl
+           << "  --peephole-disable=r1,r2,...  disable single peephole rewrites" << std::endl
+           << "  --peephole-stats              print the number of applied peephole rewrites to stderr" << std::endl
+           << "  --no-cfg-simplify             do not simplify the control flow graph" << std::endl
+           << "  --cfg-stats                   print the number of control flow simplifications to stderr" << std::endl
+           << "  --no-select                   keep branches for conditional assignments" << std::endl
+           << "  --no-unroll                   do not unroll loops" << std::endl
+           << "  --unroll-budget=n             size limit (AST nodes) of an unrolled loop body, default 128" << std::endl
+           << "  --loop-report                 print the analyzed loops and their transformations to stderr" << std::endl
+           << "  --no-licm                     do not hoist loop invariant expressions out of loops" << std::endl
+           << "  --keep-unused-functions       emit every function and runtime helper, also those main never calls" << std::endl
+           << "  --call-graph                  print the call graph, function effects, compile-time calls and clones to stderr" << std::endl
+           << "  --no-function-attributes      do not attach LLVM attributes to functions and calls" << std::endl
+           << "  --eval-budget=n               steps to evaluate a pure call with constant arguments at compile time," << std::endl
+           << "                                default 1000000, 0 keeps every call" << std::endl
+           << "  --division-stats              print the number of runtime division by zero checks to stderr" << std::endl
+           << "  --no-branch-hints             no branch weights on loop latches and error branches, no cold error calls" << std::endl
+           << "  --no-specialize               do not clone functions for calls with constant arguments" << std::endl
+           << "  --specialize-budget=n         total size limit (AST nodes) of the function clones, default 256" << std::endl
+           << "  --memoize                     cache the results of pure recursive functions in tables" << std::endl
+           << "  --run                         execute the program directly instead of generating code" << std::endl
+           << "  --vm                          execute the program in the bytecode virtual machine" << std::endl
+           << "  --bytecode                    print the bytecode of the program instead of LLVM IR" << std::endl
+           << "  --target=t                    output language: llvm (default), x86-64 (GNU assembler, Linux)" << std::endl
+           << "                                c (C99 for the system C compiler) or llvm-bc (LLVM 14 bitcode)" << std::endl
+           << "  --aot                         run main at compile time and emit only its output" << std::endl
+           << "  --aot-budget=n                steps main may run at compile time before --aot falls back" << std::endl
+           << "                                to normal code generation, default 10000000" << std::endl
+           << "  --threads=n                   threads generating the functions, default one per core" << std::endl
+           << "  --shards=n                    write the module as header.ll and up to n shards (shard0.ll, ...), split" << std::endl
+           << "                                by function size, with a manifest.txt listing them, .bc for llvm-bc" << std::endl
+           << "  --shard-dir=d                 directory of the shards, default shards" << std::endl
+           << "  --cache-dir=d                 reuse the output of earlier compilations of the same program with the" << std::endl
+           << "                                same options, stored in d (not with --run, --vm and --shards)" << std::endl
+           << "  --cache-size=n                size limit of the cache in MiB, the least recently used results are" << std::endl
+           << "                                removed first, default 256" << std::endl
+           << "  --cache-stats                 print the hits, misses and size of the cache to stderr" << std::endl
+           << "  --incremental=f               keep the code of every function in the state file f and reuse it in the" << std::endl
+           << "                                next compilation for the functions that did not change, nor anything" << std::endl
+           << "                                they call (LLVM IR and bitcode only)" << std::endl
+           << "  --incremental-stats           print the reused and recompiled functions to stderr" << std::endl;
+    }
+
+    // Everything that may change what a compilation writes, the threads, the cache and the incremental
+    // state settings do not
+    std::string cacheKey() const {
+        std::ostringstream key;
+        key << peephole << cfgSimplify << peepholeStats << cfgStats << selectConditionalAssign << unroll << loopReport
+            << hoistInvariants << removeUnusedFunctions << callGraphReport << functionAttributes << divisionStats
+            << branchHints << specialize << memoize << aheadOfTime << bytecodeListing
+            << " unroll-budget=" << unrollBudget << " eval-budget=" << evaluationBudget
+            << " specialize-budget=" << specializeBudget << " aot-budget=" << aheadOfTimeBudget
+            << " target=" << target << " peephole-disable=";
+        for (const std::string &rule : disabledPeepholeRules) {
+            key << rule << ",";
+        }
+        return key.str();
+    }
+
+    bool isCacheable() const {
+        return !cacheDirectory.empty() && !run && !virtualMachine && 0 == shards;
+    }
+
+    static std::set<std::string> splitList(const std::string &list) {
+        std::set<std::string> items;
+        std::stringstream stream(list);
+        std::string item;
+        while (std::getline(stream, item, ',')) {
+            if (!item.empty()) {
+                items.insert(item);
+            }
+        }
+        return items;
+    }
+
+    // The non-negative number after '=' in "--option=n", exits on anything else
+    static int parseCount(const std::string &arg) {
+        const std::string value = arg.substr(arg.find('=') + 1);
+        if (value.empty() || value.size() > 9 || value.find_first_not_of("0123456789") != std::string::npos) {
+            std::cerr << "hw5: invalid number in '" << arg << "'" << std::endl;
+            exit(1);
+        }
+        return std::stoi(value);
+    }
+
+    static CompilerOptions parse(int argc, char *argv[]) {
+        CompilerOptions options;
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            if (arg == "--no-peephole") {
+                options.peephole = false;
+            } else if (arg.rfind("--peephole-disable=", 0) == 0) {
+                std::set<std::string> rules = splitList(arg.substr(arg.find('=') + 1));
+                options.disabledPeepholeRules.insert(rules.begin(), rules.end());
+            } else if (arg == "--peephole-stats") {
+                options.peepholeStats = true;
+            } else if (arg == "--no-cfg-simplify") {
+                options.cfgSimplify = false;
+            } else if (arg == "--cfg-stats") {
+                options.cfgStats = true;
+            } else if (arg == "--no-select") {
+                options.selectConditionalAssign = false;
+            } else if (arg == "--no-unroll") {
+                options.unroll = false;
+            } else if (arg.rfind("--unroll-budget=", 0) == 0) {
+                options.unrollBudget = parseCount(arg);
+            } else if (arg == "--loop-report") {
+                options.loopReport = true;
+            } else if (arg == "--no-licm") {
+                options.hoistInvariants = false;
+            } else if (arg == "--keep-unused-functions") {
+                options.removeUnusedFunctions = false;
+            } else if (arg == "--call-graph") {
+                options.callGraphReport = true;
+            } else if (arg == "--no-function-attributes") {
+                options.functionAttributes = false;
+            } else if (arg == "--division-stats") {
+                options.divisionStats = true;
+            } else if (arg == "--no-branch-hints") {
+                options.branchHints = false;
+            } else if (arg == "--no-specialize") {
+                options.specialize = false;
+            } else if (arg.rfind("--specialize-budget=", 0) == 0) {
+                options.specializeBudget = parseCount(arg);
+            } else if (arg == "--memoize") {
+                options.memoize = true;
+            } else if (arg == "--run") {
+                options.run = true;
+            } else if (arg == "--vm") {
+                options.virtualMachine = true;
+            } else if (arg == "--bytecode") {
+                options.bytecodeListing = true;
+            } else if (arg.rfind("--target=", 0) == 0) {
+                options.target = arg.substr(arg.find('=') + 1);
+                if (options.target != "llvm" && options.target != "x86-64" && options.target != "c"
+                    && options.target != "llvm-bc") {
+                    std::cerr << "hw5: unknown target '" << options.target << "'" << std::endl;
+                    exit(1);
+                }
+            } else if (arg == "--aot") {
+                options.aheadOfTime = true;
+            } else if (arg.rfind("--aot-budget=", 0) == 0) {
+                options.aheadOfTimeBudget = parseCount(arg);
+            } else if (arg.rfind("--shards=", 0) == 0) {
+                options.shards = parseCount(arg);
+            } else if (arg.rfind("--shard-dir=", 0) == 0) {
+                options.shardDirectory = arg.substr(arg.find('=') + 1);
+            } else if (arg.rfind("--cache-dir=", 0) == 0) {
+                options.cacheDirectory = arg.substr(arg.find('=') + 1);
+            } else if (arg.rfind("--cache-size=", 0) == 0) {
+                options.cacheSizeMegabytes = parseCount(arg);
+            } else if (arg == "--cache-stats") {
+                options.cacheStats = true;
+            } else if (arg.rfind("--incremental=", 0) == 0) {
+                options.incrementalFile = arg.substr(arg.find('=') + 1);
+            } else if (arg == "--incremental-stats") {
+                options.incrementalStats = true;
+            } else if (arg.rfind("--threads=", 0) == 0) {
+                options.threads = std::max(1, parseCount(arg));
+            } else if (arg.rfind("--eval-budget=", 0) == 0) {
+                options.evaluationBudget = parseCount(arg);
+            } else if (arg == "--help" || arg == "-h") {
+                printUsage(std::cout);
+                exit(0);
+            } else {
+                std::cerr << "hw5: unknown option '" << arg << "'" << std::endl;
+                printUsage(std::cerr);
+                exit(1);
+            }
+        }
+        return options;
+    }
+};
+
+#endif // COMPILER_OPTIONS_HPP
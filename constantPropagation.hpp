@@ -0,0 +1,432 @@
+#ifndef CONSTANT_PROPAGATION_HPP
+#define CONSTANT_PROPAGATION_HPP
+
+#include "visitor.hpp"
+#include "nodes.hpp"
+#include "interpreter.hpp"
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <memory>
+#include <cstdint>
+
+using namespace std;
+using namespace ast;
+
+/* ConstantValue struct
+ * Lattice element of the constant propagation. A variable is undefined before any path reaches it,
+ * constant while every path agrees on its value and overdefined once two paths disagree.
+ */
+struct ConstantValue {
+    enum Kind { UNDEFINED, CONSTANT, OVERDEFINED };
+    Kind kind = UNDEFINED;
+    int32_t value = 0;
+
+    static ConstantValue constant(int32_t value) {
+        ConstantValue result;
+        result.kind = CONSTANT;
+        result.value = value;
+        return result;
+    }
+
+    static ConstantValue overdefined() {
+        ConstantValue result;
+        result.kind = OVERDEFINED;
+        return result;
+    }
+
+    bool isConstant() const { return CONSTANT == kind; }
+
+    bool operator==(const ConstantValue& other) const {
+        return kind == other.kind && (CONSTANT != kind || value == other.value);
+    }
+
+    bool operator!=(const ConstantValue& other) const { return !(*this == other); }
+
+    // The value at a join of two paths
+    ConstantValue meet(const ConstantValue& other) const {
+        if (UNDEFINED == kind) {
+            return other;
+        }
+        if (UNDEFINED == other.kind || *this == other) {
+            return *this;
+        }
+        return overdefined();
+    }
+};
+
+/* ConstantState struct
+ * The values of the variables at one point of a function. An unreachable state takes no part in joins.
+ */
+struct ConstantState {
+    bool isReachable = false;
+    map<string, ConstantValue> variables;
+
+    bool operator==(const ConstantState& other) const {
+        return isReachable == other.isReachable && variables == other.variables;
+    }
+
+    bool operator!=(const ConstantState& other) const { return !(*this == other); }
+
+    ConstantValue valueOf(const string& name) const {
+        if (!isReachable) {
+            return ConstantValue();
+        }
+        auto variable = variables.find(name);
+        // A variable declared on one side of a join only is out of scope after it
+        return (variable == variables.end()) ? ConstantValue::overdefined() : variable->second;
+    }
+
+    ConstantState meet(const ConstantState& other) const {
+        if (!isReachable) {
+            return other;
+        }
+        if (!other.isReachable) {
+            return *this;
+        }
+        ConstantState result;
+        result.isReachable = true;
+        for (const auto& variable : variables) {
+            result.variables[variable.first] = variable.second.meet(other.valueOf(variable.first));
+        }
+        for (const auto& variable : other.variables) {
+            if (!variables.count(variable.first)) {
+                result.variables[variable.first] = ConstantValue::overdefined();
+            }
+        }
+        return result;
+    }
+};
+
+/* ConstantPropagation class
+ * Sparse conditional constant propagation over the structured control flow of one function.
+ * Branch conditions with a constant value mark the other edge unreachable, so values from dead paths
+ * never reach a join. Loops are iterated until the state at the loop header does not change.
+ * The results are kept per expression node (the join of all the states it is evaluated in),
+ * per statement (reached or not) and per loop (the state before the loop is entered).
+ * Calls of pure functions with constant arguments are constant when the call evaluator can run them.
+ */
+class ConstantPropagation : public Visitor {
+private:
+    ConstantState state;
+    // Value of the last visited expression
+    ConstantValue result;
+
+    // States at the break and continue statements of the loops being analyzed
+    struct LoopExits {
+        ConstantState breaks;
+        ConstantState continues;
+    };
+    vector<LoopExits> loops;
+
+    unordered_map<const Exp*, ConstantValue> values;
+    set<const Statement*> reachedStatements;
+    unordered_map<const While*, ConstantState> loopEntries;
+    unordered_map<const While*, ConstantValue> entryConditions;
+    PureCallEvaluator* calls = nullptr;
+    // Parameters of a specialized function with a constant value
+    map<string, int32_t> boundParameters;
+
+    ConstantValue evaluate(const shared_ptr<Exp>& exp) {
+        exp->accept(*this);
+        return result;
+    }
+
+    // Every evaluation is recorded, so the recorded value holds in all the states the expression is evaluated in
+    void record(const Exp& exp, const ConstantValue& value) {
+        result = state.isReachable ? value : ConstantValue();
+        ConstantValue& recorded = values[&exp];
+        recorded = recorded.meet(result);
+    }
+
+    static ConstantValue fromBool(bool value) {
+        return ConstantValue::constant(value ? 1 : 0);
+    }
+
+public:
+    // The i32 result of a binary operation, false if it cannot be computed at compile time
+    // (division by zero exits the program, INT_MIN / -1 is undefined in LLVM)
+    static bool fold(BinOpType op, int32_t left, int32_t right, int32_t& value) {
+        switch (op) {
+            case BinOpType::ADD:
+                value = static_cast<int32_t>(static_cast<uint32_t>(left) + static_cast<uint32_t>(right));
+                return true;
+            case BinOpType::SUB:
+                value = static_cast<int32_t>(static_cast<uint32_t>(left) - static_cast<uint32_t>(right));
+                return true;
+            case BinOpType::MUL:
+                value = static_cast<int32_t>(static_cast<uint32_t>(left) * static_cast<uint32_t>(right));
+                return true;
+            case BinOpType::DIV:
+                if (0 == right || (INT32_MIN == left && -1 == right)) {
+                    return false;
+                }
+                value = left / right;
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    void setCallEvaluator(PureCallEvaluator* evaluator) {
+        calls = evaluator;
+    }
+
+    void analyze(FuncDecl& function, const map<string, int32_t>& boundParameters = {}) {
+        this->boundParameters = boundParameters;
+        values.clear();
+        reachedStatements.clear();
+        loopEntries.clear();
+        entryConditions.clear();
+        function.accept(*this);
+    }
+
+    // The value of an expression on every path that evaluates it, not constant if no path does
+    ConstantValue valueOf(const Exp& exp) const {
+        auto value = values.find(&exp);
+        return (value == values.end()) ? ConstantValue() : value->second;
+    }
+
+    bool isReached(const Statement& statement) const {
+        return reachedStatements.count(&statement) > 0;
+    }
+
+    // The value of a variable when the loop is entered, before its condition is tested the first time
+    ConstantValue entryValueOf(const While& loop, const string& name) const {
+        auto entry = loopEntries.find(&loop);
+        return (entry == loopEntries.end()) ? ConstantValue() : entry->second.valueOf(name);
+    }
+
+    // The value of the loop condition when the loop is entered
+    ConstantValue entryConditionOf(const While& loop) const {
+        auto condition = entryConditions.find(&loop);
+        return (condition == entryConditions.end()) ? ConstantValue() : condition->second;
+    }
+
+    void visit(Num& node) override { record(node, ConstantValue::constant(node.getValueInt())); }
+    void visit(NumB& node) override { record(node, ConstantValue::constant(node.getValueInt() & 255)); }
+    void visit(String& node) override { record(node, ConstantValue::overdefined()); }
+    void visit(Bool& node) override { record(node, fromBool(node.getValueBool())); }
+    void visit(ID& node) override { record(node, state.valueOf(node.getValueStr())); }
+    void visit(Type& node) override {}
+
+    void visit(BinOp& node) override {
+        const ConstantValue left = evaluate(node.getLeft());
+        const ConstantValue right = evaluate(node.getRight());
+        ConstantValue value = ConstantValue::overdefined();
+        int32_t folded = 0;
+        if (left.isConstant() && right.isConstant() && fold(node.getOp(), left.value, right.value, folded)) {
+            value = ConstantValue::constant((BYTE == node.resultType) ? (folded & 255) : folded);
+        } else if (node.getOp() == BinOpType::MUL && ((left.isConstant() && 0 == left.value) || (right.isConstant() && 0 == right.value))) {
+            value = ConstantValue::constant(0);
+        }
+        record(node, value);
+    }
+
+    void visit(RelOp& node) override {
+        const ConstantValue left = evaluate(node.getLeft());
+        const ConstantValue right = evaluate(node.getRight());
+        ConstantValue value = ConstantValue::overdefined();
+        if (left.isConstant() && right.isConstant()) {
+            switch (node.getOp()) {
+                case RelOpType::EQ: value = fromBool(left.value == right.value); break;
+                case RelOpType::NE: value = fromBool(left.value != right.value); break;
+                case RelOpType::LT: value = fromBool(left.value < right.value); break;
+                case RelOpType::GT: value = fromBool(left.value > right.value); break;
+                case RelOpType::LE: value = fromBool(left.value <= right.value); break;
+                case RelOpType::GE: value = fromBool(left.value >= right.value); break;
+                default: break;
+            }
+        }
+        record(node, value);
+    }
+
+    void visit(Not& node) override {
+        const ConstantValue operand = evaluate(node.getExpr());
+        record(node, operand.isConstant() ? fromBool(0 == operand.value) : ConstantValue::overdefined());
+    }
+
+    // A constant left operand may decide and/or on its own, the right operand is then never evaluated
+    void visit(And& node) override {
+        const ConstantValue left = evaluate(node.getLeft());
+        const ConstantValue right = evaluate(node.getRight());
+        ConstantValue value = ConstantValue::overdefined();
+        if (left.isConstant() && (0 == left.value || right.isConstant())) {
+            value = fromBool(0 != left.value && 0 != right.value);
+        }
+        record(node, value);
+    }
+
+    void visit(Or& node) override {
+        const ConstantValue left = evaluate(node.getLeft());
+        const ConstantValue right = evaluate(node.getRight());
+        ConstantValue value = ConstantValue::overdefined();
+        if (left.isConstant() && (0 != left.value || right.isConstant())) {
+            value = fromBool(0 != left.value || 0 != right.value);
+        }
+        record(node, value);
+    }
+
+    void visit(Cast& node) override {
+        const ConstantValue operand = evaluate(node.getExpr());
+        ConstantValue value = operand.isConstant() ? operand : ConstantValue::overdefined();
+        if (value.isConstant() && BYTE == node.getTargetType()) {
+            value.value &= 255;
+        }
+        record(node, value);
+    }
+
+    void visit(ExpList& node) override {
+        for (auto& exp : node.getExpressions()) {
+            exp->accept(*this);
+        }
+    }
+
+    // Functions cannot write the variables of their caller, only the returned value is unknown
+    // unless a pure function is called with constant arguments
+    void visit(Call& node) override {
+        vector<int32_t> arguments;
+        bool isConstant = true;
+        for (auto& argument : node.getArgs()) {
+            const ConstantValue value = evaluate(argument);
+            isConstant &= value.isConstant();
+            arguments.push_back(value.value);
+        }
+        int32_t returned = 0;
+        if (isConstant && state.isReachable && calls && calls->evaluate(node.getFuncId(), arguments, returned)) {
+            record(node, ConstantValue::constant(returned));
+        } else {
+            record(node, ConstantValue::overdefined());
+        }
+    }
+
+    void visit(Statements& node) override {
+        for (auto& statement : node.getStatements()) {
+            if (state.isReachable) {
+                reachedStatements.insert(statement.get());
+            }
+            statement->accept(*this);
+        }
+    }
+
+    void visit(Break& node) override {
+        if (!loops.empty()) {
+            loops.back().breaks = loops.back().breaks.meet(state);
+        }
+        state.isReachable = false;
+    }
+
+    void visit(Continue& node) override {
+        if (!loops.empty()) {
+            loops.back().continues = loops.back().continues.meet(state);
+        }
+        state.isReachable = false;
+    }
+
+    void visit(Return& node) override {
+        if (node.getExpr()) {
+            node.getExpr()->accept(*this);
+        }
+        state.isReachable = false;
+    }
+
+    void visit(If& node) override {
+        const ConstantValue condition = evaluate(node.getCondition());
+        const ConstantState before = state;
+
+        if (condition.isConstant() && 0 == condition.value) {
+            state.isReachable = false;
+        }
+        node.getThen()->accept(*this);
+        const ConstantState afterThen = state;
+
+        state = before;
+        if (condition.isConstant() && 0 != condition.value) {
+            state.isReachable = false;
+        }
+        if (node.getElse()) {
+            node.getElse()->accept(*this);
+        }
+        state = state.meet(afterThen);
+    }
+
+    void visit(While& node) override {
+        const ConstantState entry = state;
+        loopEntries[&node] = loopEntries[&node].meet(entry);
+        ConstantValue& entryCondition = entryConditions[&node];
+        entryCondition = entryCondition.meet(evaluate(node.getCondition()));
+
+        // The header joins the entry with the back edges until the join does not change any more
+        ConstantState header = entry;
+        while (true) {
+            state = header;
+            const ConstantValue condition = evaluate(node.getCondition());
+            ConstantState exit = header;
+            if (condition.isConstant() && 0 != condition.value) {
+                exit.isReachable = false;
+            }
+            if (condition.isConstant() && 0 == condition.value) {
+                state.isReachable = false;
+            }
+
+            loops.push_back(LoopExits());
+            node.getBody()->accept(*this);
+            const LoopExits exits = loops.back();
+            loops.pop_back();
+
+            const ConstantState latch = state.meet(exits.continues);
+            const ConstantState next = entry.meet(latch);
+            if (next == header) {
+                state = exit.meet(exits.breaks);
+                return;
+            }
+            header = next;
+        }
+    }
+
+    void visit(VarDecl& node) override {
+        ConstantValue value = ConstantValue::constant(0);
+        if (node.getVarInitExp()) {
+            value = evaluate(node.getVarInitExp());
+        }
+        if (state.isReachable) {
+            state.variables[node.getValueStr()] = value;
+        }
+    }
+
+    void visit(Assign& node) override {
+        const ConstantValue value = evaluate(node.getAssignExp());
+        if (state.isReachable) {
+            state.variables[node.getValueStr()] = value;
+        }
+    }
+
+    void visit(Formal& node) override {
+        auto bound = boundParameters.find(node.getFormalId());
+        state.variables[node.getFormalId()] = (bound == boundParameters.end()) ? ConstantValue::overdefined() : ConstantValue::constant(bound->second);
+    }
+
+    void visit(Formals& node) override {
+        for (auto& formal : node.getFormals()) {
+            formal->accept(*this);
+        }
+    }
+
+    void visit(FuncDecl& node) override {
+        loops.clear();
+        state = ConstantState();
+        state.isReachable = true;
+        node.getFuncParams()->accept(*this);
+        node.getFuncBody()->accept(*this);
+    }
+
+    void visit(Funcs& node) override {
+        for (auto& function : node.getFuncs()) {
+            function->accept(*this);
+        }
+    }
+};
+
+#endif // CONSTANT_PROPAGATION_HPP
@@ -0,0 +1,116 @@
+#ifndef FUNCTION_EFFECTS_HPP
+#define FUNCTION_EFFECTS_HPP
+
+#include "nodes.hpp"
+#include "loopAnalyzer.hpp"
+#include "callGraph.hpp"
+#include <string>
+#include <map>
+#include <set>
+#include <iostream>
+
+using namespace std;
+using namespace ast;
+
+/* FunctionEffects class
+ * Interprocedural classification of the functions of the program:
+ *  - pure: prints nothing and never exits, neither directly nor through a callee. Variables are local
+ *    and arguments are passed by value, so a pure call depends on its arguments only (LLVM readnone).
+ *  - always returning: no loop, no recursion and only always returning callees (LLVM willreturn).
+ * A division by anything but a nonzero literal may print the division error and exit, so it counts as both.
+ * The language has no exceptions, so no generated function unwinds (LLVM nounwind).
+ */
+class FunctionEffects {
+private:
+    set<string> pureFunctions;
+    set<string> returningFunctions;
+    // Built-ins that return to their caller; print and printi write output, so neither is pure
+    const set<string> returningBuiltIns{"print", "printi"};
+
+public:
+    void analyze(const Funcs& program, const CallGraph& callGraph) {
+        map<string, LoopBodyScanner> scanners;
+        for (const shared_ptr<FuncDecl>& function : program.getFuncs()) {
+            function->getFuncBody()->accept(scanners[function->getFuncId()]);
+        }
+
+        // Pure until shown otherwise, so pure functions calling each other recursively stay pure
+        pureFunctions.clear();
+        for (const auto& scanner : scanners) {
+            if (!scanner.second.hasUncheckedDivision) {
+                pureFunctions.insert(scanner.first);
+            }
+        }
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (auto it = pureFunctions.begin(); it != pureFunctions.end();) {
+                bool callsImpure = false;
+                for (const string& callee : callGraph.calleesOf(*it)) {
+                    callsImpure |= !pureFunctions.count(callee);
+                }
+                if (callsImpure) {
+                    it = pureFunctions.erase(it);
+                    changed = true;
+                } else {
+                    ++it;
+                }
+            }
+        }
+
+        // Not returning until shown otherwise, so recursive functions never qualify
+        returningFunctions = returningBuiltIns;
+        changed = true;
+        while (changed) {
+            changed = false;
+            for (const auto& scanner : scanners) {
+                if (returningFunctions.count(scanner.first) || scanner.second.hasLoop || scanner.second.hasUncheckedDivision) {
+                    continue;
+                }
+                bool callsAllReturn = true;
+                for (const string& callee : callGraph.calleesOf(scanner.first)) {
+                    callsAllReturn &= returningFunctions.count(callee) > 0;
+                }
+                if (callsAllReturn) {
+                    returningFunctions.insert(scanner.first);
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    bool isPure(const string& function) const {
+        return pureFunctions.count(function) > 0;
+    }
+
+    const set<string>& getPureFunctions() const {
+        return pureFunctions;
+    }
+
+    bool isAlwaysReturning(const string& function) const {
+        return returningFunctions.count(function) > 0;
+    }
+
+    // Function attributes of a generated function, for its definition and its call sites.
+    // A pure function that accesses memory the program cannot see (memo tables) is not readnone.
+    string attributesOf(const string& function, bool accessesMemory = false) const {
+        string attributes = "nounwind";
+        if (isPure(function) && !accessesMemory) {
+            attributes += " readnone";
+        }
+        if (isAlwaysReturning(function)) {
+            attributes += " willreturn";
+        }
+        return attributes;
+    }
+
+    void printReport(ostream& os, const CallGraph& callGraph) const {
+        os << "function effects:" << endl;
+        for (const string& function : callGraph.definedFunctions()) {
+            os << "  " << function << ": " << (isPure(function) ? "pure" : "has effects")
+               << ", " << (isAlwaysReturning(function) ? "always returns" : "may not return") << endl;
+        }
+    }
+};
+
+#endif // FUNCTION_EFFECTS_HPP
@@ -0,0 +1,260 @@
+#ifndef FUNCTION_FINGERPRINT_HPP
+#define FUNCTION_FINGERPRINT_HPP
+
+#include "nodes.hpp"
+#include "visitor.hpp"
+#include "callGraph.hpp"
+#include "functionEffects.hpp"
+#include "memoization.hpp"
+#include "compilationCache.hpp"
+#include <string>
+#include <sstream>
+#include <map>
+#include <set>
+
+using namespace std;
+using namespace ast;
+
+/* FunctionFingerprint class
+ * The tokens of a function declaration as a canonical text: its signature and body without line numbers,
+ * layout or comments. The fingerprint of a function is the digest of its tokens and of what its code
+ * takes from the functions it calls: their signatures and effects, whether they are recursive or
+ * memoized, and for pure functions, whose calls with constant arguments are evaluated at compile time,
+ * their tokens and those of everything they call. A function whose fingerprint did not change generates
+ * the same code, a change to the body of a function with effects does not reach its callers.
+ */
+class FunctionFingerprint : public Visitor {
+private:
+    ostringstream tokens;
+
+    void child(const shared_ptr<Node>& node) {
+        if (node) {
+            node->accept(*this);
+        } else {
+            tokens << "- ";
+        }
+    }
+
+    // The digests of the functions with those of everything they call. The functions of a strongly
+    // connected component share the digest of their tokens and of the components they call.
+    static map<string, string> closureDigests(const map<string, string>& ownDigests, const CallGraph& callGraph) {
+        map<string, string> digests;
+        for (const vector<string>& component : callGraph.stronglyConnectedComponents()) {
+            set<string> members;
+            set<string> calledComponents;
+            for (const string& function : component) {
+                members.insert(ownDigests.at(function));
+                for (const string& callee : callGraph.calleesOf(function)) {
+                    auto called = digests.find(callee);
+                    if (called != digests.end()) {
+                        calledComponents.insert(called->second);
+                    }
+                }
+            }
+            string text;
+            for (const string& digest : members) {
+                text += digest + " ";
+            }
+            text += "calls ";
+            for (const string& digest : calledComponents) {
+                text += digest + " ";
+            }
+            const string componentDigest = Sha256::digest(text);
+            for (const string& function : component) {
+                digests[function] = componentDigest;
+            }
+        }
+        return digests;
+    }
+
+public:
+    static string tokensOf(FuncDecl& function) {
+        FunctionFingerprint fingerprint;
+        function.accept(fingerprint);
+        return fingerprint.tokens.str();
+    }
+
+    // The fingerprints of the defined functions by name
+    static map<string, string> of(const Funcs& program, const CallGraph& callGraph, const FunctionEffects& effects,
+                                  const Memoization& memoization) {
+        map<string, string> ownDigests;
+        map<string, string> interfaces;
+        for (const shared_ptr<FuncDecl>& function : program.getFuncs()) {
+            ownDigests[function->getFuncId()] = Sha256::digest(tokensOf(*function));
+        }
+        const map<string, string> closures = closureDigests(ownDigests, callGraph);
+        // What a caller sees of a function
+        for (const shared_ptr<FuncDecl>& function : program.getFuncs()) {
+            const string name = function->getFuncId();
+            FunctionFingerprint signature;
+            signature.tokens << "function " << function->getFuncReturnType() << " " << name << " ";
+            function->getFuncParams()->accept(signature);
+            signature.tokens << effects.isPure(name) << effects.isAlwaysReturning(name) << callGraph.isRecursive(name)
+                             << memoization.isMemoized(name) << memoization.usesTables(name) << " ";
+            if (effects.isPure(name)) {
+                signature.tokens << closures.at(name);
+            }
+            interfaces[name] = signature.tokens.str();
+        }
+        map<string, string> fingerprints;
+        for (const shared_ptr<FuncDecl>& function : program.getFuncs()) {
+            const string name = function->getFuncId();
+            string text = ownDigests[name] + " " + interfaces[name];
+            for (const string& callee : callGraph.calleesOf(name)) {
+                auto interface = interfaces.find(callee);
+                if (interface != interfaces.end()) {
+                    text += " calls " + interface->second;
+                }
+            }
+            fingerprints[name] = Sha256::digest(text);
+        }
+        return fingerprints;
+    }
+
+    void visit(Num& node) override {
+        tokens << "num " << node.getValueInt() << " ";
+    }
+
+    void visit(NumB& node) override {
+        tokens << "numb " << node.getValueInt() << " ";
+    }
+
+    void visit(String& node) override {
+        tokens << "string " << node.getValueStr().size() << ":" << node.getValueStr() << " ";
+    }
+
+    void visit(Bool& node) override {
+        tokens << (node.getValueBool() ? "true " : "false ");
+    }
+
+    void visit(ID& node) override {
+        tokens << "id " << node.getValueStr() << " ";
+    }
+
+    void visit(BinOp& node) override {
+        tokens << "binop " << node.getOp() << " ( ";
+        child(node.getLeft());
+        child(node.getRight());
+        tokens << ") ";
+    }
+
+    void visit(RelOp& node) override {
+        tokens << "relop " << node.getOp() << " ( ";
+        child(node.getLeft());
+        child(node.getRight());
+        tokens << ") ";
+    }
+
+    void visit(Not& node) override {
+        tokens << "not ( ";
+        child(node.getExpr());
+        tokens << ") ";
+    }
+
+    void visit(And& node) override {
+        tokens << "and ( ";
+        child(node.getLeft());
+        child(node.getRight());
+        tokens << ") ";
+    }
+
+    void visit(Or& node) override {
+        tokens << "or ( ";
+        child(node.getLeft());
+        child(node.getRight());
+        tokens << ") ";
+    }
+
+    void visit(Type& node) override {
+        tokens << "type " << node.getTypeOfType() << " ";
+    }
+
+    void visit(Cast& node) override {
+        tokens << "cast " << node.getTargetType() << " ( ";
+        child(node.getExpr());
+        tokens << ") ";
+    }
+
+    void visit(ExpList& node) override {
+        tokens << "( ";
+        for (const shared_ptr<Exp>& expression : node.getExpressions()) {
+            child(expression);
+        }
+        tokens << ") ";
+    }
+
+    void visit(Call& node) override {
+        tokens << "call " << node.getFuncId() << " ";
+        child(node.getArgsExp());
+    }
+
+    void visit(Statements& node) override {
+        tokens << "{ ";
+        for (const shared_ptr<Statement>& statement : node.getStatements()) {
+            child(statement);
+        }
+        tokens << "} ";
+    }
+
+    void visit(Break& node) override {
+        tokens << "break ";
+    }
+
+    void visit(Continue& node) override {
+        tokens << "continue ";
+    }
+
+    void visit(Return& node) override {
+        tokens << "return ";
+        child(node.getExpr());
+    }
+
+    void visit(If& node) override {
+        tokens << "if ";
+        child(node.getCondition());
+        child(node.getThen());
+        child(node.getElse());
+    }
+
+    void visit(While& node) override {
+        tokens << "while ";
+        child(node.getCondition());
+        child(node.getBody());
+    }
+
+    void visit(VarDecl& node) override {
+        tokens << "var " << node.getVarType() << " " << node.getValueStr() << " ";
+        child(node.getVarInitExp());
+    }
+
+    void visit(Assign& node) override {
+        tokens << "assign " << node.getValueStr() << " ";
+        child(node.getAssignExp());
+    }
+
+    void visit(Formal& node) override {
+        tokens << "formal " << node.getFormalType() << " " << node.getFormalId() << " ";
+    }
+
+    void visit(Formals& node) override {
+        tokens << "( ";
+        for (const shared_ptr<Formal>& formal : node.getFormals()) {
+            child(formal);
+        }
+        tokens << ") ";
+    }
+
+    void visit(FuncDecl& node) override {
+        tokens << "function " << node.getFuncReturnType() << " " << node.getFuncId() << " ";
+        child(node.getFuncParams());
+        child(node.getFuncBody());
+    }
+
+    void visit(Funcs& node) override {
+        for (const shared_ptr<FuncDecl>& function : node.getFuncs()) {
+            child(function);
+        }
+    }
+};
+
+#endif // FUNCTION_FINGERPRINT_HPP
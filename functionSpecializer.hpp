@@ -0,0 +1,165 @@
+#ifndef FUNCTION_SPECIALIZER_HPP
+#define FUNCTION_SPECIALIZER_HPP
+
+#include "nodes.hpp"
+#include "loopAnalyzer.hpp"
+#include "callGraph.hpp"
+#include "memoization.hpp"
+#include "constantPropagation.hpp"
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <set>
+#include <iostream>
+
+using namespace std;
+using namespace ast;
+
+/* Specialization struct
+ * A clone of a function with some of its parameters bound to constants. The clone takes the
+ * remaining parameters only.
+ */
+struct Specialization {
+    string name;
+    const FuncDecl* function = nullptr;
+    // Bound parameter names and their values
+    map<string, int32_t> boundParameters;
+    // Positions of the call arguments the clone still takes
+    vector<size_t> keptArguments;
+};
+
+/* FunctionSpecializer class
+ * Decides which calls with constant arguments are redirected to a clone of the callee with those
+ * parameters bound. The clones are generated with the bound parameters known to the constant propagation,
+ * so their bodies fold like code with literals. Small functions are cloned for any call site, larger ones
+ * only for call sites inside loops. Recursive and memoized functions keep their single version, and the
+ * total size of the clones (AST nodes of the cloned bodies) is capped by a budget.
+ */
+class FunctionSpecializer {
+private:
+    map<string, const FuncDecl*> functions;
+    map<string, int> sizes;
+    set<string> excluded;
+    int budget = 0;
+    int usedBudget = 0;
+
+    // Clone per function and bound arguments (position and value)
+    map<pair<string, vector<pair<size_t, int32_t>>>, Specialization> clones;
+    vector<Specialization> created;
+    deque<Specialization> pending;
+
+public:
+    static const int SMALL_FUNCTION_SIZE = 32;
+    static const int HOT_FUNCTION_SIZE = 128;
+
+    void setProgram(const Funcs& program, const CallGraph& callGraph, const Memoization& memoization, int budget) {
+        this->budget = budget;
+        usedBudget = 0;
+        functions.clear();
+        sizes.clear();
+        excluded.clear();
+        clones.clear();
+        created.clear();
+        pending.clear();
+        for (const shared_ptr<FuncDecl>& function : program.getFuncs()) {
+            const string name = function->getFuncId();
+            LoopBodyScanner scanner;
+            function->getFuncBody()->accept(scanner);
+            functions[name] = function.get();
+            sizes[name] = scanner.nodeCount;
+            if ("main" == name || callGraph.isRecursive(name) || memoization.isMemoized(name)) {
+                excluded.insert(name);
+            }
+        }
+    }
+
+    // Whether specialize may redirect a call with these arguments. The decision itself depends on the
+    // clones and the budget used by the calls decided before.
+    bool isCandidate(const string& function, const vector<ConstantValue>& arguments) const {
+        if (!functions.count(function) || excluded.count(function)) {
+            return false;
+        }
+        for (const ConstantValue& argument : arguments) {
+            if (argument.isConstant()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // The clone a call is redirected to, false if the call stays a call of the function itself
+    bool specialize(const string& function, const vector<ConstantValue>& arguments, bool isInLoop, Specialization& clone) {
+        auto declaration = functions.find(function);
+        if (declaration == functions.end() || excluded.count(function)) {
+            return false;
+        }
+        vector<pair<size_t, int32_t>> bound;
+        for (size_t i = 0; i < arguments.size(); ++i) {
+            if (arguments[i].isConstant()) {
+                bound.push_back({i, arguments[i].value});
+            }
+        }
+        if (bound.empty()) {
+            return false;
+        }
+
+        auto existing = clones.find({function, bound});
+        if (existing != clones.end()) {
+            clone = existing->second;
+            return true;
+        }
+        const int size = sizes[function];
+        if (size > (isInLoop ? HOT_FUNCTION_SIZE : SMALL_FUNCTION_SIZE) || usedBudget + size > budget) {
+            return false;
+        }
+        usedBudget += size;
+
+        clone = Specialization();
+        clone.name = function + ".spec" + to_string(created.size());
+        clone.function = declaration->second;
+        const vector<string> formals = clone.function->getFuncParams()->getFormalsIds();
+        size_t next = 0;
+        for (size_t i = 0; i < formals.size(); ++i) {
+            if (next < bound.size() && bound[next].first == i) {
+                clone.boundParameters[formals[i]] = bound[next++].second;
+            } else {
+                clone.keptArguments.push_back(i);
+            }
+        }
+        clones[{function, bound}] = clone;
+        created.push_back(clone);
+        pending.push_back(clone);
+        return true;
+    }
+
+    // Clones requested but not generated yet
+    bool hasPending() const {
+        return !pending.empty();
+    }
+
+    Specialization takePending() {
+        Specialization clone = pending.front();
+        pending.pop_front();
+        return clone;
+    }
+
+    void printReport(ostream& os) const {
+        os << "specialized functions (" << usedBudget << "/" << budget << " nodes):" << endl;
+        for (const Specialization& clone : created) {
+            os << "  " << clone.name << " = " << clone.function->getFuncId() << "(";
+            bool first = true;
+            for (const string& formal : clone.function->getFuncParams()->getFormalsIds()) {
+                auto bound = clone.boundParameters.find(formal);
+                os << (first ? "" : ", ") << formal;
+                if (bound != clone.boundParameters.end()) {
+                    os << " = " << bound->second;
+                }
+                first = false;
+            }
+            os << ")" << endl;
+        }
+    }
+};
+
+#endif // FUNCTION_SPECIALIZER_HPP
@@ -0,0 +1,120 @@
+#ifndef INCREMENTAL_STATE_HPP
+#define INCREMENTAL_STATE_HPP
+
+#include "output.hpp"
+#include "compilationCache.hpp"
+#include <string>
+#include <map>
+#include <sstream>
+#include <iostream>
+
+using namespace std;
+
+/* IncrementalState class
+ * The code of the functions of the last compilation of a program, kept in a state file between runs.
+ * The generated code of a function is found by the fingerprint of its declaration and the functions it
+ * calls, its optimized code by the text the passes started from, so an edit recompiles the changed
+ * functions and those that depend on them, and every other function is read back. Registers, labels and
+ * strings are numbered within each function, so a function reads back the same wherever it is placed.
+ * The state of another compiler build or other options is discarded, as is a damaged one whose digest does
+ * not match, and the file only keeps the functions of the last compilation.
+ */
+class IncrementalState {
+public:
+    enum Section { GENERATED, OPTIMIZED, SECTIONS };
+
+private:
+    string path;
+    string configuration;
+    // Reports count what the compilation does, they disable the reuse but not the saving
+    bool reuse;
+    map<string, string> saved[SECTIONS];
+    map<string, string> kept[SECTIONS];
+    size_t reused[SECTIONS] = {0, 0};
+    size_t compiled[SECTIONS] = {0, 0};
+
+    static constexpr const char* STATE_HEADER = "hw5-incremental 2";
+
+    // "hw5-incremental 2\n<digest of the rest>\n<configuration><count>\n" and the entries
+    // "<section> <key>\n<text>", a state whose digest does not match was damaged and is discarded
+    void load() {
+        string text;
+        if (!CompilationCache::readFile(path, text)) {
+            return;
+        }
+        istringstream state(text);
+        string line;
+        string digest;
+        string savedConfiguration;
+        size_t count = 0;
+        getline(state, line);
+        getline(state, digest);
+        if (line != STATE_HEADER || !state.good() || digest != Sha256::digest(text.substr(static_cast<size_t>(state.tellg())))
+            || !output::readText(state, savedConfiguration) || savedConfiguration != configuration
+            || !(state >> count)) {
+            return;
+        }
+        map<string, string> entries[SECTIONS];
+        for (size_t entry = 0; entry < count; ++entry) {
+            int section = 0;
+            string key;
+            string code;
+            if (!(state >> section >> key) || state.get() != '\n' || section < 0 || section >= SECTIONS
+                || !output::readText(state, code)) {
+                return;
+            }
+            entries[section][key] = move(code);
+        }
+        for (int section = 0; section < SECTIONS; ++section) {
+            saved[section] = move(entries[section]);
+        }
+    }
+
+public:
+    IncrementalState(const string& path, const string& options, bool reuse)
+        : path(path), configuration(string(HW5_BUILD_ID) + '\0' + options), reuse(reuse) {
+        load();
+    }
+
+    // The key of a function: the build and the options, and the text that decides its code
+    string key(const string& text) const {
+        return Sha256::digest(configuration + '\0' + text);
+    }
+
+    // The code saved under the key by the last compilation, read-only so the threads look up at once
+    const string* find(Section section, const string& key) const {
+        if (!reuse) {
+            return nullptr;
+        }
+        auto entry = saved[section].find(key);
+        return (entry == saved[section].end()) ? nullptr : &entry->second;
+    }
+
+    // Keeps the code of a function of this compilation for the next one
+    void keep(Section section, const string& key, const string& code, bool wasReused) {
+        kept[section][key] = code;
+        (wasReused ? reused : compiled)[section]++;
+    }
+
+    bool save() const {
+        ostringstream state;
+        output::writeText(state, configuration);
+        state << kept[GENERATED].size() + kept[OPTIMIZED].size() << "\n";
+        for (int section = 0; section < SECTIONS; ++section) {
+            for (const auto& entry : kept[section]) {
+                state << section << " " << entry.first << "\n";
+                output::writeText(state, entry.second);
+            }
+        }
+        return CompilationCache::writeAtomically(path, string(STATE_HEADER) + "\n" + Sha256::digest(state.str()) + "\n"
+            + state.str());
+    }
+
+    void printStatistics(ostream& os) const {
+        os << "incremental state " << path << ": " << reused[GENERATED] << " functions reused, "
+           << compiled[GENERATED] << " generated, " << reused[OPTIMIZED] << " optimized functions reused, "
+           << compiled[OPTIMIZED] << " optimized" << endl;
+    }
+};
+
+#endif // INCREMENTAL_STATE_HPP
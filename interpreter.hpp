@@ -0,0 +1,487 @@
+#ifndef INTERPRETER_HPP
+#define INTERPRETER_HPP
+
+#include "visitor.hpp"
+#include "nodes.hpp"
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <memory>
+#include <sstream>
+#include <mutex>
+#include <iostream>
+#include <cstdint>
+#include <pthread.h>
+
+using namespace std;
+using namespace ast;
+
+/* InterpreterStatus enum
+ * How a run of the interpreter ended.
+ */
+enum InterpreterStatus {
+    RUN_FINISHED,       // The called function returned
+    RUN_EXITED,         // A division by zero printed the error and exited the program
+    RUN_OUT_OF_BUDGET,  // The step budget or the call depth limit ran out first
+    RUN_UNDEFINED,      // The program did something the generated code leaves undefined (INT_MIN / -1)
+    RUN_OUT_OF_STACK    // The calls nested deeper than the stack of the running thread allows
+};
+
+/* Interpreter class
+ * Executes functions of an analyzed program directly on the AST, with the semantics of the generated code:
+ * i32 arithmetic wraps, byte results are truncated to 8 bits and a division by zero prints the error and exits.
+ * Every visited node costs one step; a run stops once the step budget or the call depth limit is spent,
+ * so the caller can fall back to generated code for runs that are too long or never end. With an
+ * unlimited budget it runs whole programs (--run), printing exactly what the compiled program prints.
+ * Calls nest on the stack of the running thread, a run also stops before a call would overflow it.
+ */
+class Interpreter : public Visitor {
+private:
+    enum Flow { FLOW_NORMAL, FLOW_BREAK, FLOW_CONTINUE, FLOW_RETURN, FLOW_HALT };
+
+    map<string, const FuncDecl*> functions;
+    ostream& output;
+    int64_t stepBudget;
+    int depthLimit;
+
+    int64_t steps = 0;
+    int depth = 0;
+    // Lowest stack address a call may start at, 0 when the stack of the thread is unknown
+    uintptr_t stackLimit = 0;
+    InterpreterStatus status = RUN_FINISHED;
+    Flow flow = FLOW_NORMAL;
+    // Value of the last evaluated expression, and the text of the last evaluated string
+    int32_t value = 0;
+    string text;
+    // Variables of the running function, one frame per active call (names are unique within a function)
+    vector<map<string, int32_t>> frames;
+
+    bool isHalted() const {
+        return FLOW_HALT == flow;
+    }
+
+    void halt(InterpreterStatus reason) {
+        status = reason;
+        flow = FLOW_HALT;
+    }
+
+    // Charges one step, false once the run has to stop
+    bool step() {
+        if (isHalted()) {
+            return false;
+        }
+        if (++steps > stepBudget) {
+            halt(RUN_OUT_OF_BUDGET);
+            return false;
+        }
+        return true;
+    }
+
+    int32_t evaluate(const shared_ptr<Exp>& exp) {
+        exp->accept(*this);
+        return value;
+    }
+
+    // The lowest address of the stack of this thread, above a reserve for the deepest call and the
+    // library functions it calls, 0 when it cannot be found. Finding the stack of the main thread reads
+    // /proc/self/maps, so it is found once per thread.
+    static uintptr_t threadStackLimit() {
+        static thread_local const uintptr_t limit = findThreadStackLimit();
+        return limit;
+    }
+
+    static uintptr_t findThreadStackLimit() {
+        const uintptr_t STACK_RESERVE = 256 * 1024;
+        pthread_attr_t attributes;
+        if (0 != pthread_getattr_np(pthread_self(), &attributes)) {
+            return 0;
+        }
+        void* lowest = nullptr;
+        size_t size = 0;
+        const bool isKnown = 0 == pthread_attr_getstack(&attributes, &lowest, &size);
+        pthread_attr_destroy(&attributes);
+        if (!isKnown || size <= 2 * STACK_RESERVE) {
+            return 0;
+        }
+        return reinterpret_cast<uintptr_t>(lowest) + STACK_RESERVE;
+    }
+
+    int32_t invoke(const FuncDecl& function, const vector<int32_t>& arguments) {
+        if (depth >= depthLimit) {
+            halt(RUN_OUT_OF_BUDGET);
+            return 0;
+        }
+        // The stack grows down, a call that starts below the limit could overflow it
+        const char top = 0;
+        if (reinterpret_cast<uintptr_t>(&top) < stackLimit) {
+            halt(RUN_OUT_OF_STACK);
+            return 0;
+        }
+        ++depth;
+        frames.emplace_back();
+        const vector<string> formals = function.getFuncParams()->getFormalsIds();
+        for (size_t i = 0; i < formals.size() && i < arguments.size(); ++i) {
+            frames.back()[formals[i]] = arguments[i];
+        }
+        // A function that ends without a return statement returns 0, as the generated code does
+        value = 0;
+        function.getFuncBody()->accept(*this);
+        frames.pop_back();
+        --depth;
+        if (isHalted()) {
+            return 0;
+        }
+        const int32_t returned = (FLOW_RETURN == flow) ? value : 0;
+        flow = FLOW_NORMAL;
+        return returned;
+    }
+
+public:
+    Interpreter(const Funcs& program, ostream& output, int64_t stepBudget, int depthLimit = 1000)
+        : output(output), stepBudget(stepBudget), depthLimit(depthLimit) {
+        for (const shared_ptr<FuncDecl>& function : program.getFuncs()) {
+            functions[function->getFuncId()] = function.get();
+        }
+    }
+
+    // Runs a defined function, its returned value is stored in result when the run finishes
+    InterpreterStatus run(const string& function, const vector<int32_t>& arguments, int32_t& result) {
+        steps = 0;
+        depth = 0;
+        status = RUN_FINISHED;
+        flow = FLOW_NORMAL;
+        frames.clear();
+        stackLimit = threadStackLimit();
+        auto called = functions.find(function);
+        if (called == functions.end()) {
+            return RUN_UNDEFINED;
+        }
+        const int32_t returned = invoke(*called->second, arguments);
+        if (!isHalted()) {
+            result = returned;
+        }
+        return status;
+    }
+
+    int64_t getSteps() const {
+        return steps;
+    }
+
+    void visit(Num& node) override {
+        if (step()) {
+            value = node.getValueInt();
+        }
+    }
+
+    void visit(NumB& node) override {
+        if (step()) {
+            value = node.getValueInt() & 255;
+        }
+    }
+
+    void visit(String& node) override {
+        if (step()) {
+            text = node.getValueStr();
+        }
+    }
+
+    void visit(Bool& node) override {
+        if (step()) {
+            value = node.getValueBool() ? 1 : 0;
+        }
+    }
+
+    void visit(ID& node) override {
+        if (step()) {
+            value = frames.back()[node.getValueStr()];
+        }
+    }
+
+    void visit(Type& node) override {}
+
+    void visit(BinOp& node) override {
+        if (!step()) {
+            return;
+        }
+        const int32_t left = evaluate(node.getLeft());
+        const int32_t right = evaluate(node.getRight());
+        if (isHalted()) {
+            return;
+        }
+        const uint32_t l = static_cast<uint32_t>(left);
+        const uint32_t r = static_cast<uint32_t>(right);
+        int32_t computed = 0;
+        switch (node.getOp()) {
+            case BinOpType::ADD: computed = static_cast<int32_t>(l + r); break;
+            case BinOpType::SUB: computed = static_cast<int32_t>(l - r); break;
+            case BinOpType::MUL: computed = static_cast<int32_t>(l * r); break;
+            case BinOpType::DIV:
+                if (0 == right) {
+                    output << "Error division by zero\n";
+                    halt(RUN_EXITED);
+                    return;
+                }
+                if (INT32_MIN == left && -1 == right) {
+                    halt(RUN_UNDEFINED);
+                    return;
+                }
+                computed = left / right;
+                break;
+            default: break;
+        }
+        value = (BYTE == node.resultType) ? (computed & 255) : computed;
+    }
+
+    void visit(RelOp& node) override {
+        if (!step()) {
+            return;
+        }
+        const int32_t left = evaluate(node.getLeft());
+        const int32_t right = evaluate(node.getRight());
+        if (isHalted()) {
+            return;
+        }
+        bool holds = false;
+        switch (node.getOp()) {
+            case RelOpType::EQ: holds = left == right; break;
+            case RelOpType::NE: holds = left != right; break;
+            case RelOpType::LT: holds = left < right; break;
+            case RelOpType::GT: holds = left > right; break;
+            case RelOpType::LE: holds = left <= right; break;
+            case RelOpType::GE: holds = left >= right; break;
+            default: break;
+        }
+        value = holds ? 1 : 0;
+    }
+
+    void visit(Not& node) override {
+        if (step()) {
+            value = (0 == evaluate(node.getExpr())) ? 1 : 0;
+        }
+    }
+
+    void visit(And& node) override {
+        if (step() && 0 != evaluate(node.getLeft()) && !isHalted()) {
+            value = (0 != evaluate(node.getRight())) ? 1 : 0;
+        }
+    }
+
+    void visit(Or& node) override {
+        if (step() && 0 == evaluate(node.getLeft()) && !isHalted()) {
+            value = (0 != evaluate(node.getRight())) ? 1 : 0;
+        }
+    }
+
+    void visit(Cast& node) override {
+        if (step()) {
+            const int32_t operand = evaluate(node.getExpr());
+            value = (BYTE == node.getTargetType()) ? (operand & 255) : operand;
+        }
+    }
+
+    void visit(ExpList& node) override {
+        for (auto& exp : node.getExpressions()) {
+            exp->accept(*this);
+        }
+    }
+
+    void visit(Call& node) override {
+        if (!step()) {
+            return;
+        }
+        const string function = node.getFuncId();
+        if ("print" == function || "printi" == function) {
+            node.getArgs().front()->accept(*this);
+            if (!isHalted()) {
+                if ("print" == function) {
+                    output << text << '\n';
+                } else {
+                    output << value << '\n';
+                }
+            }
+            return;
+        }
+
+        vector<int32_t> arguments;
+        for (auto& argument : node.getArgs()) {
+            arguments.push_back(evaluate(argument));
+            if (isHalted()) {
+                return;
+            }
+        }
+        auto called = functions.find(function);
+        if (called == functions.end()) {
+            halt(RUN_UNDEFINED);
+            return;
+        }
+        value = invoke(*called->second, arguments);
+    }
+
+    void visit(Statements& node) override {
+        for (auto& statement : node.getStatements()) {
+            if (FLOW_NORMAL != flow) {
+                return;
+            }
+            statement->accept(*this);
+        }
+    }
+
+    void visit(Break& node) override {
+        if (step()) {
+            flow = FLOW_BREAK;
+        }
+    }
+
+    void visit(Continue& node) override {
+        if (step()) {
+            flow = FLOW_CONTINUE;
+        }
+    }
+
+    void visit(Return& node) override {
+        if (!step()) {
+            return;
+        }
+        value = 0;
+        if (node.getExpr()) {
+            node.getExpr()->accept(*this);
+        }
+        if (!isHalted()) {
+            flow = FLOW_RETURN;
+        }
+    }
+
+    void visit(If& node) override {
+        if (!step()) {
+            return;
+        }
+        const int32_t condition = evaluate(node.getCondition());
+        if (isHalted()) {
+            return;
+        }
+        if (0 != condition) {
+            node.getThen()->accept(*this);
+        } else if (node.getElse()) {
+            node.getElse()->accept(*this);
+        }
+    }
+
+    void visit(While& node) override {
+        while (step()) {
+            const int32_t condition = evaluate(node.getCondition());
+            if (isHalted() || 0 == condition) {
+                return;
+            }
+            node.getBody()->accept(*this);
+            if (FLOW_BREAK == flow) {
+                flow = FLOW_NORMAL;
+                return;
+            }
+            if (FLOW_CONTINUE == flow) {
+                flow = FLOW_NORMAL;
+            }
+            if (FLOW_NORMAL != flow) {
+                return;
+            }
+        }
+    }
+
+    void visit(VarDecl& node) override {
+        if (!step()) {
+            return;
+        }
+        int32_t initial = 0;
+        if (node.getVarInitExp()) {
+            initial = evaluate(node.getVarInitExp());
+            if (BYTE == node.getVarType()) {
+                initial &= 255;
+            }
+        }
+        if (!isHalted()) {
+            frames.back()[node.getValueStr()] = initial;
+        }
+    }
+
+    void visit(Assign& node) override {
+        if (!step()) {
+            return;
+        }
+        const int32_t assigned = evaluate(node.getAssignExp());
+        if (!isHalted()) {
+            frames.back()[node.getValueStr()] = assigned;
+        }
+    }
+
+    void visit(Formal& node) override {}
+    void visit(Formals& node) override {}
+    void visit(FuncDecl& node) override {}
+    void visit(Funcs& node) override {}
+};
+
+/* PureCallEvaluator class
+ * Evaluates calls of pure functions with constant arguments at compile time. Each call gets the same
+ * step budget; a call that does not finish within it stays a runtime call. Results are cached, since
+ * the constant propagation evaluates a call once per pass over its loop.
+ */
+class PureCallEvaluator {
+private:
+    const Funcs* program = nullptr;
+    set<string> pureFunctions;
+    int64_t stepBudget = 0;
+    // Returned value per call, absent values are calls that fell back to runtime
+    map<pair<string, vector<int32_t>>, pair<bool, int32_t>> results;
+    // Functions are generated in parallel, the calls themselves run outside the lock. Two threads may
+    // evaluate the same call, both get the same result.
+    mutex resultsLock;
+
+public:
+    // A budget of 0 disables the evaluation
+    void setProgram(const Funcs& program, const set<string>& pureFunctions, int64_t stepBudget) {
+        this->program = &program;
+        this->pureFunctions = pureFunctions;
+        this->stepBudget = stepBudget;
+        results.clear();
+    }
+
+    bool evaluate(const string& function, const vector<int32_t>& arguments, int32_t& result) {
+        if (!program || 0 >= stepBudget || !pureFunctions.count(function)) {
+            return false;
+        }
+        {
+            lock_guard<mutex> guard(resultsLock);
+            auto cached = results.find({function, arguments});
+            if (cached != results.end()) {
+                result = cached->second.second;
+                return cached->second.first;
+            }
+        }
+        // Pure functions print nothing, the output is only there to satisfy the interpreter
+        ostringstream discarded;
+        Interpreter interpreter(*program, discarded, stepBudget);
+        int32_t returned = 0;
+        const bool isFinished = RUN_FINISHED == interpreter.run(function, arguments, returned);
+        lock_guard<mutex> guard(resultsLock);
+        results.insert({{function, arguments}, {isFinished, returned}});
+        result = returned;
+        return isFinished;
+    }
+
+    void printReport(ostream& os) const {
+        os << "compile-time calls:" << endl;
+        for (const auto& call : results) {
+            os << "  " << call.first.first << "(";
+            for (size_t i = 0; i < call.first.second.size(); ++i) {
+                os << (i ? ", " : "") << call.first.second[i];
+            }
+            os << ") = ";
+            if (call.second.first) {
+                os << call.second.second << endl;
+            } else {
+                os << "runtime call" << endl;
+            }
+        }
+    }
+};
+
+#endif // INTERPRETER_HPP
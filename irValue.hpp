@@ -0,0 +1,84 @@
+#ifndef IR_VALUE_HPP
+#define IR_VALUE_HPP
+
+#include <string>
+#include <ostream>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+
+namespace output {
+    /* Value struct
+     * A name of the generated code: a virtual register "%t12", a label "%label_3" or one of its blocks
+     * "%label_3.then", or the stack slot of a short-circuit operand "%allocation_label_3.leftOperand".
+     * It is a kind tag, a number and a suffix that is always a string literal, so values are copied without
+     * heap memory and become text only when they are written into a code buffer or a stream.
+     */
+    struct Value {
+        enum Kind : uint8_t { UNDEFINED, REGISTER, LABEL, OPERAND_SLOT };
+
+        Kind kind = UNDEFINED;
+        int id = 0;
+        const char *suffix = "";
+
+        Value() = default;
+
+        Value(Kind kind, int id, const char *suffix = "") : kind(kind), id(id), suffix(suffix) {}
+
+        // A block of a label, "%label_3" -> "%label_3.then"
+        Value block(const char *blockSuffix) const {
+            return Value(kind, id, blockSuffix);
+        }
+
+        // The stack slot of an operand of a short-circuit operator, "%label_3" -> "%allocation_label_3.leftOperand"
+        Value operandSlot(const char *operand) const {
+            return Value(OPERAND_SLOT, id, operand);
+        }
+
+        bool isDefined() const {
+            return UNDEFINED != kind;
+        }
+
+        bool operator==(const Value &other) const {
+            return kind == other.kind && id == other.id && 0 == std::strcmp(suffix, other.suffix);
+        }
+
+        bool operator!=(const Value &other) const {
+            return !(*this == other);
+        }
+
+        // Appends the name to the text, a label definition ("label_3.then:") is written without the '%'
+        void appendTo(std::string &text, bool isDefinition = false) const {
+            switch (kind) {
+                case REGISTER:
+                    text += "%t";
+                    break;
+                case LABEL:
+                    text += isDefinition ? "label_" : "%label_";
+                    break;
+                case OPERAND_SLOT:
+                    text += "%allocation_label_";
+                    break;
+                default:
+                    // The name an expression has before it is generated
+                    text += "Undef";
+                    return;
+            }
+            char digits[16];
+            text.append(digits, std::to_chars(digits, digits + sizeof(digits), id).ptr);
+            text += suffix;
+        }
+
+        std::string str() const {
+            std::string text;
+            appendTo(text);
+            return text;
+        }
+    };
+
+    inline std::ostream &operator<<(std::ostream &os, const Value &value) {
+        return os << value.str();
+    }
+}
+
+#endif //IR_VALUE_HPP
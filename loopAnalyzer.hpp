@@ -0,0 +1,673 @@
+#ifndef LOOP_ANALYZER_HPP
+#define LOOP_ANALYZER_HPP
+
+#include "visitor.hpp"
+#include "nodes.hpp"
+#include "symbolTable.hpp"
+#include "constantPropagation.hpp"
+#include <string>
+#include <vector>
+#include <set>
+#include <memory>
+#include <cstdint>
+#include <iostream>
+
+using namespace std;
+using namespace ast;
+
+/* LoopBodyScanner class
+ * Collects the effects of a statement tree without generating code: the variables it assigns and declares,
+ * the functions it calls, returns, loops, divisions that may hit a zero divisor and break/continue
+ * statements that leave the scanned loop.
+ * The number of visited nodes serves as a size estimate of the generated code.
+ */
+class LoopBodyScanner : public Visitor {
+public:
+    set<string> assignedVariables;
+    set<string> declaredVariables;
+    set<string> calledFunctions;
+    bool hasReturn = false;
+    bool hasLoopExit = false;
+    bool hasLoop = false;
+    // A division by anything but a nonzero literal
+    bool hasUncheckedDivision = false;
+    int nodeCount = 0;
+
+private:
+    // Depth of the loops nested inside the scanned statements
+    int nestedLoops = 0;
+
+public:
+    void visit(Num& node) override { nodeCount++; }
+    void visit(NumB& node) override { nodeCount++; }
+    void visit(String& node) override { nodeCount++; }
+    void visit(Bool& node) override { nodeCount++; }
+    void visit(ID& node) override { nodeCount++; }
+    void visit(Type& node) override {}
+
+    void visit(BinOp& node) override {
+        nodeCount++;
+        if (node.getOp() == BinOpType::DIV) {
+            shared_ptr<Exp> divisor = node.getRight();
+            bool isLiteral = dynamic_pointer_cast<Num>(divisor) || dynamic_pointer_cast<NumB>(divisor);
+            hasUncheckedDivision |= !isLiteral || 0 == divisor->getValueInt();
+        }
+        node.getLeft()->accept(*this);
+        node.getRight()->accept(*this);
+    }
+
+    void visit(RelOp& node) override {
+        nodeCount++;
+        node.getLeft()->accept(*this);
+        node.getRight()->accept(*this);
+    }
+
+    void visit(Not& node) override {
+        nodeCount++;
+        node.getExpr()->accept(*this);
+    }
+
+    void visit(And& node) override {
+        nodeCount++;
+        node.getLeft()->accept(*this);
+        node.getRight()->accept(*this);
+    }
+
+    void visit(Or& node) override {
+        nodeCount++;
+        node.getLeft()->accept(*this);
+        node.getRight()->accept(*this);
+    }
+
+    void visit(Cast& node) override {
+        nodeCount++;
+        node.getExpr()->accept(*this);
+    }
+
+    void visit(ExpList& node) override {
+        for (auto& expr : node.getExpressions()) {
+            expr->accept(*this);
+        }
+    }
+
+    void visit(Call& node) override {
+        nodeCount++;
+        calledFunctions.insert(node.getFuncId());
+        node.getArgsExp()->accept(*this);
+    }
+
+    void visit(Statements& node) override {
+        for (auto& statement : node.getStatements()) {
+            statement->accept(*this);
+        }
+    }
+
+    void visit(Break& node) override {
+        nodeCount++;
+        hasLoopExit |= (0 == nestedLoops);
+    }
+
+    void visit(Continue& node) override {
+        nodeCount++;
+        hasLoopExit |= (0 == nestedLoops);
+    }
+
+    void visit(Return& node) override {
+        nodeCount++;
+        hasReturn = true;
+        if (node.getExpr()) {
+            node.getExpr()->accept(*this);
+        }
+    }
+
+    void visit(If& node) override {
+        nodeCount++;
+        node.getCondition()->accept(*this);
+        node.getThen()->accept(*this);
+        if (node.getElse()) {
+            node.getElse()->accept(*this);
+        }
+    }
+
+    void visit(While& node) override {
+        nodeCount++;
+        hasLoop = true;
+        nestedLoops++;
+        node.getCondition()->accept(*this);
+        node.getBody()->accept(*this);
+        nestedLoops--;
+    }
+
+    void visit(VarDecl& node) override {
+        nodeCount++;
+        declaredVariables.insert(node.getValueStr());
+        if (node.getVarInitExp()) {
+            node.getVarInitExp()->accept(*this);
+        }
+    }
+
+    void visit(Assign& node) override {
+        nodeCount++;
+        assignedVariables.insert(node.getValueStr());
+        node.getAssignExp()->accept(*this);
+    }
+
+    void visit(Formal& node) override {}
+    void visit(Formals& node) override {}
+
+    void visit(FuncDecl& node) override {
+        node.getFuncBody()->accept(*this);
+    }
+
+    void visit(Funcs& node) override {
+        for (auto& funcDecl : node.getFuncs()) {
+            funcDecl->accept(*this);
+        }
+    }
+};
+
+/* LoopInvariantCollector class
+ * Finds the largest subexpressions of a loop that compute the same value on every iteration and may be
+ * computed before the loop even where the loop would not have computed them: literals, strings and
+ * variables the loop does not assign, combined by arithmetic (division only by a nonzero literal),
+ * comparisons, not and casts. Calls cannot write the caller's variables, so a call only keeps itself
+ * (not its arguments) in the loop; and/or stay in the loop since they branch.
+ */
+class LoopInvariantCollector : public Visitor {
+private:
+    // Variables assigned or declared inside the loop
+    set<string> variantVariables;
+
+    // Literals and lone variables are as cheap to recompute as to keep in a register
+    static bool isWorthHoisting(const shared_ptr<Exp>& exp) {
+        return dynamic_pointer_cast<BinOp>(exp) || dynamic_pointer_cast<RelOp>(exp) || dynamic_pointer_cast<Not>(exp)
+            || dynamic_pointer_cast<Cast>(exp) || dynamic_pointer_cast<String>(exp);
+    }
+
+    void collect(const shared_ptr<Exp>& exp) {
+        if (isInvariant(exp) && isWorthHoisting(exp)) {
+            invariants.push_back(exp);
+        } else {
+            exp->accept(*this);
+        }
+    }
+
+public:
+    // In evaluation order, inner loops included
+    vector<shared_ptr<Exp>> invariants;
+
+    explicit LoopInvariantCollector(const set<string>& variantVariables) : variantVariables(variantVariables) {}
+
+    bool isInvariant(const shared_ptr<Exp>& exp) const {
+        if (dynamic_pointer_cast<Num>(exp) || dynamic_pointer_cast<NumB>(exp)
+            || dynamic_pointer_cast<Bool>(exp) || dynamic_pointer_cast<String>(exp)) {
+            return true;
+        }
+        if (shared_ptr<ID> id = dynamic_pointer_cast<ID>(exp)) {
+            return 0 == variantVariables.count(id->getValueStr());
+        }
+        if (shared_ptr<BinOp> binOp = dynamic_pointer_cast<BinOp>(exp)) {
+            if (binOp->getOp() == BinOpType::DIV) {
+                shared_ptr<Exp> divisor = binOp->getRight();
+                bool isLiteral = dynamic_pointer_cast<Num>(divisor) || dynamic_pointer_cast<NumB>(divisor);
+                if (!isLiteral || 0 == divisor->getValueInt()) {
+                    return false;
+                }
+            }
+            return isInvariant(binOp->getLeft()) && isInvariant(binOp->getRight());
+        }
+        if (shared_ptr<RelOp> relOp = dynamic_pointer_cast<RelOp>(exp)) {
+            return isInvariant(relOp->getLeft()) && isInvariant(relOp->getRight());
+        }
+        if (shared_ptr<Not> notExp = dynamic_pointer_cast<Not>(exp)) {
+            return isInvariant(notExp->getExpr());
+        }
+        if (shared_ptr<Cast> cast = dynamic_pointer_cast<Cast>(exp)) {
+            return isInvariant(cast->getExpr());
+        }
+        return false;
+    }
+
+    void visit(Num& node) override {}
+    void visit(NumB& node) override {}
+    void visit(String& node) override {}
+    void visit(Bool& node) override {}
+    void visit(ID& node) override {}
+    void visit(Type& node) override {}
+
+    void visit(BinOp& node) override {
+        collect(node.getLeft());
+        collect(node.getRight());
+    }
+
+    void visit(RelOp& node) override {
+        collect(node.getLeft());
+        collect(node.getRight());
+    }
+
+    void visit(Not& node) override {
+        collect(node.getExpr());
+    }
+
+    void visit(And& node) override {
+        collect(node.getLeft());
+        collect(node.getRight());
+    }
+
+    void visit(Or& node) override {
+        collect(node.getLeft());
+        collect(node.getRight());
+    }
+
+    void visit(Cast& node) override {
+        collect(node.getExpr());
+    }
+
+    void visit(ExpList& node) override {
+        for (auto& expr : node.getExpressions()) {
+            collect(expr);
+        }
+    }
+
+    void visit(Call& node) override {
+        node.getArgsExp()->accept(*this);
+    }
+
+    void visit(Statements& node) override {
+        for (auto& statement : node.getStatements()) {
+            statement->accept(*this);
+        }
+    }
+
+    void visit(Break& node) override {}
+    void visit(Continue& node) override {}
+
+    void visit(Return& node) override {
+        if (node.getExpr()) {
+            collect(node.getExpr());
+        }
+    }
+
+    void visit(If& node) override {
+        collect(node.getCondition());
+        node.getThen()->accept(*this);
+        if (node.getElse()) {
+            node.getElse()->accept(*this);
+        }
+    }
+
+    void visit(While& node) override {
+        collect(node.getCondition());
+        node.getBody()->accept(*this);
+    }
+
+    void visit(VarDecl& node) override {
+        if (node.getVarInitExp()) {
+            collect(node.getVarInitExp());
+        }
+    }
+
+    void visit(Assign& node) override {
+        collect(node.getAssignExp());
+    }
+
+    void visit(Formal& node) override {}
+    void visit(Formals& node) override {}
+    void visit(FuncDecl& node) override {}
+    void visit(Funcs& node) override {}
+};
+
+enum LoopAction {
+    LOOP_NONE,          // Generated as is
+    LOOP_FULL_UNROLL,   // The body is repeated tripCount times without any branch
+    LOOP_PARTIAL_UNROLL,// The body is repeated unrollFactor times between two tests of the condition
+    LOOP_METADATA       // Not unrolled here, the decision is passed to LLVM through !llvm.loop metadata
+};
+
+/* LoopInfo struct
+ * The result of analyzing one while loop of the form
+ *      i = start; while (i < bound) { ...; i = i + step; ... }
+ */
+struct LoopInfo {
+    string function;
+    int line = 0;
+    bool hasInductionVariable = false;
+    string variable;
+    BuiltInType variableType = INT;
+    bool isStartKnown = false;
+    int start = 0;
+    RelOpType compare = REL_ERROR;
+    int bound = 0;
+    // Set when the bound is a variable instead of a literal
+    string boundVariable;
+    int step = 0;
+    // -1 when the number of iterations is not known at compile time
+    int64_t tripCount = -1;
+    int bodySize = 0;
+    bool hasCalls = false;
+    LoopAction action = LOOP_NONE;
+    int unrollFactor = 1;
+    // Properties of the !llvm.loop metadata, e.g. !"llvm.loop.unroll.disable"
+    vector<string> metadata;
+    string reason;
+    // Invariant expressions computed once before the loop, and how many of them were not already
+    // hoisted out of an enclosing loop
+    vector<shared_ptr<Exp>> invariants;
+    size_t hoistedCount = 0;
+    // Position in the report
+    size_t id = 0;
+};
+
+/* LoopAnalyzer class
+ * Recognizes simple induction variables of while loops, computes trip counts and decides how each loop
+ * is unrolled under a size budget (the number of AST nodes the unrolled body may have).
+ */
+class LoopAnalyzer {
+private:
+    int unrollBudget;
+    bool isUnrollEnabled;
+    bool isHoistingEnabled;
+    vector<LoopInfo> loops;
+
+    // Loops with more iterations than this are not counted at compile time
+    static const int64_t MAX_COUNTED_TRIPS = 1 << 20;
+    // Full unrolling also needs a small trip count, not only a small unrolled size
+    static const int64_t MAX_FULL_UNROLL_TRIPS = 64;
+
+    static bool literalValue(const shared_ptr<Exp>& exp, int& value) {
+        if (dynamic_pointer_cast<Num>(exp) || dynamic_pointer_cast<NumB>(exp)) {
+            value = exp->getValueInt();
+            return true;
+        }
+        return false;
+    }
+
+    static bool isVariable(const shared_ptr<Exp>& exp, const string& name) {
+        shared_ptr<ID> id = dynamic_pointer_cast<ID>(exp);
+        return id && (name.empty() || id->getValueStr() == name);
+    }
+
+    // "5 > i" is "i < 5"
+    static RelOpType mirror(RelOpType op) {
+        switch (op) {
+            case LT: return GT;
+            case GT: return LT;
+            case LE: return GE;
+            case GE: return LE;
+            default: return op;
+        }
+    }
+
+    static bool compare(RelOpType op, int32_t left, int32_t right) {
+        switch (op) {
+            case EQ: return left == right;
+            case NE: return left != right;
+            case LT: return left < right;
+            case GT: return left > right;
+            case LE: return left <= right;
+            case GE: return left >= right;
+            default: return false;
+        }
+    }
+
+    static string opString(RelOpType op) {
+        switch (op) {
+            case EQ: return "==";
+            case NE: return "!=";
+            case LT: return "<";
+            case GT: return ">";
+            case LE: return "<=";
+            case GE: return ">=";
+            default: return "?";
+        }
+    }
+
+    static vector<shared_ptr<Statement>> bodyStatements(const While& loop) {
+        shared_ptr<Statements> block = dynamic_pointer_cast<Statements>(loop.getBody());
+        if (block) {
+            return block->getStatements();
+        }
+        return {loop.getBody()};
+    }
+
+    // i = i + c, i = c + i or i = i - c
+    static bool stepOf(const shared_ptr<Statement>& statement, const string& name, int& step) {
+        shared_ptr<Assign> assign = dynamic_pointer_cast<Assign>(statement);
+        if (!assign || assign->getValueStr() != name) {
+            return false;
+        }
+        shared_ptr<BinOp> update = dynamic_pointer_cast<BinOp>(assign->getAssignExp());
+        if (!update) {
+            return false;
+        }
+        int value = 0;
+        if (update->getOp() == BinOpType::ADD && isVariable(update->getLeft(), name) && literalValue(update->getRight(), value)) {
+            step = value;
+            return true;
+        }
+        if (update->getOp() == BinOpType::ADD && literalValue(update->getLeft(), value) && isVariable(update->getRight(), name)) {
+            step = value;
+            return true;
+        }
+        if (update->getOp() == BinOpType::SUB && isVariable(update->getLeft(), name) && literalValue(update->getRight(), value)) {
+            step = -value;
+            return true;
+        }
+        return false;
+    }
+
+    static bool hasStep(const vector<shared_ptr<Statement>>& statements, const string& name) {
+        int step = 0;
+        for (const shared_ptr<Statement>& statement : statements) {
+            if (stepOf(statement, name, step)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    int64_t countTrips(const LoopInfo& loop) const {
+        int32_t value = loop.start;
+        int64_t trips = 0;
+        while (compare(loop.compare, value, loop.bound)) {
+            if (++trips > MAX_COUNTED_TRIPS) {
+                return -1;
+            }
+            value = static_cast<int32_t>(static_cast<uint32_t>(value) + static_cast<uint32_t>(loop.step));
+            if (BYTE == loop.variableType) {
+                value &= 255;
+            }
+        }
+        return trips;
+    }
+
+    // Largest factor out of 8, 4, 2 whose unrolled body fits the budget (and divides the trip count if required)
+    int partialFactor(const LoopInfo& loop, bool mustDivide) const {
+        for (int factor : {8, 4, 2}) {
+            bool fits = factor * loop.bodySize <= unrollBudget;
+            if (fits && (!mustDivide || (loop.tripCount >= factor && 0 == loop.tripCount % factor))) {
+                return factor;
+            }
+        }
+        return 1;
+    }
+
+    void plan(LoopInfo& loop) const {
+        if (!loop.hasInductionVariable) {
+            return;
+        }
+        if (!isUnrollEnabled) {
+            loop.reason = "unrolling disabled";
+            return;
+        }
+        const string vectorize = "!\"llvm.loop.vectorize.enable\", i1 true";
+        if (loop.tripCount >= 0) {
+            if (loop.tripCount <= MAX_FULL_UNROLL_TRIPS && loop.tripCount * loop.bodySize <= unrollBudget) {
+                loop.action = LOOP_FULL_UNROLL;
+                loop.unrollFactor = static_cast<int>(loop.tripCount);
+                return;
+            }
+            int factor = partialFactor(loop, true);
+            if (factor > 1) {
+                loop.action = LOOP_PARTIAL_UNROLL;
+                loop.unrollFactor = factor;
+                // The remaining loop is already unrolled, LLVM should not unroll it again
+                loop.metadata.push_back("!\"llvm.loop.unroll.disable\"");
+                return;
+            }
+            loop.reason = "body too large for the unroll budget";
+            loop.action = LOOP_METADATA;
+            loop.metadata.push_back("!\"llvm.loop.unroll.disable\"");
+        } else {
+            loop.reason = "trip count not known at compile time";
+            loop.action = LOOP_METADATA;
+            int factor = partialFactor(loop, false);
+            if (factor > 1) {
+                loop.metadata.push_back("!\"llvm.loop.unroll.count\", i32 " + to_string(factor));
+            } else {
+                loop.metadata.push_back("!\"llvm.loop.unroll.disable\"");
+            }
+        }
+        // Loops without calls are candidates for vectorization
+        if (!loop.hasCalls) {
+            loop.metadata.push_back(vectorize);
+        }
+    }
+
+    static string actionString(const LoopInfo& loop) {
+        switch (loop.action) {
+            case LOOP_FULL_UNROLL: return "fully unrolled";
+            case LOOP_PARTIAL_UNROLL: return "unrolled by " + to_string(loop.unrollFactor);
+            case LOOP_METADATA: return "not unrolled (" + loop.reason + "), !llvm.loop metadata attached";
+            default: return "not transformed (" + loop.reason + ")";
+        }
+    }
+
+public:
+    static const int DEFAULT_UNROLL_BUDGET = 128;
+
+    explicit LoopAnalyzer(int unrollBudget = DEFAULT_UNROLL_BUDGET, bool isUnrollEnabled = true, bool isHoistingEnabled = true)
+        : unrollBudget(unrollBudget), isUnrollEnabled(isUnrollEnabled), isHoistingEnabled(isHoistingEnabled) {}
+
+    // constants holds the values of the variables when the loop is entered
+    LoopInfo analyze(While& loop, const ConstantPropagation& constants, SymbolTable& symbolTable, const string& function) {
+        LoopInfo info;
+        info.function = function;
+        info.line = loop.getLine();
+
+        LoopBodyScanner scanner;
+        loop.getBody()->accept(scanner);
+        info.bodySize = scanner.nodeCount;
+        info.hasCalls = !scanner.calledFunctions.empty();
+
+        shared_ptr<RelOp> condition = dynamic_pointer_cast<RelOp>(loop.getCondition());
+        vector<shared_ptr<Statement>> statements = bodyStatements(loop);
+        if (!condition) {
+            info.reason = "condition is not a comparison";
+        } else {
+            // The loop variable is compared with a literal or with another variable the body does not assign
+            shared_ptr<Exp> left = condition->getLeft();
+            shared_ptr<Exp> right = condition->getRight();
+            bool isLeftBound = literalValue(left, info.bound) || isVariable(left, "");
+            bool isRightBound = literalValue(right, info.bound) || isVariable(right, "");
+            if (isVariable(left, "") && isRightBound && (!isVariable(right, "") || hasStep(statements, left->getValueStr()))) {
+                info.variable = left->getValueStr();
+                info.compare = condition->getOp();
+                literalValue(right, info.bound);
+                info.boundVariable = isVariable(right, "") ? right->getValueStr() : "";
+            } else if (isVariable(right, "") && isLeftBound) {
+                info.variable = right->getValueStr();
+                info.compare = mirror(condition->getOp());
+                literalValue(left, info.bound);
+                info.boundVariable = isVariable(left, "") ? left->getValueStr() : "";
+            } else {
+                info.reason = "condition does not compare a variable with a literal or a variable";
+            }
+        }
+
+        if (!info.variable.empty()) {
+            Symbol* symbol = symbolTable.getSymbol(info.variable);
+            info.variableType = symbol ? symbol->getDataType() : TYPE_ERROR;
+
+            // One statement of the body steps the variable once per iteration, the others must leave it alone
+            LoopBodyScanner rest;
+            size_t steps = 0;
+            for (const shared_ptr<Statement>& statement : statements) {
+                int step = 0;
+                if (stepOf(statement, info.variable, step)) {
+                    info.step = step;
+                    steps++;
+                } else {
+                    statement->accept(rest);
+                }
+            }
+            if (info.variableType != INT && info.variableType != BYTE) {
+                info.reason = "loop variable is not a number";
+            } else if (1 != steps || 0 == info.step) {
+                info.reason = "body does not step the loop variable exactly once";
+            } else if (rest.assignedVariables.count(info.variable) || scanner.declaredVariables.count(info.variable)) {
+                info.reason = "loop variable is assigned inside the body";
+            } else if (!info.boundVariable.empty() && (info.boundVariable == info.variable
+                       || rest.assignedVariables.count(info.boundVariable) || scanner.declaredVariables.count(info.boundVariable))) {
+                info.reason = "loop bound is assigned inside the body";
+            } else if (scanner.hasLoopExit) {
+                info.reason = "body contains break or continue";
+            } else {
+                info.hasInductionVariable = true;
+                const ConstantValue start = constants.entryValueOf(loop, info.variable);
+                info.isStartKnown = start.isConstant();
+                info.start = start.value;
+                // The body does not assign a bound variable, so its value on entry holds in every iteration
+                const ConstantValue bound = info.boundVariable.empty() ? ConstantValue::constant(info.bound)
+                                                                       : constants.entryValueOf(loop, info.boundVariable);
+                info.bound = bound.value;
+                if (info.isStartKnown && bound.isConstant()) {
+                    info.tripCount = countTrips(info);
+                }
+            }
+        }
+        plan(info);
+
+        if (isHoistingEnabled) {
+            set<string> variantVariables = scanner.assignedVariables;
+            variantVariables.insert(scanner.declaredVariables.begin(), scanner.declaredVariables.end());
+            LoopInvariantCollector collector(variantVariables);
+            loop.accept(collector);
+            info.invariants = collector.invariants;
+        }
+        info.id = loops.size();
+        loops.push_back(info);
+        return info;
+    }
+
+    void recordHoisted(const LoopInfo& loop, size_t count) {
+        loops[loop.id].hoistedCount = count;
+    }
+
+    // Adds the loops another analyzer found, after those of this one
+    void merge(const LoopAnalyzer& other) {
+        loops.insert(loops.end(), other.loops.begin(), other.loops.end());
+    }
+
+    void printReport(ostream& os) const {
+        os << "loops:" << endl;
+        for (const LoopInfo& loop : loops) {
+            os << "  " << loop.function << ":" << loop.line << ": ";
+            if (loop.hasInductionVariable) {
+                os << loop.variable << " = " << (loop.isStartKnown ? to_string(loop.start) : "?")
+                   << "; " << loop.variable << " " << opString(loop.compare) << " " << (loop.boundVariable.empty() ? to_string(loop.bound) : loop.boundVariable)
+                   << "; " << loop.variable << " += " << loop.step << ", ";
+                os << (loop.tripCount >= 0 ? to_string(loop.tripCount) : "unknown") << " iterations, ";
+            } else {
+                os << "no induction variable, ";
+            }
+            os << "body size " << loop.bodySize << ": " << actionString(loop);
+            if (loop.hoistedCount > 0) {
+                os << ", " << loop.hoistedCount << " invariant expressions hoisted";
+            }
+            os << endl;
+        }
+    }
+};
+
+#endif // LOOP_ANALYZER_HPP
@@ -5,23 +5,375 @@
 #include "symbolTable.hpp"
 #include "semanticAnalyzer.hpp"
 #include "CodeGenerator.hpp"
+#include "compilerOptions.hpp"
+#include "peepholeOptimizer.hpp"
+#include "cfgSimplifier.hpp"
+#include "interpreter.hpp"
+#include "bytecode.hpp"
+#include "virtualMachine.hpp"
+#include "assemblyGenerator.hpp"
+#include "cSourceGenerator.hpp"
+#include "bitcodeWriter.hpp"
+#include "threadPool.hpp"
+#include "moduleSplitter.hpp"
+#include "compilationCache.hpp"
+#include "incrementalState.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <cstdio>
+#include <functional>
+#include <pthread.h>
+#include <sys/mman.h>
 using namespace output;
 
 // Extern from the bison-generated parser
 extern int yyparse();
 
+// The input of the flex-generated scanner
+extern FILE *yyin;
+
 extern std::shared_ptr<ast::Node> program;
 
-int main() {
+// Call depth limit of the programs run by --run and --vm
+static const int RUN_DEPTH_LIMIT = 1000000;
+
+// Stack of the thread --run interprets on, reserved up front and backed by memory only as the calls reach it
+static const size_t RUN_STACK_SIZE = size_t(4) << 30;
+
+// Exit status of a program run by --run or --vm. Failures the generated code would not report go to stderr.
+static int runExitStatus(InterpreterStatus status, size_t depthLimit) {
+    std::cout.flush();
+    if (RUN_OUT_OF_BUDGET == status) {
+        std::cerr << "hw5: call depth limit of " << depthLimit << " exceeded" << std::endl;
+        return 1;
+    }
+    if (RUN_OUT_OF_STACK == status) {
+        std::cerr << "hw5: out of stack space for the nested calls, --vm runs deeper recursion" << std::endl;
+        return 1;
+    }
+    if (RUN_UNDEFINED == status) {
+        std::cerr << "hw5: division overflow (INT_MIN / -1)" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Runs the work on a new thread with a stack of the given size and waits for it, or runs it on this thread
+// when the stack cannot be reserved
+static void runOnStack(size_t stackSize, const std::function<void()> &work) {
+    void *stack = mmap(nullptr, stackSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK,
+                       -1, 0);
+    bool isStarted = false;
+    pthread_t thread;
+    pthread_attr_t attributes;
+    if (MAP_FAILED != stack && 0 == pthread_attr_init(&attributes)) {
+        auto start = [](void *argument) -> void * {
+            (*static_cast<const std::function<void()> *>(argument))();
+            return nullptr;
+        };
+        isStarted = 0 == pthread_attr_setstack(&attributes, stack, stackSize)
+                    && 0 == pthread_create(&thread, &attributes, start, const_cast<std::function<void()> *>(&work));
+        pthread_attr_destroy(&attributes);
+    }
+    if (isStarted) {
+        pthread_join(thread, nullptr);
+    } else {
+        work();
+    }
+    if (MAP_FAILED != stack) {
+        munmap(stack, stackSize);
+    }
+}
+
+// Writes the module as a header and shards that can be compiled in parallel, and the manifest listing them
+static int writeShards(const CodeBuffer &buffer, const CompilerOptions &options) {
+    std::stringstream text;
+    text << buffer;
+    const std::vector<ModuleShard> shards = ModuleSplitter().split(text.str(), options.shards, {"print", "printi"});
+    const bool isBitcode = options.target == "llvm-bc";
+    std::error_code ignored;
+    std::filesystem::create_directories(options.shardDirectory, ignored);
+    const std::string manifestPath = options.shardDirectory + "/manifest.txt";
+    std::ofstream manifest(manifestPath);
+    manifest << "# module\tfunctions\tinstructions" << std::endl;
+    for (const ModuleShard &shard : shards) {
+        const std::string file = shard.name + (isBitcode ? ".bc" : ".ll");
+        const std::string path = options.shardDirectory + "/" + file;
+        std::ofstream module(path, std::ios::binary);
+        if (isBitcode) {
+            try {
+                const std::string bitcode = BitcodeWriter().write(shard.text);
+                module.write(bitcode.data(), bitcode.size());
+            } catch (const std::runtime_error &error) {
+                std::cerr << "hw5: cannot write bitcode: " << error.what() << std::endl;
+                return 1;
+            }
+        } else {
+            module << shard.text;
+        }
+        if (!module) {
+            std::cerr << "hw5: cannot write " << path << std::endl;
+            return 1;
+        }
+        manifest << file << "\t" << shard.functions << "\t" << shard.instructions << std::endl;
+    }
+    if (!manifest) {
+        std::cerr << "hw5: cannot write " << manifestPath << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Parses, analyzes and compiles (or runs) the program on the scanner input, returns the exit status
+static int compile(const CompilerOptions &options) {
     // Parse the input. The result is stored in the global variable `program`
     yyparse();
 
     SemanticAnalyzer analyzer;
     program->accept(analyzer);
 
-    CodeGenerator codeGenerator;
+    if (options.run) {
+        // The analyzed program runs in the interpreter and writes what the generated code would write. Calls
+        // nest on the native stack, so it runs on a thread whose stack is large enough for the depth limit.
+        Interpreter interpreter(*std::dynamic_pointer_cast<ast::Funcs>(program), std::cout, INT64_MAX, RUN_DEPTH_LIMIT);
+        InterpreterStatus status = RUN_FINISHED;
+        runOnStack(RUN_STACK_SIZE, [&]() {
+            int32_t ignored = 0;
+            status = interpreter.run("main", {}, ignored);
+        });
+        return runExitStatus(status, RUN_DEPTH_LIMIT);
+    }
+    if (options.virtualMachine || options.bytecodeListing) {
+        BytecodeProgram bytecode = BytecodeCompiler().compile(*std::dynamic_pointer_cast<ast::Funcs>(program));
+        if (options.bytecodeListing) {
+            bytecode.disassemble(std::cout);
+            return 0;
+        }
+        // Frames are on the heap, the VM needs no stack of its own for the depth limit
+        VirtualMachine machine(bytecode, std::cout, RUN_DEPTH_LIMIT);
+        return runExitStatus(machine.run(), RUN_DEPTH_LIMIT);
+    }
+    if (options.target == "x86-64") {
+        AssemblyGenerator assemblyGenerator;
+        program->accept(assemblyGenerator);
+        assemblyGenerator.print(std::cout);
+        return 0;
+    }
+    if (options.target == "c") {
+        CSourceGenerator cSourceGenerator;
+        program->accept(cSourceGenerator);
+        cSourceGenerator.print(std::cout);
+        return 0;
+    }
+
+    // The reports count the work of this compilation, so it reads nothing back when one is asked for
+    std::unique_ptr<IncrementalState> incremental;
+    if (!options.incrementalFile.empty()) {
+        const bool reuse = !options.loopReport && !options.divisionStats && !options.peepholeStats && !options.cfgStats
+            && !options.callGraphReport;
+        incremental = std::make_unique<IncrementalState>(options.incrementalFile, options.cacheKey(), reuse);
+    }
+    CodeGenerator codeGenerator(options);
+    codeGenerator.setIncrementalState(incremental.get());
     program->accept(codeGenerator);
 
+    // The passes enable each other (folded conditions become constant branches, merged blocks expose
+    // more local rewrites), so they are repeated a few rounds until nothing changes. They only look at
+    // one function at a time, so the functions are optimized in parallel, with passes per thread.
+    std::vector<FunctionRecord *> functions;
+    for (ModuleEntry &entry : codeGenerator.getCodeBuffer().getEntries()) {
+        if (entry.isFunction) {
+            functions.push_back(&entry.function);
+        }
+    }
+    ThreadPool pool(options.threads);
+    std::vector<PeepholeOptimizer> peepholes(pool.size(), PeepholeOptimizer(options.disabledPeepholeRules));
+    std::vector<CfgSimplifier> cfgSimplifiers(pool.size());
+    const int MAX_PASS_ROUNDS = 4;
+    // With an incremental state, a function the passes got the same text for last time is read back
+    std::vector<std::string> keys(functions.size());
+    std::vector<std::string> optimized(functions.size());
+    std::vector<char> isReused(functions.size(), false);
+    pool.run(functions.size(), [&](size_t function, size_t worker) {
+        if (incremental) {
+            std::ostringstream text;
+            functions[function]->render(text);
+            keys[function] = incremental->key(text.str());
+            const std::string *saved = incremental->find(IncrementalState::OPTIMIZED, keys[function]);
+            if (saved) {
+                CodeBuffer buffer;
+                buffer << *saved;
+                for (ModuleEntry &entry : buffer.getEntries()) {
+                    if (entry.isFunction) {
+                        *functions[function] = std::move(entry.function);
+                        isReused[function] = true;
+                        return;
+                    }
+                }
+            }
+        }
+        for (int round = 0; round < MAX_PASS_ROUNDS; ++round) {
+            bool changed = false;
+            if (options.peephole) {
+                changed |= peepholes[worker].run(*functions[function]);
+            }
+            if (options.cfgSimplify) {
+                changed |= cfgSimplifiers[worker].run(*functions[function]);
+            }
+            if (!changed) {
+                break;
+            }
+        }
+        if (incremental) {
+            std::ostringstream text;
+            functions[function]->render(text);
+            optimized[function] = text.str();
+        }
+    });
+    if (incremental) {
+        for (size_t function = 0; function < functions.size(); ++function) {
+            const std::string &code = isReused[function] ? *incremental->find(IncrementalState::OPTIMIZED, keys[function]) : optimized[function];
+            incremental->keep(IncrementalState::OPTIMIZED, keys[function], code, isReused[function]);
+        }
+        if (!incremental->save()) {
+            std::cerr << "hw5: cannot write " << options.incrementalFile << std::endl;
+        }
+        if (options.incrementalStats) {
+            incremental->printStatistics(std::cerr);
+        }
+    }
+    PeepholeOptimizer &peephole = peepholes.front();
+    CfgSimplifier &cfgSimplifier = cfgSimplifiers.front();
+    for (size_t worker = 1; worker < pool.size(); ++worker) {
+        peephole.merge(peepholes[worker]);
+        cfgSimplifier.merge(cfgSimplifiers[worker]);
+    }
+    if (options.peephole && options.peepholeStats) {
+        peephole.printReport(std::cerr);
+    }
+    if (options.cfgSimplify && options.cfgStats) {
+        cfgSimplifier.printReport(std::cerr);
+    }
+    if (options.loopReport) {
+        codeGenerator.getLoopAnalyzer().printReport(std::cerr);
+    }
+    if (options.divisionStats) {
+        codeGenerator.printDivisionReport(std::cerr);
+    }
+    if (options.callGraphReport) {
+        codeGenerator.getCallGraph().printReport(std::cerr);
+        codeGenerator.getFunctionEffects().printReport(std::cerr, codeGenerator.getCallGraph());
+        codeGenerator.getPureCalls().printReport(std::cerr);
+        codeGenerator.getSpecializer().printReport(std::cerr);
+        if (options.memoize) {
+            codeGenerator.getMemoization().printReport(std::cerr);
+        }
+    }
+
     analyzer.printResults();
+    if (options.shards > 0) {
+        return writeShards(codeGenerator.getCodeBuffer(), options);
+    }
+    if (options.target == "llvm-bc") {
+        // The finished module is written as text once more and encoded from there
+        std::stringstream text;
+        text << codeGenerator.getCodeBuffer();
+        try {
+            const std::string bitcode = BitcodeWriter().write(text.str());
+            std::cout.write(bitcode.data(), bitcode.size());
+        } catch (const std::runtime_error &error) {
+            std::cerr << "hw5: cannot write bitcode: " << error.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
     codeGenerator.printBuffer();
+    return 0;
+}
+
+// A compilation whose output is recorded for the cache. It is stored when the compilation returns, or
+// when a diagnostic ends it through exit(0), and written to the real stdout and stderr then.
+struct CacheRecording {
+    CompilationCache cache;
+    std::string key;
+    bool printStatistics;
+    std::ostringstream output;
+    std::ostringstream diagnostics;
+    std::streambuf *stdoutBuffer;
+    std::streambuf *stderrBuffer;
+
+    CacheRecording(const CompilerOptions &options, const std::string &key)
+        : cache(options.cacheDirectory, uintmax_t(options.cacheSizeMegabytes) << 20), key(key),
+          printStatistics(options.cacheStats), stdoutBuffer(std::cout.rdbuf(output.rdbuf())),
+          stderrBuffer(std::cerr.rdbuf(diagnostics.rdbuf())) {}
+};
+
+static CacheRecording *activeRecording = nullptr;
+
+static void finishRecording(int status) {
+    CacheRecording &recording = *activeRecording;
+    activeRecording = nullptr;
+    std::cout.rdbuf(recording.stdoutBuffer);
+    std::cerr.rdbuf(recording.stderrBuffer);
+    const CachedResult result{status, recording.output.str(), recording.diagnostics.str()};
+    recording.cache.store(recording.key, result);
+    std::cout << result.output << std::flush;
+    std::cerr << result.diagnostics;
+    if (recording.printStatistics) {
+        recording.cache.printStatistics(std::cerr);
+    }
+}
+
+// The diagnostics print their line and exit with status 0
+static void finishRecordingAtExit() {
+    if (activeRecording) {
+        finishRecording(0);
+    }
+}
+
+// Looks the program up in the cache, a hit writes the stored output without parsing the program
+static int compileCached(const CompilerOptions &options) {
+    const std::string source((std::istreambuf_iterator<char>(std::cin)), std::istreambuf_iterator<char>());
+    const std::string key = CompilationCache::key(source, options.cacheKey());
+    CompilationCache cache(options.cacheDirectory, uintmax_t(options.cacheSizeMegabytes) << 20);
+    CachedResult cached;
+    if (cache.lookup(key, cached)) {
+        std::cout << cached.output << std::flush;
+        std::cerr << cached.diagnostics;
+        if (options.cacheStats) {
+            cache.printStatistics(std::cerr);
+        }
+        return cached.status;
+    }
+
+    yyin = fmemopen(const_cast<char *>(source.data()), source.size(), "r");
+    if (!yyin) {
+        std::cerr << "hw5: cannot read the program" << std::endl;
+        return 1;
+    }
+    // On the heap, a diagnostic may finish the recording from exit() when this frame is gone
+    CacheRecording *recording = new CacheRecording(options, key);
+    activeRecording = recording;
+    std::atexit(finishRecordingAtExit);
+    const int status = compile(options);
+    finishRecording(status);
+    delete recording;
+    return status;
+}
+
+int main(int argc, char *argv[]) {
+    CompilerOptions options = CompilerOptions::parse(argc, argv);
+    for (const std::string &rule : options.disabledPeepholeRules) {
+        const std::vector<std::string> &rules = PeepholeOptimizer::ruleNames();
+        if (std::find(rules.begin(), rules.end(), rule) == rules.end()) {
+            std::cerr << "hw5: unknown peephole rule '" << rule << "'" << std::endl;
+            exit(1);
+        }
+    }
+    if (options.isCacheable()) {
+        return compileCached(options);
+    }
+    return compile(options);
 }
@@ -0,0 +1,149 @@
+#ifndef MEMOIZATION_HPP
+#define MEMOIZATION_HPP
+
+#include "nodes.hpp"
+#include "output.hpp"
+#include "callGraph.hpp"
+#include "functionEffects.hpp"
+#include <string>
+#include <vector>
+#include <set>
+#include <iostream>
+
+using namespace std;
+using namespace ast;
+
+/* Memoization class
+ * Caches the results of pure recursive functions. The body of a memoized function f is generated as
+ * "f.compute" and f becomes a wrapper that looks its arguments up in a direct-mapped table, a global of
+ * TABLE_SIZE slots holding a valid flag, the arguments and the result. On a miss the wrapper calls the
+ * body and fills the slot. Recursive calls go through the wrapper, so every computed result is reused.
+ * Pure functions always return the same result for the same arguments, so a hit never changes the output.
+ */
+class Memoization {
+private:
+    set<string> memoized;
+    // Memoized functions and the functions calling them, these read and write the tables
+    set<string> tableUsers;
+
+public:
+    static const int TABLE_BITS = 12;
+    static const int TABLE_SIZE = 1 << TABLE_BITS;
+    // Multiplier of the argument hash (2654435761, the golden ratio scaled to 32 bits)
+    static const int32_t HASH_MULTIPLIER = -1640531535;
+
+    void analyze(const Funcs& program, const CallGraph& callGraph, const FunctionEffects& effects) {
+        memoized.clear();
+        tableUsers.clear();
+        for (const shared_ptr<FuncDecl>& function : program.getFuncs()) {
+            const string name = function->getFuncId();
+            if (VOID != function->getFuncReturnType() && !function->getFuncParams()->getFormals().empty()
+                    && effects.isPure(name) && callGraph.isRecursive(name)) {
+                memoized.insert(name);
+            }
+        }
+        for (const string& function : callGraph.definedFunctions()) {
+            for (const string& cached : memoized) {
+                if (function == cached || callGraph.reaches(function, cached)) {
+                    tableUsers.insert(function);
+                }
+            }
+        }
+    }
+
+    bool isMemoized(const string& function) const {
+        return memoized.count(function) > 0;
+    }
+
+    bool usesTables(const string& function) const {
+        return tableUsers.count(function) > 0;
+    }
+
+    static string computeName(const string& function) {
+        return function + ".compute";
+    }
+
+    // The table and the wrapper of a memoized function, emitted after its body
+    void emitWrapper(output::CodeBuffer& codeBuffer, const FuncDecl& function, const string& attributes) const {
+        const string name = function.getFuncId();
+        const size_t params = function.getFuncParams()->getFormals().size();
+        const string slotType = "[" + to_string(params + 2) + " x i32]";
+        const string tableType = "[" + to_string(TABLE_SIZE) + " x " + slotType + "]";
+        const string table = "@" + name + ".memo";
+        codeBuffer.emit(table + " = internal global " + tableType + " zeroinitializer");
+
+        string prototype = "define i32 @" + name + " (";
+        string arguments;
+        for (size_t i = 0; i < params; ++i) {
+            prototype += string(i ? ", " : "") + "i32";
+            arguments += string(i ? ", " : "") + "i32 %" + to_string(i);
+        }
+        codeBuffer << prototype << ")" << attributes << " {" << endl;
+
+        // Slot index: the top bits of a multiplicative hash of the arguments
+        string hash = "%0";
+        for (size_t i = 0; i < params; ++i) {
+            if (i) {
+                const output::Value mixed = codeBuffer.freshVar();
+                codeBuffer << "\t" << mixed << " = xor i32 " << hash << ", %" << i << endl;
+                hash = mixed.str();
+            }
+            const output::Value multiplied = codeBuffer.freshVar();
+            codeBuffer << "\t" << multiplied << " = mul i32 " << hash << ", " << to_string(HASH_MULTIPLIER) << endl;
+            hash = multiplied.str();
+        }
+        const output::Value index = codeBuffer.freshVar();
+        codeBuffer << "\t" << index << " = lshr i32 " << hash << ", " << (32 - TABLE_BITS) << endl;
+
+        // Pointers to the fields of the slot: 0 is the valid flag, then the arguments, then the result
+        vector<output::Value> fields;
+        for (size_t field = 0; field < params + 2; ++field) {
+            fields.push_back(codeBuffer.freshVar());
+            codeBuffer << "\t" << fields.back() << " = getelementptr " << tableType << ", " << tableType << "* " << table
+                       << ", i32 0, i32 " << index << ", i32 " << field << endl;
+        }
+
+        const output::Value valid = codeBuffer.freshVar();
+        codeBuffer << "\t" << valid << " = load i32, i32* " << fields[0] << endl;
+        output::Value hit = codeBuffer.freshVar();
+        codeBuffer << "\t" << hit << " = icmp ne i32 " << valid << ", 0" << endl;
+        for (size_t i = 0; i < params; ++i) {
+            const output::Value key = codeBuffer.freshVar();
+            const output::Value same = codeBuffer.freshVar();
+            const output::Value both = codeBuffer.freshVar();
+            codeBuffer << "\t" << key << " = load i32, i32* " << fields[i + 1] << endl;
+            codeBuffer << "\t" << same << " = icmp eq i32 " << key << ", %" << i << endl;
+            codeBuffer << "\t" << both << " = and i1 " << hit << ", " << same << endl;
+            hit = both;
+        }
+        const output::Value hitLabel = codeBuffer.freshLabel();
+        const output::Value missLabel = codeBuffer.freshLabel();
+        codeBuffer << "\tbr i1 " << hit << ", label " << hitLabel << ", label " << missLabel << endl;
+
+        codeBuffer.emitLabel(hitLabel);
+        const output::Value cached = codeBuffer.freshVar();
+        codeBuffer << "\t" << cached << " = load i32, i32* " << fields[params + 1] << endl;
+        codeBuffer << "\tret i32 " << cached << endl;
+
+        codeBuffer.emitLabel(missLabel);
+        const output::Value computed = codeBuffer.freshVar();
+        codeBuffer << "\t" << computed << " = call i32 @" << computeName(name) << "(" << arguments << ")" << attributes << endl;
+        codeBuffer << "\tstore i32 1, i32* " << fields[0] << endl;
+        for (size_t i = 0; i < params; ++i) {
+            codeBuffer << "\tstore i32 %" << i << ", i32* " << fields[i + 1] << endl;
+        }
+        codeBuffer << "\tstore i32 " << computed << ", i32* " << fields[params + 1] << endl;
+        codeBuffer << "\tret i32 " << computed << endl;
+        codeBuffer << "}\n\n";
+    }
+
+    void printReport(ostream& os) const {
+        os << "memoized functions:";
+        for (const string& function : memoized) {
+            os << " " << function;
+        }
+        os << endl;
+    }
+};
+
+#endif // MEMOIZATION_HPP
@@ -0,0 +1,299 @@
+#ifndef MODULE_SPLITTER_HPP
+#define MODULE_SPLITTER_HPP
+
+#include "output.hpp"
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <sstream>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+using namespace std;
+
+/* ModuleShard struct
+ * One module of a split program and the functions it defines.
+ */
+struct ModuleShard {
+    // "header" or "shard0", "shard1", ...
+    string name;
+    string text;
+    size_t functions = 0;
+    size_t instructions = 0;
+};
+
+/* ModuleSplitter class
+ * Splits a rendered LLVM module into a header module and shards that llc compiles independently, and that
+ * llvm-link (or the system linker, after llc) combines again. The functions are partitioned by their number
+ * of instructions: the largest goes first, to the shard with the fewest instructions so far. Within a shard
+ * they keep their order in the module. The header holds the runtime helpers and the globals used by more
+ * than one module.
+ * Every module gets the globals only it uses, external declarations of the functions and globals it uses
+ * from other modules, the declarations of the library functions it calls, and the metadata nodes it refers
+ * to, renumbered from 0. Globals the header shares lose their internal linkage, nothing else changes.
+ */
+class ModuleSplitter {
+private:
+    struct Function {
+        string name;
+        vector<string> lines;
+        size_t instructions = 0;
+        // Symbols ("@...") and metadata nodes the body refers to
+        set<string> symbols;
+        set<size_t> metadata;
+        size_t module = 0;
+    };
+
+    struct Global {
+        string name;
+        string definition;
+        set<size_t> users;
+        size_t module = 0;
+    };
+
+    vector<Function> functions;
+    vector<Global> globals;
+    map<string, size_t> globalIndex;
+    // Library functions ("declare ...") by name, in the order of the module
+    vector<pair<string, string>> declarations;
+    vector<string> metadata;
+
+    static const size_t HEADER = 0;
+
+    static bool isSymbolCharacter(char c) {
+        return isalnum(static_cast<unsigned char>(c)) || '_' == c || '.' == c || '$' == c || '-' == c;
+    }
+
+    // The name of the symbol starting at the first '@' of a line, with the '@'
+    static string firstSymbol(const string& line) {
+        const size_t start = line.find('@');
+        size_t end = start + 1;
+        while (end < line.size() && isSymbolCharacter(line[end])) {
+            ++end;
+        }
+        return line.substr(start, end - start);
+    }
+
+    static string trimRight(const string& text) {
+        size_t end = text.size();
+        while (end > 0 && isspace(static_cast<unsigned char>(text[end - 1]))) {
+            --end;
+        }
+        return text.substr(0, end);
+    }
+
+    static void collectReferences(const string& line, Function& function) {
+        for (size_t i = 0; i < line.size(); ++i) {
+            if ('@' == line[i]) {
+                size_t end = i + 1;
+                while (end < line.size() && isSymbolCharacter(line[end])) {
+                    ++end;
+                }
+                function.symbols.insert(line.substr(i, end - i));
+                i = end - 1;
+            } else if ('!' == line[i] && i + 1 < line.size() && isdigit(static_cast<unsigned char>(line[i + 1]))) {
+                size_t end = i + 1;
+                while (end < line.size() && isdigit(static_cast<unsigned char>(line[end]))) {
+                    ++end;
+                }
+                function.metadata.insert(stoul(line.substr(i + 1, end - i - 1)));
+                i = end - 1;
+            }
+        }
+    }
+
+    void parse(const string& text) {
+        istringstream lines(text);
+        string line;
+        Function* current = nullptr;
+        while (getline(lines, line)) {
+            if (current) {
+                current->lines.push_back(line);
+                const string trimmed = trimRight(line);
+                if ("}" == trimmed) {
+                    current = nullptr;
+                } else if (!trimmed.empty() && ':' != trimmed.back()) {
+                    current->instructions++;
+                    collectReferences(line, *current);
+                }
+            } else if (0 == line.rfind("define", 0)) {
+                functions.emplace_back();
+                current = &functions.back();
+                current->name = firstSymbol(line);
+                current->lines.push_back(line);
+            } else if (0 == line.rfind("declare", 0)) {
+                declarations.push_back({firstSymbol(line), trimRight(line)});
+            } else if (0 == line.rfind("@", 0)) {
+                globalIndex[firstSymbol(line)] = globals.size();
+                globals.push_back({firstSymbol(line), trimRight(line), {}, HEADER});
+            } else if (0 == line.rfind("!", 0)) {
+                metadata.push_back(line.substr(line.find(" = ") + 3));
+            }
+        }
+    }
+
+    // Largest first to the least loaded shard, ties to the earlier function and the lower shard
+    size_t partition(size_t shardCount, const set<string>& headerFunctions) {
+        vector<size_t> order;
+        for (size_t i = 0; i < functions.size(); ++i) {
+            if (!headerFunctions.count(functions[i].name.substr(1))) {
+                order.push_back(i);
+            }
+        }
+        shardCount = max<size_t>(1, min(shardCount, order.size()));
+        stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return functions[a].instructions > functions[b].instructions;
+        });
+        vector<size_t> loads(shardCount, 0);
+        for (size_t function : order) {
+            const size_t shard = min_element(loads.begin(), loads.end()) - loads.begin();
+            loads[shard] += functions[function].instructions;
+            functions[function].module = shard + 1;
+        }
+
+        for (const Function& function : functions) {
+            for (const string& symbol : function.symbols) {
+                auto global = globalIndex.find(symbol);
+                if (global != globalIndex.end()) {
+                    globals[global->second].users.insert(function.module);
+                }
+            }
+        }
+        for (Global& global : globals) {
+            global.module = (1 == global.users.size()) ? *global.users.begin() : HEADER;
+        }
+        return shardCount;
+    }
+
+    // "@x = external constant [4 x i8]" for "@x = internal constant [4 x i8] c"..."", types may nest brackets
+    static string globalDeclaration(const string& definition) {
+        istringstream words(definition.substr(definition.find(" = ") + 3));
+        string kind;
+        words >> kind;
+        while ("internal" == kind || "private" == kind || "external" == kind) {
+            words >> kind;
+        }
+        string rest;
+        getline(words, rest);
+        rest = rest.substr(rest.find_first_not_of(' '));
+        size_t end = 0;
+        int depth = 0;
+        do {
+            depth += ('[' == rest[end]) - (']' == rest[end]);
+            ++end;
+        } while (end < rest.size() && (depth > 0 || ' ' != rest[end]));
+        return definition.substr(0, definition.find(" = ")) + " = external " + kind + " " + rest.substr(0, end);
+    }
+
+    // The definition shared through the header, without the linkage that would hide it from the shards
+    static string sharedDefinition(const string& definition) {
+        string shared = definition;
+        for (const char* linkage : {" = internal ", " = private "}) {
+            const size_t at = shared.find(linkage);
+            if (at != string::npos) {
+                shared.replace(at, strlen(linkage), " = ");
+            }
+        }
+        return shared;
+    }
+
+    // "declare i32 @f(i32) nounwind" for "define i32 @f (i32) nounwind {"
+    static string functionDeclaration(const string& header) {
+        string declaration = trimRight(header);
+        if (!declaration.empty() && '{' == declaration.back()) {
+            declaration = trimRight(declaration.substr(0, declaration.size() - 1));
+        }
+        return "declare" + declaration.substr(string("define").size());
+    }
+
+    ModuleShard render(size_t module, const string& name) const {
+        ModuleShard shard;
+        shard.name = name;
+        set<string> symbols;
+        set<size_t> nodes;
+        for (const Function& function : functions) {
+            if (function.module == module) {
+                symbols.insert(function.symbols.begin(), function.symbols.end());
+                nodes.insert(function.metadata.begin(), function.metadata.end());
+                shard.functions++;
+                shard.instructions += function.instructions;
+            }
+        }
+        // Loop nodes refer to their property nodes
+        vector<size_t> pending(nodes.begin(), nodes.end());
+        while (!pending.empty()) {
+            Function references;
+            collectReferences(metadata[pending.back()], references);
+            pending.pop_back();
+            for (size_t node : references.metadata) {
+                if (nodes.insert(node).second) {
+                    pending.push_back(node);
+                }
+            }
+        }
+        vector<string> numbers(metadata.size());
+        size_t next = 0;
+        for (size_t node : nodes) {
+            numbers[node] = "!" + to_string(next++);
+        }
+
+        ostringstream text;
+        for (const Global& global : globals) {
+            if (global.module == module) {
+                text << (HEADER == module ? sharedDefinition(global.definition) : global.definition) << endl;
+            } else if (symbols.count(global.name)) {
+                text << globalDeclaration(global.definition) << endl;
+            }
+        }
+        text << endl;
+        for (const Function& function : functions) {
+            if (function.module != module) {
+                continue;
+            }
+            for (const string& line : function.lines) {
+                text << (nodes.empty() ? line : output::renumberMetadata(line, numbers)) << endl;
+            }
+            text << endl;
+        }
+        for (const Function& function : functions) {
+            if (function.module != module && symbols.count(function.name)) {
+                text << functionDeclaration(function.lines.front()) << endl;
+            }
+        }
+        for (const auto& declaration : declarations) {
+            if (symbols.count(declaration.first)) {
+                text << declaration.second << endl;
+            }
+        }
+        if (!nodes.empty()) {
+            text << endl;
+            for (size_t node : nodes) {
+                text << numbers[node] << " = " << output::renumberMetadata(metadata[node], numbers) << endl;
+            }
+        }
+        shard.text = text.str();
+        return shard;
+    }
+
+public:
+    // The header first, then the shards. There are at most as many shards as functions outside the header.
+    vector<ModuleShard> split(const string& module, size_t shardCount, const set<string>& headerFunctions) {
+        functions.clear();
+        globals.clear();
+        globalIndex.clear();
+        declarations.clear();
+        metadata.clear();
+        parse(module);
+        shardCount = partition(shardCount, headerFunctions);
+
+        vector<ModuleShard> shards{render(HEADER, "header")};
+        for (size_t shard = 0; shard < shardCount; ++shard) {
+            shards.push_back(render(shard + 1, "shard" + to_string(shard)));
+        }
+        return shards;
+    }
+};
+
+#endif // MODULE_SPLITTER_HPP
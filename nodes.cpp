@@ -21,7 +21,8 @@ using namespace ast;
 
 namespace ast {
 
-    Node::Node() : line(yylineno), text(yytext) {
+    // The parser may create a node before the scanner read the first token, yytext is null then
+    Node::Node() : line(yylineno), text(yytext ? yytext : "") {
         this->nodeType = NODE_Undecided;
     }
 
@@ -5,15 +5,18 @@
 #include <string>
 #include <vector>
 #include "visitor.hpp"
+#include "irValue.hpp"
 
 using namespace std;
 namespace ast {
 
     typedef struct {
-        string name = "Undef";
+        output::Value name;
         bool isZero = true;
         int registerValue = 0;
         bool isRegisterValueKnown = true;
+        // The known value holds on every path: it comes from literals and variables the constant propagation proves constant
+        bool isRegisterValueProven = false;
 
         void setRegisterValue(bool isKnownValue, int newValue = 0) {
             if(isKnownValue) {
@@ -108,7 +111,7 @@ namespace ast {
 
     /* Base class for all expressions */
     class Exp : virtual public Node {
-        RegisterStruct storingRegister{"Undef", false};
+        RegisterStruct storingRegister{output::Value(), false};
     public:
         Exp() = default;
         virtual int getValueInt() const { return 0; }
@@ -187,6 +190,9 @@ namespace ast {
     public:
         // Name of the identifier
         string value;
+        // Offset of the variable in its function (Symbol::offset), set by the semantic analysis.
+        // Locals count up from 0, parameters down from -1
+        int offset = 0;
 
         // Constructor that receives a C-style string that represents the identifier
         explicit ID(string str);
@@ -1,5 +1,7 @@
 #include "output.hpp"
 #include <iostream>
+#include <cctype>
+#include <map>
 
 namespace output {
     /* Helper functions */
@@ -96,39 +98,434 @@ namespace output {
         exit(0);
     }
 
+    /* Instruction records */
+
+    InstructionRecord InstructionRecord::parse(std::string_view line) {
+        InstructionRecord record;
+        size_t start = line.find_first_not_of(" \t");
+        if (start == std::string_view::npos) {
+            record.indent = line;
+            return record;
+        }
+        record.indent = line.substr(0, start);
+        std::string_view rest = line.substr(start);
+
+        size_t commentPos = rest.find(';');
+        if (commentPos != std::string_view::npos) {
+            size_t textEnd = rest.find_last_not_of(" \t", commentPos == 0 ? 0 : commentPos - 1);
+            textEnd = (commentPos == 0 || textEnd == std::string_view::npos) ? 0 : textEnd + 1;
+            record.comment = rest.substr(textEnd);
+            rest = rest.substr(0, textEnd);
+        }
+
+        size_t assignPos = rest.find(" = ");
+        if (rest[0] == '%' && assignPos != std::string_view::npos) {
+            record.result = rest.substr(0, assignPos);
+            rest = rest.substr(assignPos + 3);
+        }
+
+        size_t spacePos = rest.find(' ');
+        if (spacePos == std::string_view::npos) {
+            record.opcode = rest;
+        } else {
+            record.opcode = rest.substr(0, spacePos);
+            record.operands = rest.substr(spacePos + 1);
+        }
+        return record;
+    }
+
+    bool InstructionRecord::isTerminator() const {
+        return opcode == "br" || opcode == "ret" || opcode == "unreachable" || opcode == "switch";
+    }
+
+    static bool isValueNameChar(char c) {
+        return isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '.';
+    }
+
+    std::vector<std::string> InstructionRecord::valueTokens() const {
+        std::vector<std::string> tokens;
+        for (size_t i = 0; i < operands.size(); ++i) {
+            if (operands[i] != '%') {
+                continue;
+            }
+            size_t end = i + 1;
+            while (end < operands.size() && isValueNameChar(operands[end])) {
+                ++end;
+            }
+            tokens.push_back(operands.substr(i, end - i));
+            i = end - 1;
+        }
+        return tokens;
+    }
+
+    bool InstructionRecord::replaceValues(const std::unordered_map<std::string, std::string> &replacements) {
+        if (replacements.empty() || operands.find('%') == std::string::npos) {
+            return false;
+        }
+        std::string replaced;
+        bool changed = false;
+        for (size_t i = 0; i < operands.size(); ++i) {
+            if (operands[i] != '%') {
+                replaced += operands[i];
+                continue;
+            }
+            size_t end = i + 1;
+            while (end < operands.size() && isValueNameChar(operands[end])) {
+                ++end;
+            }
+            std::string token = operands.substr(i, end - i);
+            auto it = replacements.find(token);
+            if (it != replacements.end()) {
+                replaced += it->second;
+                changed = true;
+            } else {
+                replaced += token;
+            }
+            i = end - 1;
+        }
+        operands = replaced;
+        return changed;
+    }
+
+    std::string InstructionRecord::render() const {
+        std::string text = indent;
+        if (!result.empty()) {
+            text += result + " = ";
+        }
+        text += opcode;
+        if (!operands.empty()) {
+            text += " " + operands;
+        }
+        return text + comment;
+    }
+
+    std::vector<std::string> BlockRecord::successors() const {
+        std::vector<std::string> labels;
+        if (instructions.empty() || instructions.back().opcode != "br") {
+            return labels;
+        }
+        const std::string &operands = instructions.back().operands;
+        size_t pos = 0;
+        while ((pos = operands.find("label %", pos)) != std::string::npos) {
+            size_t start = pos + 6;
+            size_t end = start + 1;
+            while (end < operands.size() && isValueNameChar(operands[end])) {
+                ++end;
+            }
+            labels.push_back(operands.substr(start, end - start));
+            pos = end;
+        }
+        return labels;
+    }
+
+    std::string FunctionRecord::name() const {
+        size_t at = header.find('@');
+        if (at == std::string::npos) {
+            return "";
+        }
+        size_t end = header.find_first_of(" (", at);
+        return header.substr(at + 1, end == std::string::npos ? std::string::npos : end - at - 1);
+    }
+
+    void FunctionRecord::render(std::ostream &os, bool closed) const {
+        os << header << std::endl;
+        for (const BlockRecord &block : blocks) {
+            if (!block.label.empty()) {
+                os << std::endl << block.label << ":" << std::endl;
+            }
+            for (const InstructionRecord &instruction : block.instructions) {
+                os << instruction.render() << std::endl;
+            }
+        }
+        if (closed) {
+            os << "}" << std::endl;
+        }
+    }
+
     /* CodeBuffer class */
 
-    CodeBuffer::CodeBuffer() : labelCount(0), varCount(0), stringCount(0) {}
+    CodeBuffer::CodeBuffer(const std::string &scope)
+        : scope(scope), labelCount(0), varCount(0), stringCount(0), insideFunction(false) {}
+
+    Value CodeBuffer::freshLabel() {
+        return Value(Value::LABEL, labelCount++);
+    }
 
-    std::string CodeBuffer::freshLabel() {
-        return "%label_" + std::to_string(labelCount++);
+    Value CodeBuffer::freshVar() {
+        return Value(Value::REGISTER, varCount++);
     }
 
-    std::string CodeBuffer::freshVar() {
-        return "%t" + std::to_string(varCount++);
+    // "@.str3" in the module, "@.str.fib.3" in the buffer of the function fib
+    static std::string stringName(const std::string &scope, int number) {
+        return "@.str" + (scope.empty() ? "" : "." + scope + ".") + std::to_string(number);
     }
 
-    std::string CodeBuffer::emitString(const std::string &str) {
-        std::string var = "@.str" + std::to_string(stringCount++);
-        globalsBuffer << var << " = constant [" << str.length() + 1 << " x i8] c\"" << str << "\\00\"";
+    std::string CodeBuffer::emitString(const std::string &str, const std::string &name) {
+        std::string var = name.empty() ? stringName(scope, stringCount++) : name;
+        globalsBuffer << var << " = constant [" << str.length() + 1 << " x i8] c\"" << str << "\\00\"" << std::endl;
         return var;
     }
 
+    std::string CodeBuffer::emitBytes(const std::string &bytes) {
+        static const char *hexDigits = "0123456789ABCDEF";
+        std::string escaped;
+        for (const unsigned char c : bytes) {
+            if (std::isprint(c) && c != '"' && c != '\\') {
+                escaped += static_cast<char>(c);
+            } else {
+                escaped += '\\';
+                escaped += hexDigits[c >> 4];
+                escaped += hexDigits[c & 15];
+            }
+        }
+        std::string var = stringName(scope, stringCount++);
+        globalsBuffer << var << " = constant [" << bytes.length() + 1 << " x i8] c\"" << escaped << "\\00\"" << std::endl;
+        return var;
+    }
+
+    std::string CodeBuffer::emitLoopMetadata(const std::vector<std::string> &properties) {
+        const size_t loopNode = metadataNodes.size();
+        std::string loopId = "!" + std::to_string(loopNode);
+        std::string node = "distinct !{" + loopId;
+        metadataNodes.push_back("");
+        for (const std::string &property : properties) {
+            node += ", !" + std::to_string(metadataNodes.size());
+            metadataNodes.push_back("!{" + property + "}");
+        }
+        metadataNodes[loopNode] = node + "}";
+        return loopId;
+    }
+
+    std::string CodeBuffer::emitBranchWeights(int taken, int notTaken) {
+        const std::string weights = "!\"branch_weights\", i32 " + std::to_string(taken) + ", i32 " + std::to_string(notTaken);
+        auto existing = branchWeights.find(weights);
+        if (existing != branchWeights.end()) {
+            return existing->second;
+        }
+        std::string node = "!" + std::to_string(metadataNodes.size());
+        metadataNodes.push_back("!{" + weights + "}");
+        branchWeights[weights] = node;
+        return node;
+    }
+
+    std::string renumberMetadata(const std::string &text, const std::vector<std::string> &numbers) {
+        std::string renumbered;
+        for (size_t i = 0; i < text.size(); ++i) {
+            if (text[i] != '!' || i + 1 == text.size() || !std::isdigit(static_cast<unsigned char>(text[i + 1]))) {
+                renumbered += text[i];
+                continue;
+            }
+            size_t end = i + 1;
+            while (end < text.size() && std::isdigit(static_cast<unsigned char>(text[end]))) {
+                ++end;
+            }
+            renumbered += numbers[std::stoul(text.substr(i + 1, end - i - 1))];
+            i = end - 1;
+        }
+        return renumbered;
+    }
+
+    void writeText(std::ostream &os, const std::string &text) {
+        os << text.size() << "\n" << text << "\n";
+    }
+
+    bool readText(std::istream &is, std::string &text) {
+        size_t size = 0;
+        if (!(is >> size) || is.get() != '\n') {
+            return false;
+        }
+        text.resize(size);
+        return is.read(&text[0], size) && is.get() == '\n';
+    }
+
+    // The scope, the globals, the metadata nodes, the shared branch weights and the functions as text
+    void CodeBuffer::save(std::ostream &os) {
+        captureLines();
+        writeText(os, scope);
+        writeText(os, globalsBuffer.str());
+        os << metadataNodes.size() << "\n";
+        for (const std::string &node : metadataNodes) {
+            writeText(os, node);
+        }
+        std::map<std::string, std::string> weights(branchWeights.begin(), branchWeights.end());
+        os << weights.size() << "\n";
+        for (const auto &weight : weights) {
+            writeText(os, weight.first);
+            writeText(os, weight.second);
+        }
+        std::ostringstream body;
+        for (const ModuleEntry &entry : entries) {
+            if (entry.isFunction) {
+                entry.function.render(body, !(insideFunction && &entry == &entries.back()));
+            } else {
+                body << entry.text;
+            }
+        }
+        writeText(os, body.str());
+    }
+
+    bool CodeBuffer::load(std::istream &is) {
+        std::string savedScope;
+        std::string globals;
+        size_t count = 0;
+        if (!readText(is, savedScope) || !readText(is, globals) || !(is >> count)) {
+            return false;
+        }
+        *this = CodeBuffer(savedScope);
+        globalsBuffer << globals;
+        metadataNodes.resize(count);
+        for (std::string &node : metadataNodes) {
+            if (!readText(is, node)) {
+                return false;
+            }
+        }
+        if (!(is >> count)) {
+            return false;
+        }
+        for (size_t weight = 0; weight < count; ++weight) {
+            std::string key;
+            std::string node;
+            if (!readText(is, key) || !readText(is, node)) {
+                return false;
+            }
+            branchWeights[key] = node;
+        }
+        if (!readText(is, pending)) {
+            return false;
+        }
+        captureLines();
+        return true;
+    }
+
+    void CodeBuffer::append(CodeBuffer &other) {
+        other.captureLines();
+        globalsBuffer << other.globalsBuffer.str();
+
+        // Every node of the other buffer gets its number here before any is copied, loop nodes refer to
+        // themselves and to the property nodes that follow them
+        std::vector<std::string> numbers(other.metadataNodes.size());
+        std::vector<bool> shared(other.metadataNodes.size(), false);
+        for (const auto &weights : other.branchWeights) {
+            auto existing = branchWeights.find(weights.first);
+            if (existing != branchWeights.end()) {
+                const size_t node = std::stoul(weights.second.substr(1));
+                numbers[node] = existing->second;
+                shared[node] = true;
+            }
+        }
+        size_t next = metadataNodes.size();
+        for (size_t node = 0; node < numbers.size(); ++node) {
+            if (!shared[node]) {
+                numbers[node] = "!" + std::to_string(next++);
+            }
+        }
+        for (size_t node = 0; node < numbers.size(); ++node) {
+            if (!shared[node]) {
+                metadataNodes.push_back(renumberMetadata(other.metadataNodes[node], numbers));
+            }
+        }
+        for (const auto &weights : other.branchWeights) {
+            branchWeights.insert({weights.first, numbers[std::stoul(weights.second.substr(1))]});
+        }
+
+        for (ModuleEntry &entry : other.entries) {
+            if (entry.isFunction && !numbers.empty()) {
+                for (BlockRecord &block : entry.function.blocks) {
+                    for (InstructionRecord &instruction : block.instructions) {
+                        if (instruction.operands.find('!') != std::string::npos) {
+                            instruction.operands = renumberMetadata(instruction.operands, numbers);
+                        }
+                    }
+                }
+            }
+            entries.push_back(std::move(entry));
+        }
+        other.entries.clear();
+        other.metadataNodes.clear();
+        other.branchWeights.clear();
+    }
+
     void CodeBuffer::emit(const std::string &str) {
-        buffer << str << std::endl;
+        pending += str;
+        pending += '\n';
+        captureLines();
+    }
+
+    // The lines are captured where they were written, only the incomplete last line stays pending
+    void CodeBuffer::captureLines() {
+        const std::string_view text(pending);
+        size_t lineStart = 0;
+        size_t lineEnd;
+        while ((lineEnd = text.find('\n', lineStart)) != std::string_view::npos) {
+            captureLine(text.substr(lineStart, lineEnd - lineStart));
+            lineStart = lineEnd + 1;
+        }
+        pending.erase(0, lineStart);
     }
 
-    void CodeBuffer::emitLabel(const std::string &label) {
-        buffer << label.substr(1) << ":" << std::endl;
+    void CodeBuffer::captureLine(std::string_view line) {
+        size_t start = line.find_first_not_of(" \t");
+        std::string_view trimmed = (start == std::string_view::npos) ? std::string_view() : line.substr(start);
+
+        if (!insideFunction) {
+            if (trimmed.rfind("define ", 0) == 0) {
+                entries.push_back({true, "", FunctionRecord{std::string(trimmed), {BlockRecord()}}});
+                insideFunction = true;
+            } else if (!entries.empty() && !entries.back().isFunction) {
+                entries.back().text.append(line).push_back('\n');
+            } else {
+                entries.push_back({false, std::string(line) + "\n", FunctionRecord()});
+            }
+            return;
+        }
+
+        FunctionRecord &function = entries.back().function;
+        if (trimmed == "}") {
+            insideFunction = false;
+        } else if (trimmed.empty()) {
+            // Blank lines between blocks are regenerated when the function is rendered
+        } else if (trimmed.back() == ':' && trimmed.find(' ') == std::string_view::npos) {
+            function.blocks.push_back({std::string(trimmed.substr(0, trimmed.size() - 1)), {}});
+        } else {
+            function.blocks.back().instructions.push_back(InstructionRecord::parse(line));
+        }
     }
 
-    CodeBuffer &CodeBuffer::operator<<(std::ostream &(*manip)(std::ostream &)) {
-        buffer << manip;
+    std::vector<ModuleEntry> &CodeBuffer::getEntries() {
+        captureLines();
+        return entries;
+    }
+
+    void CodeBuffer::emitLabel(const Value &label) {
+        label.appendTo(pending, true);
+        pending += ":\n";
+        captureLines();
+    }
+
+    CodeBuffer &CodeBuffer::operator<<(std::ostream &(*)(std::ostream &)) {
+        pending += '\n';
+        captureLines();
         return *this;
     }
 
     std::ostream &operator<<(std::ostream &os, const CodeBuffer &buffer) {
-        os << buffer.globalsBuffer.str() << std::endl << buffer.buffer.str();
+        os << buffer.globalsBuffer.str() << std::endl;
+        for (size_t i = 0; i < buffer.entries.size(); ++i) {
+            const ModuleEntry &entry = buffer.entries[i];
+            if (entry.isFunction) {
+                // The last function is still open if its closing brace has not been captured yet
+                entry.function.render(os, !(buffer.insideFunction && i == buffer.entries.size() - 1));
+            } else {
+                os << entry.text;
+            }
+        }
+        os << buffer.pending;
+        if (!buffer.metadataNodes.empty()) {
+            os << std::endl;
+            for (size_t node = 0; node < buffer.metadataNodes.size(); ++node) {
+                os << "!" << node << " = " << buffer.metadataNodes[node] << std::endl;
+            }
+        }
         return os;
     }
 }
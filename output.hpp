@@ -4,8 +4,14 @@
 #include <vector>
 #include <string>
 #include <sstream>
+#include <ostream>
+#include <string_view>
+#include <type_traits>
+#include <charconv>
+#include <unordered_map>
 #include "visitor.hpp"
 #include "nodes.hpp"
+#include "irValue.hpp"
 
 namespace output {
     /* Error handling functions */
@@ -36,57 +42,198 @@ namespace output {
 
     void errorByteTooLarge(int lineno, int value);
 
+    // Replaces every metadata reference "!N" in the text by numbers[N]
+    std::string renumberMetadata(const std::string &text, const std::vector<std::string> &numbers);
+
+    // A text of any bytes as "<size>\n<text>\n", for the saved state of the incremental compilation
+    void writeText(std::ostream &os, const std::string &text);
+
+    bool readText(std::istream &is, std::string &text);
+
+    /* Instruction record
+     * A single emitted instruction line, split into its parts so passes can inspect and rewrite it.
+     * For "%t3 = add i32 %t1, 0" the result is "%t3", the opcode is "add" and the operands are "i32 %t1, 0".
+     */
+    struct InstructionRecord {
+        std::string indent;
+        std::string result;
+        std::string opcode;
+        std::string operands;
+        std::string comment;
+
+        static InstructionRecord parse(std::string_view line);
+
+        bool isTerminator() const;
+
+        // Returns every local value or label name ("%...") used by the operands, in order
+        std::vector<std::string> valueTokens() const;
+
+        // Replaces local value names used by the operands. Returns true if something was replaced
+        bool replaceValues(const std::unordered_map<std::string, std::string> &replacements);
+
+        std::string render() const;
+    };
+
+    /* Basic block record
+     * The entry block of a function has an empty label, every other block starts with "label:".
+     */
+    struct BlockRecord {
+        std::string label;
+        std::vector<InstructionRecord> instructions;
+
+        // Returns the labels ("%...") the terminator of the block may jump to
+        std::vector<std::string> successors() const;
+    };
+
+    /* Function record
+     * Everything emitted between a "define ... {" line and its closing "}".
+     */
+    struct FunctionRecord {
+        std::string header;
+        std::vector<BlockRecord> blocks;
+
+        // Returns the function name without the '@' (e.g. "main")
+        std::string name() const;
+
+        void render(std::ostream &os, bool closed = true) const;
+    };
+
+    /* Module entry
+     * Text emitted outside of any function (declarations, runtime globals) is kept as is.
+     */
+    struct ModuleEntry {
+        bool isFunction;
+        std::string text;
+        FunctionRecord function;
+    };
+
     /* CodeBuffer class
      * This class is used to store the generated code.
      * It provides a simple interface to emit code and manage labels and variables.
+     * A buffer may hold a single function generated on its own: registers and labels are numbered within
+     * the buffer, and its strings are named after the function (the scope), so the buffers of different
+     * functions can be appended to the module buffer in any order of generation.
      */
     class CodeBuffer {
     private:
+        std::string scope;
         std::stringstream globalsBuffer;
-        std::stringstream buffer;
+        // Metadata nodes by number, "distinct !{!0, !1}" for "!0 = distinct !{!0, !1}"
+        std::vector<std::string> metadataNodes;
+        std::unordered_map<std::string, std::string> branchWeights;
+        // Text written since the last complete line
+        std::string pending;
         int labelCount;
         int varCount;
         int stringCount;
+        std::vector<ModuleEntry> entries;
+        bool insideFunction;
+
+        // Moves every complete line written so far from the text buffer into the records
+        void captureLines();
+
+        void captureLine(std::string_view line);
 
         friend std::ostream &operator<<(std::ostream &os, const CodeBuffer &buffer);
 
     public:
-        CodeBuffer();
+        explicit CodeBuffer(const std::string &scope = "");
 
-        // Returns a string that represents a label not used before
+        // Returns a label not used before, its blocks are named by suffixes
         // Usage examples:
         //      emitLabel(freshLabel());
-        //      buffer << "br label " << freshLabel() << std::endl;
-        std::string freshLabel();
+        //      buffer << "br label " << freshLabel().block(".then") << std::endl;
+        Value freshLabel();
 
-        // Returns a string that represents a variable not used before
+        // Returns a variable not used before
         // Usage examples:
-        //      std::string var = freshVar();
+        //      Value var = freshVar();
         //      buffer << var << " = icmp eq i32 0, 0" << std::endl;
-        std::string freshVar();
+        Value freshVar();
 
         // Emits a label into the buffer
-        void emitLabel(const std::string &label);
+        void emitLabel(const Value &label);
 
         // Emits a constant string into the globals section of the code.
         // Returns the name of the constant. For the string of the length n (not including null character), the type is [n+1 x i8]
         // Usage examples:
         //      std::string str = emitString("Hello, World!");
         //      buffer << "call i32 (i8*, ...) @printf(i8* getelementptr inbounds ([14 x i8], [14 x i8]* " << str << ", i32 0, i32 0))" << std::endl;
-        std::string emitString(const std::string &str);
+        //      Constants used by many functions (the division error) may be given a fixed name instead.
+        std::string emitString(const std::string &str, const std::string &name = "");
+
+        // Emits arbitrary bytes (newlines, quotes, backslashes) as a constant string, escaped for LLVM.
+        // Returns the name of the constant, its type is [n+1 x i8] for n bytes like with emitString.
+        std::string emitBytes(const std::string &bytes);
+
+        // Emits a distinct loop metadata node with the given properties, printed at the end of the module.
+        // Returns the name of the node.
+        // Usage examples:
+        //      std::string loopId = emitLoopMetadata({"!\"llvm.loop.unroll.disable\""});
+        //      buffer << "br i1 %c, label %body, label %done, !llvm.loop " << loopId << std::endl;
+        std::string emitLoopMetadata(const std::vector<std::string> &properties);
+
+        // Emits a branch_weights metadata node for a conditional branch, shared by all branches with the same weights.
+        // Returns the name of the node.
+        // Usage examples:
+        //      buffer << "br i1 %c, label %likely, label %unlikely, !prof " << emitBranchWeights(2000, 1) << std::endl;
+        std::string emitBranchWeights(int taken, int notTaken);
 
         // Emits a string into the buffer
         void emit(const std::string &str);
 
-        // Template overload for general types
+        CodeBuffer &operator<<(const std::string &text) {
+            pending += text;
+            return *this;
+        }
+
+        CodeBuffer &operator<<(const char *text) {
+            pending += text;
+            return *this;
+        }
+
+        CodeBuffer &operator<<(char c) {
+            pending += c;
+            return *this;
+        }
+
+        CodeBuffer &operator<<(const Value &value) {
+            value.appendTo(pending);
+            return *this;
+        }
+
+        // Template overload for general types, numbers are written the way a stream writes them
         template<typename T>
         CodeBuffer &operator<<(const T &value) {
-            buffer << value;
+            if constexpr (std::is_same_v<T, bool>) {
+                pending += value ? '1' : '0';
+            } else if constexpr (std::is_integral_v<T>) {
+                char digits[24];
+                pending.append(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr);
+            } else {
+                std::ostringstream text;
+                text << value;
+                pending += text.str();
+            }
             return *this;
         }
 
-        // Overload for manipulators (like std::endl)
+        // Overload for manipulators, every one (std::endl) ends the line
         CodeBuffer &operator<<(std::ostream &(*manip)(std::ostream &));
+
+        // Returns the structured records of everything emitted so far.
+        // Passes may rewrite the function records in place before the buffer is printed.
+        std::vector<ModuleEntry> &getEntries();
+
+        // Writes everything the buffer holds in the form load reads back
+        void save(std::ostream &os);
+
+        // Replaces the buffer by a saved one, returns false if the input is not a saved buffer
+        bool load(std::istream &is);
+
+        // Moves everything another buffer holds to the end of this one. Its metadata nodes are renumbered
+        // after those of this buffer, branch weights already present here are shared.
+        void append(CodeBuffer &other);
     };
 
     std::ostream &operator<<(std::ostream &os, const CodeBuffer &buffer);
@@ -65,12 +65,13 @@ shared_ptr<Node> program;
 Program: Funcs { program = $1; };
 
 // TODO: Define grammar here
+// Left recursive, so the parser stack does not grow with the number of functions
 Funcs: { $$ = make_shared<Funcs>(); }
-            | FuncDecl Funcs 
+            | Funcs FuncDecl 
             { 
-                shared_ptr<Funcs> funcs_ptr = dynamic_pointer_cast<Funcs>($2);
-                shared_ptr<FuncDecl> singleFunc_ptr = dynamic_pointer_cast<FuncDecl>($1);
-                funcs_ptr->push_front(singleFunc_ptr);
+                shared_ptr<Funcs> funcs_ptr = dynamic_pointer_cast<Funcs>($1);
+                shared_ptr<FuncDecl> singleFunc_ptr = dynamic_pointer_cast<FuncDecl>($2);
+                funcs_ptr->push_back(singleFunc_ptr);
                 $$ = funcs_ptr;
             }
 
@@ -0,0 +1,517 @@
+#ifndef PEEPHOLE_OPTIMIZER_HPP
+#define PEEPHOLE_OPTIMIZER_HPP
+
+#include "output.hpp"
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <unordered_map>
+#include <cstdint>
+#include <iostream>
+
+using namespace std;
+using namespace output;
+
+/* Operand helpers
+ * The code generator only emits a small set of instruction shapes, these helpers split their operands.
+ */
+
+// "i32 %a, %b" -> type "i32", lhs "%a", rhs "%b"
+static bool splitBinaryOperands(const string &operands, string &type, string &lhs, string &rhs) {
+    size_t typeEnd = operands.find(' ');
+    size_t comma = operands.find(", ");
+    if (typeEnd == string::npos || comma == string::npos || comma < typeEnd) {
+        return false;
+    }
+    type = operands.substr(0, typeEnd);
+    lhs = operands.substr(typeEnd + 1, comma - typeEnd - 1);
+    rhs = operands.substr(comma + 2);
+    return true;
+}
+
+// "i1 %a to i32" -> source type "i1", value "%a", target type "i32"
+static bool splitCastOperands(const string &operands, string &fromType, string &value, string &toType) {
+    size_t typeEnd = operands.find(' ');
+    size_t toPos = operands.find(" to ");
+    if (typeEnd == string::npos || toPos == string::npos || toPos < typeEnd) {
+        return false;
+    }
+    fromType = operands.substr(0, typeEnd);
+    value = operands.substr(typeEnd + 1, toPos - typeEnd - 1);
+    toType = operands.substr(toPos + 4);
+    return true;
+}
+
+// "i1 %c, i32 %a, i32 %b" -> condition "%c", values "%a" and "%b"
+static bool splitSelectOperands(const string &operands, string &condition, string &trueValue, string &falseValue) {
+    size_t first = operands.find(", ");
+    size_t second = operands.find(", ", first == string::npos ? 0 : first + 2);
+    if (operands.rfind("i1 ", 0) != 0 || first == string::npos || second == string::npos) {
+        return false;
+    }
+    condition = operands.substr(3, first - 3);
+    string trueOperand = operands.substr(first + 2, second - first - 2);
+    string falseOperand = operands.substr(second + 2);
+    size_t trueSpace = trueOperand.find(' ');
+    size_t falseSpace = falseOperand.find(' ');
+    if (trueSpace == string::npos || falseSpace == string::npos) {
+        return false;
+    }
+    trueValue = trueOperand.substr(trueSpace + 1);
+    falseValue = falseOperand.substr(falseSpace + 1);
+    return true;
+}
+
+// "i32 %v, i32* %ptr" (store) or "i32, i32* %ptr" (load) -> pointer "%ptr"
+static string memoryPointerOperand(const string &operands) {
+    size_t lastSpace = operands.find_last_of(' ');
+    return (lastSpace == string::npos) ? "" : operands.substr(lastSpace + 1);
+}
+
+// "i32 %v, i32* %ptr" -> stored value "%v"
+static string storedValueOperand(const string &operands) {
+    size_t typeEnd = operands.find(' ');
+    size_t comma = operands.find(", ");
+    if (typeEnd == string::npos || comma == string::npos) {
+        return "";
+    }
+    return operands.substr(typeEnd + 1, comma - typeEnd - 1);
+}
+
+// Integer literals and the i1 literals true/false
+static bool parseConstant(const string &token, int64_t &value) {
+    if (token == "true" || token == "false") {
+        value = (token == "true") ? 1 : 0;
+        return true;
+    }
+    if (token.empty()) {
+        return false;
+    }
+    size_t start = (token[0] == '-') ? 1 : 0;
+    if (start == token.size()) {
+        return false;
+    }
+    for (size_t i = start; i < token.size(); ++i) {
+        if (!isdigit(static_cast<unsigned char>(token[i]))) {
+            return false;
+        }
+    }
+    value = stoll(token);
+    return true;
+}
+
+static string constantToString(const string &type, int64_t value) {
+    if (type == "i1") {
+        return (value & 1) ? "true" : "false";
+    }
+    return to_string(static_cast<int32_t>(static_cast<uint32_t>(value)));
+}
+
+/* PeepholeOptimizer class
+ * Runs local rewrites over the instruction records of every function before the code is printed.
+ * Each rewrite can be disabled by name and the number of applications of each rewrite is counted.
+ */
+class PeepholeOptimizer {
+private:
+    set<string> disabledRules;
+    map<string, int> rewriteCounts;
+
+    static const int MAX_ITERATIONS = 16;
+
+    bool isEnabled(const string &rule) const {
+        return disabledRules.count(rule) == 0;
+    }
+
+    void countRewrite(const string &rule) {
+        rewriteCounts[rule]++;
+    }
+
+    static bool isPure(const string &opcode) {
+        static const set<string> pureOpcodes = {"add", "sub", "mul", "and", "or", "xor", "icmp",
+                                                "zext", "trunc", "getelementptr", "load", "alloca", "select"};
+        return pureOpcodes.count(opcode) > 0;
+    }
+
+    static bool foldBinary(const string &opcode, int64_t lhs, int64_t rhs, int64_t &result) {
+        int32_t left = static_cast<int32_t>(lhs);
+        int32_t right = static_cast<int32_t>(rhs);
+        if (opcode == "add") {
+            result = static_cast<int32_t>(static_cast<uint32_t>(left) + static_cast<uint32_t>(right));
+        } else if (opcode == "sub") {
+            result = static_cast<int32_t>(static_cast<uint32_t>(left) - static_cast<uint32_t>(right));
+        } else if (opcode == "mul") {
+            result = static_cast<int32_t>(static_cast<uint32_t>(left) * static_cast<uint32_t>(right));
+        } else if (opcode == "sdiv") {
+            if (right == 0 || (left == INT32_MIN && right == -1)) {
+                return false;
+            }
+            result = left / right;
+        } else if (opcode == "and") {
+            result = left & right;
+        } else if (opcode == "or") {
+            result = left | right;
+        } else if (opcode == "xor") {
+            result = left ^ right;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    static bool foldCompare(const string &predicate, int64_t lhs, int64_t rhs, int64_t &result) {
+        int32_t left = static_cast<int32_t>(lhs);
+        int32_t right = static_cast<int32_t>(rhs);
+        if (predicate == "eq") result = left == right;
+        else if (predicate == "ne") result = left != right;
+        else if (predicate == "slt") result = left < right;
+        else if (predicate == "sgt") result = left > right;
+        else if (predicate == "sle") result = left <= right;
+        else if (predicate == "sge") result = left >= right;
+        else return false;
+        return true;
+    }
+
+    // Tries to replace the value defined by the instruction with an existing value or a constant
+    bool simplify(const InstructionRecord &instruction, const unordered_map<string, InstructionRecord> &definitions,
+                  const unordered_map<string, string> &slotValues, string &replacement) {
+        const string &opcode = instruction.opcode;
+        string type, lhs, rhs;
+        int64_t lhsValue = 0, rhsValue = 0, folded = 0;
+
+        if (opcode == "load") {
+            auto slot = slotValues.find(memoryPointerOperand(instruction.operands));
+            if (isEnabled("store-load") && slot != slotValues.end()) {
+                replacement = slot->second;
+                countRewrite("store-load");
+                return true;
+            }
+            return false;
+        }
+
+        if (opcode == "icmp") {
+            size_t predicateEnd = instruction.operands.find(' ');
+            if (predicateEnd == string::npos
+                || !splitBinaryOperands(instruction.operands.substr(predicateEnd + 1), type, lhs, rhs)) {
+                return false;
+            }
+            if (isEnabled("constant-fold") && parseConstant(lhs, lhsValue) && parseConstant(rhs, rhsValue)
+                && foldCompare(instruction.operands.substr(0, predicateEnd), lhsValue, rhsValue, folded)) {
+                replacement = constantToString("i1", folded);
+                countRewrite("constant-fold");
+                return true;
+            }
+            return false;
+        }
+
+        if (opcode == "zext" || opcode == "trunc") {
+            string fromType, value, toType;
+            if (!splitCastOperands(instruction.operands, fromType, value, toType)) {
+                return false;
+            }
+            if (isEnabled("constant-fold") && parseConstant(value, lhsValue)) {
+                replacement = constantToString(toType, lhsValue);
+                countRewrite("constant-fold");
+                return true;
+            }
+            auto source = definitions.find(value);
+            if (isEnabled("zext-trunc") && opcode == "trunc" && source != definitions.end()
+                && source->second.opcode == "zext") {
+                string sourceFromType, sourceValue, sourceToType;
+                if (splitCastOperands(source->second.operands, sourceFromType, sourceValue, sourceToType)
+                    && sourceFromType == toType) {
+                    replacement = sourceValue;
+                    countRewrite("zext-trunc");
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        if (opcode == "select") {
+            // "i1 %c, i32 %a, i32 %b"
+            string condition, trueValue, falseValue;
+            if (!splitSelectOperands(instruction.operands, condition, trueValue, falseValue)) {
+                return false;
+            }
+            if (isEnabled("constant-fold") && (parseConstant(condition, lhsValue) || trueValue == falseValue)) {
+                replacement = (trueValue == falseValue || lhsValue != 0) ? trueValue : falseValue;
+                countRewrite("constant-fold");
+                return true;
+            }
+            return false;
+        }
+
+        if (!splitBinaryOperands(instruction.operands, type, lhs, rhs) || type != "i32") {
+            return false;
+        }
+        bool lhsConstant = parseConstant(lhs, lhsValue);
+        bool rhsConstant = parseConstant(rhs, rhsValue);
+
+        if (isEnabled("constant-fold") && lhsConstant && rhsConstant && foldBinary(opcode, lhsValue, rhsValue, folded)) {
+            replacement = constantToString(type, folded);
+            countRewrite("constant-fold");
+            return true;
+        }
+
+        if (isEnabled("copy")) {
+            if (((opcode == "add" || opcode == "or" || opcode == "xor") && rhsConstant && rhsValue == 0)
+                || (opcode == "sub" && rhsConstant && rhsValue == 0)
+                || (opcode == "mul" && rhsConstant && rhsValue == 1)) {
+                replacement = lhs;
+                countRewrite("copy");
+                return true;
+            }
+            if (((opcode == "add" || opcode == "or" || opcode == "xor") && lhsConstant && lhsValue == 0)
+                || (opcode == "mul" && lhsConstant && lhsValue == 1)) {
+                replacement = rhs;
+                countRewrite("copy");
+                return true;
+            }
+        }
+
+        if (isEnabled("redundant-mask") && opcode == "and" && rhsConstant && rhsValue == 255) {
+            auto source = definitions.find(lhs);
+            if (source != definitions.end()) {
+                string sourceType, sourceLhs, sourceRhs;
+                bool alreadyMasked = source->second.opcode == "and"
+                    && splitBinaryOperands(source->second.operands, sourceType, sourceLhs, sourceRhs)
+                    && sourceRhs == "255";
+                bool isBoolean = source->second.opcode == "zext" && source->second.operands.rfind("i1 ", 0) == 0;
+                if (alreadyMasked || isBoolean) {
+                    replacement = lhs;
+                    countRewrite("redundant-mask");
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    // Instructions after the first terminator of a block and blocks that no branch reaches can never execute.
+    // Both are removed together, since a value defined in the dead tail of a block may only be used by
+    // blocks that are themselves reachable only through that tail.
+    bool removeUnreachableCode(FunctionRecord &function) {
+        if (!isEnabled("unreachable-code") || function.blocks.empty()) {
+            return false;
+        }
+        bool changed = false;
+        for (BlockRecord &block : function.blocks) {
+            for (size_t i = 0; i < block.instructions.size(); ++i) {
+                if (block.instructions[i].isTerminator() && i + 1 < block.instructions.size()) {
+                    rewriteCounts["unreachable-code"] += block.instructions.size() - i - 1;
+                    block.instructions.erase(block.instructions.begin() + i + 1, block.instructions.end());
+                    changed = true;
+                    break;
+                }
+            }
+        }
+
+        unordered_map<string, size_t> blockIndex;
+        for (size_t i = 0; i < function.blocks.size(); ++i) {
+            blockIndex["%" + function.blocks[i].label] = i;
+        }
+        vector<bool> reachable(function.blocks.size(), false);
+        vector<size_t> worklist = {0};
+        reachable[0] = true;
+        while (!worklist.empty()) {
+            const BlockRecord &block = function.blocks[worklist.back()];
+            worklist.pop_back();
+            for (const string &target : block.successors()) {
+                auto it = blockIndex.find(target);
+                if (it != blockIndex.end() && !reachable[it->second]) {
+                    reachable[it->second] = true;
+                    worklist.push_back(it->second);
+                }
+            }
+        }
+
+        vector<BlockRecord> kept;
+        for (size_t i = 0; i < function.blocks.size(); ++i) {
+            if (reachable[i]) {
+                kept.push_back(function.blocks[i]);
+            } else {
+                rewriteCounts["unreachable-code"] += function.blocks[i].instructions.size() + 1;
+                changed = true;
+            }
+        }
+        function.blocks = kept;
+        return changed;
+    }
+
+    bool simplifyInstructions(FunctionRecord &function) {
+        bool changed = false;
+        unordered_map<string, string> replacements;
+        unordered_map<string, InstructionRecord> definitions;
+
+        for (BlockRecord &block : function.blocks) {
+            // Values known to be stored in each stack slot, valid until the end of the block.
+            // Stack slots never escape (calls only receive values), so only stores can change them.
+            unordered_map<string, string> slotValues;
+            vector<InstructionRecord> kept;
+            for (InstructionRecord &instruction : block.instructions) {
+                instruction.replaceValues(replacements);
+                string replacement;
+                if (!instruction.result.empty() && simplify(instruction, definitions, slotValues, replacement)) {
+                    replacements[instruction.result] = replacement;
+                    changed = true;
+                    continue;
+                }
+                if (!instruction.result.empty()) {
+                    definitions[instruction.result] = instruction;
+                }
+                if (instruction.opcode == "store") {
+                    slotValues[memoryPointerOperand(instruction.operands)] = storedValueOperand(instruction.operands);
+                } else if (instruction.opcode == "load") {
+                    slotValues[memoryPointerOperand(instruction.operands)] = instruction.result;
+                }
+                kept.push_back(instruction);
+            }
+            block.instructions = kept;
+        }
+
+        if (changed) {
+            for (BlockRecord &block : function.blocks) {
+                for (InstructionRecord &instruction : block.instructions) {
+                    instruction.replaceValues(replacements);
+                }
+            }
+        }
+        return changed;
+    }
+
+    bool removeDeadCode(FunctionRecord &function) {
+        bool changed = false;
+        bool removedSomething = true;
+        while (removedSomething) {
+            removedSomething = false;
+            unordered_map<string, int> uses;
+            unordered_map<string, int> loads;
+            for (const BlockRecord &block : function.blocks) {
+                for (const InstructionRecord &instruction : block.instructions) {
+                    for (const string &token : instruction.valueTokens()) {
+                        uses[token]++;
+                    }
+                    if (instruction.opcode == "load") {
+                        loads[memoryPointerOperand(instruction.operands)]++;
+                    }
+                }
+            }
+            for (BlockRecord &block : function.blocks) {
+                vector<InstructionRecord> kept;
+                for (const InstructionRecord &instruction : block.instructions) {
+                    if (isEnabled("dead-code") && !instruction.result.empty() && isPure(instruction.opcode)
+                        && uses[instruction.result] == 0) {
+                        countRewrite("dead-code");
+                        removedSomething = true;
+                        continue;
+                    }
+                    // A stack slot that is never loaded only needs its stores for nothing
+                    if (isEnabled("dead-store") && instruction.opcode == "store"
+                        && loads[memoryPointerOperand(instruction.operands)] == 0) {
+                        countRewrite("dead-store");
+                        removedSomething = true;
+                        continue;
+                    }
+                    kept.push_back(instruction);
+                }
+                block.instructions = kept;
+            }
+            changed |= removedSomething;
+        }
+        return changed;
+    }
+
+    // "br label %X" right before block X, when it is the only way into X, joins the two blocks
+    bool mergeFallthroughBranches(FunctionRecord &function) {
+        if (!isEnabled("fallthrough-branch")) {
+            return false;
+        }
+        unordered_map<string, int> labelReferences;
+        for (const BlockRecord &block : function.blocks) {
+            for (const InstructionRecord &instruction : block.instructions) {
+                if (instruction.opcode == "br") {
+                    for (const string &token : instruction.valueTokens()) {
+                        labelReferences[token]++;
+                    }
+                }
+            }
+        }
+
+        bool changed = false;
+        for (size_t i = 0; i + 1 < function.blocks.size();) {
+            BlockRecord &block = function.blocks[i];
+            BlockRecord &next = function.blocks[i + 1];
+            const string nextLabel = "%" + next.label;
+            if (!block.instructions.empty() && block.instructions.back().opcode == "br"
+                && block.instructions.back().operands == "label " + nextLabel && labelReferences[nextLabel] == 1) {
+                block.instructions.pop_back();
+                block.instructions.insert(block.instructions.end(), next.instructions.begin(), next.instructions.end());
+                function.blocks.erase(function.blocks.begin() + i + 1);
+                countRewrite("fallthrough-branch");
+                changed = true;
+            } else {
+                ++i;
+            }
+        }
+        return changed;
+    }
+
+public:
+    explicit PeepholeOptimizer(const set<string> &disabledRules = {}) : disabledRules(disabledRules) {}
+
+    static const vector<string> &ruleNames() {
+        static const vector<string> names = {"copy", "constant-fold", "zext-trunc", "redundant-mask", "store-load",
+                                             "dead-code", "dead-store", "unreachable-code", "fallthrough-branch"};
+        return names;
+    }
+
+    // Returns true if the function was changed
+    bool run(FunctionRecord &function) {
+        bool changed = false;
+        for (int iteration = 0; iteration < MAX_ITERATIONS; ++iteration) {
+            bool iterationChanged = false;
+            iterationChanged |= removeUnreachableCode(function);
+            iterationChanged |= simplifyInstructions(function);
+            iterationChanged |= removeDeadCode(function);
+            iterationChanged |= mergeFallthroughBranches(function);
+            if (!iterationChanged) {
+                break;
+            }
+            changed = true;
+        }
+        return changed;
+    }
+
+    bool run(vector<ModuleEntry> &entries) {
+        bool changed = false;
+        for (ModuleEntry &entry : entries) {
+            if (entry.isFunction) {
+                changed |= run(entry.function);
+            }
+        }
+        return changed;
+    }
+
+    const map<string, int> &getRewriteCounts() const {
+        return rewriteCounts;
+    }
+
+    // Adds the rewrites another optimizer (of other functions) applied
+    void merge(const PeepholeOptimizer &other) {
+        for (const auto &rule : other.rewriteCounts) {
+            rewriteCounts[rule.first] += rule.second;
+        }
+    }
+
+    void printReport(ostream &os) const {
+        os << "peephole rewrites:" << endl;
+        for (const string &rule : ruleNames()) {
+            auto it = rewriteCounts.find(rule);
+            os << "  " << rule << ": " << (it == rewriteCounts.end() ? 0 : it->second)
+               << (isEnabled(rule) ? "" : " (disabled)") << endl;
+        }
+    }
+};
+
+#endif // PEEPHOLE_OPTIMIZER_HPP
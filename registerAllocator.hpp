@@ -0,0 +1,273 @@
+#ifndef REGISTER_ALLOCATOR_HPP
+#define REGISTER_ALLOCATOR_HPP
+
+#include "bytecode.hpp"
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+using namespace std;
+
+/* Location struct
+ * Where a bytecode register lives in native code: a machine register, a stack slot, or nowhere when its
+ * value is never used.
+ */
+struct Location {
+    enum Kind { NONE, MACHINE_REGISTER, STACK_SLOT };
+    Kind kind = NONE;
+    int index = 0;
+};
+
+/* LiveInterval struct
+ * Instructions from the first definition to the last use of a bytecode register. Parameters start at -1,
+ * the function entry. An interval crosses a call when a call lies strictly inside it.
+ */
+struct LiveInterval {
+    int bytecodeRegister = 0;
+    int start = 0;
+    int end = 0;
+    bool crossesCall = false;
+};
+
+/* LinearScanAllocator class
+ * Assigns the registers of one bytecode function to machine registers with linear scan. Liveness is
+ * computed on the instruction level control flow graph, and each register gets one interval spanning
+ * every instruction where it is live. Intervals crossing a call may only take callee-saved registers.
+ * When no register is free, the interval ending last (the current one or an active one whose register
+ * fits) moves to a stack slot.
+ * The machine registers are numbered by the caller: 0 to calleeSaved - 1 are callee-saved, the rest
+ * caller-saved.
+ */
+class LinearScanAllocator {
+private:
+    int calleeSaved;
+    int machineRegisters;
+
+    vector<Location> locations;
+    vector<bool> liveParameters;
+    int stackSlots = 0;
+    vector<bool> usedRegisters;
+
+    static bool isCall(Opcode opcode) {
+        return OP_CALL == opcode || OP_PRINT == opcode || OP_PRINTI == opcode;
+    }
+
+public:
+    // Registers read by an instruction and the register it writes (-1 for none)
+    static void operandsOf(const BytecodeProgram& program, const Instruction& instruction, vector<int>& uses, int& definition) {
+        uses.clear();
+        definition = -1;
+        switch (instruction.opcode) {
+            case OP_CONST:
+                definition = instruction.a;
+                break;
+            case OP_MOVE: case OP_ADD_IMM: case OP_MUL_IMM: case OP_DIV_IMM: case OP_TRUNC_BYTE:
+                definition = instruction.a;
+                uses.push_back(instruction.b);
+                break;
+            case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV:
+            case OP_ADD_BYTE: case OP_SUB_BYTE: case OP_MUL_BYTE: case OP_DIV_BYTE:
+                definition = instruction.a;
+                uses.push_back(instruction.b);
+                uses.push_back(instruction.c);
+                break;
+            case OP_JUMP_ZERO: case OP_JUMP_NONZERO: case OP_RETURN: case OP_PRINTI:
+            case OP_JUMP_EQ_IMM: case OP_JUMP_NE_IMM: case OP_JUMP_LT_IMM:
+            case OP_JUMP_GT_IMM: case OP_JUMP_LE_IMM: case OP_JUMP_GE_IMM:
+                uses.push_back(instruction.a);
+                break;
+            case OP_JUMP_EQ: case OP_JUMP_NE: case OP_JUMP_LT: case OP_JUMP_GT: case OP_JUMP_LE: case OP_JUMP_GE:
+                uses.push_back(instruction.a);
+                uses.push_back(instruction.b);
+                break;
+            case OP_CALL:
+                definition = instruction.a;
+                for (int i = 0; i < program.functions[instruction.b].parameters; ++i) {
+                    uses.push_back(instruction.c + i);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    // Instructions that may run after an instruction
+    static vector<size_t> successorsOf(const Instruction& instruction, size_t position) {
+        switch (instruction.opcode) {
+            case OP_JUMP:
+                return {static_cast<size_t>(instruction.a)};
+            case OP_JUMP_ZERO: case OP_JUMP_NONZERO:
+                return {position + 1, static_cast<size_t>(instruction.b)};
+            case OP_JUMP_EQ: case OP_JUMP_NE: case OP_JUMP_LT: case OP_JUMP_GT: case OP_JUMP_LE: case OP_JUMP_GE:
+            case OP_JUMP_EQ_IMM: case OP_JUMP_NE_IMM: case OP_JUMP_LT_IMM:
+            case OP_JUMP_GT_IMM: case OP_JUMP_LE_IMM: case OP_JUMP_GE_IMM:
+                return {position + 1, static_cast<size_t>(instruction.c)};
+            case OP_RETURN: case OP_RETURN_VOID:
+                return {};
+            default:
+                return {position + 1};
+        }
+    }
+
+    LinearScanAllocator(int calleeSaved, int machineRegisters)
+        : calleeSaved(calleeSaved), machineRegisters(machineRegisters) {}
+
+    void allocate(const BytecodeProgram& program, size_t function) {
+        const BytecodeFunction& compiled = program.functions[function];
+        const size_t entry = compiled.entry;
+        const size_t count = program.functionEnd(function) - entry;
+        const size_t words = (compiled.frameSize + 63) / 64;
+
+        // Live-in sets per instruction, until nothing changes
+        vector<vector<int>> uses(count);
+        vector<int> definitions(count);
+        vector<vector<size_t>> successors(count);
+        for (size_t i = 0; i < count; ++i) {
+            operandsOf(program, program.code[entry + i], uses[i], definitions[i]);
+            for (size_t successor : successorsOf(program.code[entry + i], entry + i)) {
+                successors[i].push_back(successor - entry);
+            }
+        }
+        vector<vector<uint64_t>> liveIn(count, vector<uint64_t>(words, 0));
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (size_t i = count; i-- > 0;) {
+                vector<uint64_t> live(words, 0);
+                for (size_t successor : successors[i]) {
+                    if (successor < count) {
+                        for (size_t w = 0; w < words; ++w) {
+                            live[w] |= liveIn[successor][w];
+                        }
+                    }
+                }
+                if (definitions[i] >= 0) {
+                    live[definitions[i] / 64] &= ~(uint64_t(1) << (definitions[i] % 64));
+                }
+                for (int used : uses[i]) {
+                    live[used / 64] |= uint64_t(1) << (used % 64);
+                }
+                if (live != liveIn[i]) {
+                    liveIn[i] = live;
+                    changed = true;
+                }
+            }
+        }
+
+        vector<LiveInterval> intervals(compiled.frameSize);
+        vector<bool> seen(compiled.frameSize, false);
+        auto extend = [&](int bytecodeRegister, int position) {
+            LiveInterval& interval = intervals[bytecodeRegister];
+            if (!seen[bytecodeRegister]) {
+                seen[bytecodeRegister] = true;
+                interval.bytecodeRegister = bytecodeRegister;
+                interval.start = interval.end = position;
+            }
+            interval.start = min(interval.start, position);
+            interval.end = max(interval.end, position);
+        };
+        for (size_t i = 0; i < count; ++i) {
+            for (int r = 0; r < compiled.frameSize; ++r) {
+                if (liveIn[i][r / 64] >> (r % 64) & 1) {
+                    extend(r, i);
+                }
+            }
+            if (definitions[i] >= 0) {
+                extend(definitions[i], i);
+            }
+        }
+        // Parameters live at the entry are written by the prologue
+        liveParameters.assign(compiled.parameters, false);
+        for (int r = 0; r < compiled.parameters; ++r) {
+            if (count && seen[r] && (liveIn[0][r / 64] >> (r % 64) & 1)) {
+                intervals[r].start = -1;
+                liveParameters[r] = true;
+            }
+        }
+
+        vector<LiveInterval> ordered;
+        for (int r = 0; r < compiled.frameSize; ++r) {
+            if (seen[r]) {
+                for (size_t i = 0; i < count; ++i) {
+                    const int position = static_cast<int>(i);
+                    if (isCall(program.code[entry + i].opcode) && intervals[r].start < position && position < intervals[r].end) {
+                        intervals[r].crossesCall = true;
+                        break;
+                    }
+                }
+                ordered.push_back(intervals[r]);
+            }
+        }
+        sort(ordered.begin(), ordered.end(), [](const LiveInterval& x, const LiveInterval& y) {
+            return x.start < y.start || (x.start == y.start && x.bytecodeRegister < y.bytecodeRegister);
+        });
+
+        locations.assign(compiled.frameSize, Location());
+        usedRegisters.assign(machineRegisters, false);
+        stackSlots = 0;
+        vector<const LiveInterval*> active;
+        vector<bool> freeRegisters(machineRegisters, true);
+        auto spill = [&](int bytecodeRegister) {
+            locations[bytecodeRegister].kind = Location::STACK_SLOT;
+            locations[bytecodeRegister].index = stackSlots++;
+        };
+        for (const LiveInterval& interval : ordered) {
+            // An interval ending where this one starts only reads its register before this one writes it
+            for (auto it = active.begin(); it != active.end();) {
+                if ((*it)->end <= interval.start) {
+                    freeRegisters[locations[(*it)->bytecodeRegister].index] = true;
+                    it = active.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+
+            // Caller-saved registers first, they cost no save and restore in the prologue
+            int chosen = -1;
+            for (int m = machineRegisters - 1; m >= 0 && chosen < 0; --m) {
+                if (freeRegisters[m] && (m < calleeSaved || !interval.crossesCall)) {
+                    chosen = m;
+                }
+            }
+            if (chosen < 0) {
+                const LiveInterval* victim = nullptr;
+                for (const LiveInterval* candidate : active) {
+                    const int m = locations[candidate->bytecodeRegister].index;
+                    if ((m < calleeSaved || !interval.crossesCall) && (!victim || candidate->end > victim->end)) {
+                        victim = candidate;
+                    }
+                }
+                if (!victim || victim->end <= interval.end) {
+                    spill(interval.bytecodeRegister);
+                    continue;
+                }
+                chosen = locations[victim->bytecodeRegister].index;
+                spill(victim->bytecodeRegister);
+                active.erase(find(active.begin(), active.end(), victim));
+            }
+            freeRegisters[chosen] = false;
+            usedRegisters[chosen] = true;
+            locations[interval.bytecodeRegister].kind = Location::MACHINE_REGISTER;
+            locations[interval.bytecodeRegister].index = chosen;
+            active.push_back(&interval);
+        }
+    }
+
+    const Location& locationOf(int bytecodeRegister) const {
+        return locations[bytecodeRegister];
+    }
+
+    bool isLiveParameter(int parameter) const {
+        return liveParameters[parameter];
+    }
+
+    int getStackSlots() const {
+        return stackSlots;
+    }
+
+    bool isUsed(int machineRegister) const {
+        return usedRegisters[machineRegister];
+    }
+};
+
+#endif // REGISTER_ALLOCATOR_HPP
@@ -0,0 +1,89 @@
+#!/bin/bash
+# Runs every program of Our_Tests and Staff_Tests through one execution path of hw5 and diffs what it
+# prints with the .out file next to it. A .out without a final newline matches an output that ends with one.
+# The .out of a program hw5 rejects holds what lli prints for the diagnostic, nothing, so such a program is
+# not run in any mode.
+#   llvm             hw5 < t.in, run with lli (default)
+#   no-peephole      hw5 --no-peephole, the CFG simplifier without the peephole pass, run with lli
+#   no-cfg-simplify  hw5 --no-cfg-simplify, the peephole pass without the CFG simplifier, run with lli
+#   aot              hw5 --aot, main run at compile time, run with lli
+#   memoize          hw5 --memoize, pure recursive functions cached in tables, run with lli
+#   run              hw5 --run, the AST interpreter in-process
+#   vm               hw5 --vm, the bytecode virtual machine
+#   x86-64           hw5 --target=x86-64, assembled and linked with cc
+#   c                hw5 --target=c, built with cc -std=c99 -O2
+#   llvm-bc          hw5 --target=llvm-bc, run with lli
+#   shards           hw5 --shards=4, the shards linked with llvm-link, run with lli
+# Prints the failing tests and the totals, the exit status is 1 if a test failed.
+# usage: ./run_tests.sh [path to hw5] [mode]
+
+HW5=${1:-./hw5}
+MODE=${2:-llvm}
+TESTS_DIR=$(dirname "$0")
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+# Whether hw5 accepts the program: the LLVM IR starts with a declaration, a diagnostic with its line
+compiles() {
+    ! "$HW5" < "$1" 2> /dev/null | head -n 1 | grep -qE "^(line [0-9]+: |Program has no 'void main\(\)' function)"
+}
+
+# Writes what the program prints in the mode to the file given second
+run_program() {
+    case "$MODE" in
+        llvm)
+            "$HW5" < "$1" > "$WORK_DIR/program.ll" && lli "$WORK_DIR/program.ll" > "$2" ;;
+        no-peephole)
+            "$HW5" --no-peephole < "$1" > "$WORK_DIR/program.ll" && lli "$WORK_DIR/program.ll" > "$2" ;;
+        no-cfg-simplify)
+            "$HW5" --no-cfg-simplify < "$1" > "$WORK_DIR/program.ll" && lli "$WORK_DIR/program.ll" > "$2" ;;
+        aot)
+            "$HW5" --aot < "$1" > "$WORK_DIR/program.ll" && lli "$WORK_DIR/program.ll" > "$2" ;;
+        memoize)
+            "$HW5" --memoize < "$1" > "$WORK_DIR/program.ll" && lli "$WORK_DIR/program.ll" > "$2" ;;
+        run)
+            "$HW5" --run < "$1" > "$2" ;;
+        vm)
+            "$HW5" --vm < "$1" > "$2" ;;
+        x86-64)
+            "$HW5" --target=x86-64 < "$1" > "$WORK_DIR/program.s" \
+                && cc "$WORK_DIR/program.s" -o "$WORK_DIR/program" && "$WORK_DIR/program" > "$2" ;;
+        c)
+            "$HW5" --target=c < "$1" > "$WORK_DIR/program.c" \
+                && cc -std=c99 -O2 "$WORK_DIR/program.c" -o "$WORK_DIR/program" && "$WORK_DIR/program" > "$2" ;;
+        llvm-bc)
+            "$HW5" --target=llvm-bc < "$1" > "$WORK_DIR/program.bc" && lli "$WORK_DIR/program.bc" > "$2" ;;
+        shards)
+            rm -rf "$WORK_DIR/shards"
+            "$HW5" --shards=4 --shard-dir="$WORK_DIR/shards" < "$1" \
+                && llvm-link $(grep -v '^#' "$WORK_DIR/shards/manifest.txt" | cut -f1 | sed "s|^|$WORK_DIR/shards/|") \
+                    -o "$WORK_DIR/program.bc" \
+                && lli "$WORK_DIR/program.bc" > "$2" ;;
+        *)
+            echo "unknown mode '$MODE'" >&2
+            exit 2 ;;
+    esac
+}
+
+passed=0
+failed=0
+start=$(date +%s%N)
+for test in "$TESTS_DIR"/Our_Tests/*.in "$TESTS_DIR"/Staff_Tests/*.in; do
+    expected="${test%.in}.out"
+    [ -f "$expected" ] || continue
+    rm -f "$WORK_DIR/program" "$WORK_DIR/output.txt"
+    if compiles "$test"; then
+        run_program "$test" "$WORK_DIR/output.txt" 2> "$WORK_DIR/errors.txt"
+    else
+        : > "$WORK_DIR/output.txt"
+    fi
+    if [ -f "$WORK_DIR/output.txt" ] && diff -q <(sed -e '$a\' "$expected") "$WORK_DIR/output.txt" > /dev/null; then
+        passed=$((passed + 1))
+    else
+        failed=$((failed + 1))
+        echo "FAIL $test"
+    fi
+done
+milliseconds=$(( ($(date +%s%N) - start) / 1000000 ))
+echo "$MODE: $passed passed, $failed failed in $milliseconds ms"
+[ "$failed" -eq 0 ]
@@ -62,8 +62,8 @@ private:
     int nextParamOffset = -1;
     bool inLoopScope = false;
     std::string scopeName = "";
-    std::string conditionLabel = "";
-    std::string doneLabel = "";
+    Value conditionLabel;
+    Value doneLabel;
     
 
 public:
@@ -108,13 +108,13 @@ public:
         return parent ? parent->getSymbolName(name) : nullptr;
     }
 
-    void setRegNameScope(const std::string& name, const std::string& reg) { 
+    void setRegNameScope(const std::string& name, const Value& reg) { 
         this->getSymbolName(name)->setRegName(reg);
-        printf("Setting reg name for %s to %s\n", name.c_str(), reg.c_str());
+        printf("Setting reg name for %s to %s\n", name.c_str(), reg.str().c_str());
     }
 
-    std::string getRegNameScope(const std::string& name){ 
-        string result = this->getSymbolName(name)->getRegName();
+    Value getRegNameScope(const std::string& name){ 
+        Value result = this->getSymbolName(name)->getRegName();
         printf("Getting reg name for %s\n", name.c_str());
         return result;
     }
@@ -139,20 +139,20 @@ public:
         inLoopScope = isLoopScope;
     }
 
-    void setConditionLabel(const std::string& conditionLabel) {
+    void setConditionLabel(const Value& conditionLabel) {
         this->conditionLabel = conditionLabel;
     }
 
-    std::string getConditionLabel() const {
+    Value getConditionLabel() const {
         //cout << "Getting condition label: " << conditionLabel << endl;
         return conditionLabel;
     }
 
-    void setDoneLabel(const std::string& doneLabel) {
+    void setDoneLabel(const Value& doneLabel) {
         this->doneLabel = doneLabel;
     }
 
-    std::string getDoneLabel() const {
+    Value getDoneLabel() const {
         //cout << "Getting done label: " << doneLabel << endl;
         return doneLabel;
     }
@@ -112,6 +112,7 @@ public:
 
         if (var && var->getSymbolType() == VARIABLE) {
             node.setType(builtInToNodeType(var->getDataType()));
+            node.offset = var->getOffset();
         }
     }
 
@@ -438,7 +439,9 @@ public:
             beginScope();
             if(node.getElse()->getType() == NODE_Statements) {
                 beginScope();
-                node.getElse()->accept(*this);
+            }
+            node.getElse()->accept(*this);
+            if(node.getElse()->getType() == NODE_Statements) {
                 endScope();
             }
             endScope();
@@ -523,6 +526,7 @@ public:
         if (var->getSymbolType() == FUNCTION) {
             errorDefAsFunc(node.getLine(), node.getValueStr());
         }
+        node.id->offset = var->getOffset();
         node.getAssignExp()->accept(*this);
 
         BuiltInType varType = var->getDataType();
@@ -559,6 +563,7 @@ public:
 
         symbolTable.addParameterSymbol(node.getFormalId(), node.getFormalType(), node.getLine());
         Symbol* symbol = symbolTable.getSymbol(node.getFormalId());
+        node.id->offset = symbol->getOffset();
         // printer.emitVar(node.getFormalId(), node.getFormalType(), symbol->getOffset());
     }
 
@@ -37,17 +37,17 @@ RegisterStruct symbolRegister;
 public:
     // Default constructor
     Symbol()
-        : name(""), symbolType(SymbolType::VARIABLE), dataType(BuiltInType::TYPE_ERROR), offset(0), symbolRegister{"0", false} {}
+        : name(""), symbolType(SymbolType::VARIABLE), dataType(BuiltInType::TYPE_ERROR), offset(0), symbolRegister{output::Value(), false} {}
 
     // Constructor for variables
     Symbol(const string& name, SymbolType symbolType, BuiltInType dataType, int offset)
-        : name(name), symbolType(symbolType), dataType(dataType), offset(offset), symbolRegister{"0", false} {}
+        : name(name), symbolType(symbolType), dataType(dataType), offset(offset), symbolRegister{output::Value(), false} {}
 
     // Constructor for functions
     Symbol(const string& name, SymbolType symbolType, BuiltInType dataType,
            const vector<BuiltInType>& paramTypes, const vector<string>& paramNames)
         : name(name), symbolType(symbolType), dataType(dataType),
-          offset(0), parameterTypes(paramTypes), parameterNames(paramNames), symbolRegister{"0", false} {}
+          offset(0), parameterTypes(paramTypes), parameterNames(paramNames), symbolRegister{output::Value(), false} {}
 
     // Getters
     const string& getName() const { return name; }
@@ -61,8 +61,8 @@ public:
     RegisterStruct getRegister(void) { return symbolRegister; }
     void setRegister(const RegisterStruct& regToSet) { symbolRegister = regToSet; }
 
-    void setRegName(const string& reg) { symbolRegister.name = reg; }
-    string getRegName() const { return symbolRegister.name; }
+    void setRegName(const output::Value& reg) { symbolRegister.name = reg; }
+    output::Value getRegName() const { return symbolRegister.name; }
     void setRegZeroState(bool isZero) { symbolRegister.isZero = isZero; }
     bool isRegZero(void) { return symbolRegister.isZero; }
     
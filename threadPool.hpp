@@ -0,0 +1,108 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <cstddef>
+
+using namespace std;
+
+/* ThreadPool class
+ * A fixed set of worker threads that run the jobs of one batch at a time. run(count, job) calls
+ * job(index, worker) once for every index below count and returns when all calls have returned. The
+ * worker number (0 to size() - 1) lets a job use state owned by the thread running it. The calling
+ * thread works as worker 0, so a pool of one thread starts no threads at all.
+ */
+class ThreadPool {
+private:
+    vector<thread> threads;
+    mutex lock;
+    condition_variable started;
+    condition_variable finished;
+    // The batch being run, a new generation wakes the workers
+    function<void(size_t, size_t)> job;
+    size_t jobCount = 0;
+    atomic<size_t> nextJob{0};
+    size_t generation = 0;
+    size_t busyWorkers = 0;
+    bool isStopping = false;
+
+    // Takes jobs of the current batch until none is left
+    void work(size_t worker) {
+        for (size_t index = nextJob++; index < jobCount; index = nextJob++) {
+            job(index, worker);
+        }
+    }
+
+    void workerLoop(size_t worker) {
+        size_t seenGeneration = 0;
+        while (true) {
+            {
+                unique_lock<mutex> guard(lock);
+                started.wait(guard, [&] { return isStopping || generation != seenGeneration; });
+                if (isStopping) {
+                    return;
+                }
+                seenGeneration = generation;
+            }
+            work(worker);
+            {
+                lock_guard<mutex> guard(lock);
+                --busyWorkers;
+            }
+            finished.notify_one();
+        }
+    }
+
+public:
+    explicit ThreadPool(size_t size) {
+        for (size_t worker = 1; worker < size; ++worker) {
+            threads.emplace_back(&ThreadPool::workerLoop, this, worker);
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            lock_guard<mutex> guard(lock);
+            isStopping = true;
+        }
+        started.notify_all();
+        for (thread& worker : threads) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const {
+        return threads.size() + 1;
+    }
+
+    void run(size_t count, const function<void(size_t, size_t)>& batch) {
+        if (threads.empty() || count <= 1) {
+            for (size_t index = 0; index < count; ++index) {
+                batch(index, 0);
+            }
+            return;
+        }
+        {
+            lock_guard<mutex> guard(lock);
+            job = batch;
+            jobCount = count;
+            nextJob = 0;
+            busyWorkers = threads.size();
+            ++generation;
+        }
+        started.notify_all();
+        work(0);
+        unique_lock<mutex> guard(lock);
+        finished.wait(guard, [&] { return 0 == busyWorkers; });
+    }
+};
+
+#endif // THREAD_POOL_HPP
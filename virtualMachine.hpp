@@ -0,0 +1,214 @@
+#ifndef VIRTUAL_MACHINE_HPP
+#define VIRTUAL_MACHINE_HPP
+
+#include "bytecode.hpp"
+#include "interpreter.hpp"
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <cstdint>
+
+using namespace std;
+
+/* VirtualMachine class
+ * Executes a bytecode program with the semantics of the generated code. Before running, every instruction
+ * is translated to the address of its handler (GNU labels as values, supported by g++ and clang), and
+ * each handler jumps straight to the handler of the next instruction instead of returning to a switch.
+ * Frames live on one register stack: a call moves the frame base to the first argument register of the
+ * caller and pushes the return address, the caller frame base and the register receiving the result.
+ */
+class VirtualMachine {
+private:
+    struct ThreadedInstruction {
+        const void* handler;
+        int32_t a;
+        int32_t b;
+        int32_t c;
+    };
+
+    struct Frame {
+        const ThreadedInstruction* returnAddress;
+        size_t base;
+        int32_t result;
+    };
+
+    static constexpr size_t INITIAL_REGISTERS = 1 << 16;
+
+    const BytecodeProgram& program;
+    ostream& output;
+    size_t depthLimit;
+
+public:
+    VirtualMachine(const BytecodeProgram& program, ostream& output, size_t depthLimit)
+        : program(program), output(output), depthLimit(depthLimit) {}
+
+    // Runs main, RUN_OUT_OF_BUDGET when the call depth limit is reached
+    InterpreterStatus run() {
+        static const void* const handlers[OPCODE_COUNT] = {
+            &&op_const, &&op_move,
+            &&op_add, &&op_sub, &&op_mul, &&op_div,
+            &&op_add_imm, &&op_mul_imm, &&op_div_imm,
+            &&op_add_byte, &&op_sub_byte, &&op_mul_byte, &&op_div_byte,
+            &&op_trunc_byte,
+            &&op_jump, &&op_jump_zero, &&op_jump_nonzero,
+            &&op_jump_eq, &&op_jump_ne, &&op_jump_lt, &&op_jump_gt, &&op_jump_le, &&op_jump_ge,
+            &&op_jump_eq_imm, &&op_jump_ne_imm, &&op_jump_lt_imm,
+            &&op_jump_gt_imm, &&op_jump_le_imm, &&op_jump_ge_imm,
+            &&op_call, &&op_return, &&op_return_void,
+            &&op_print, &&op_printi
+        };
+
+        vector<ThreadedInstruction> code;
+        code.reserve(program.code.size());
+        for (const Instruction& instruction : program.code) {
+            code.push_back({handlers[instruction.opcode], instruction.a, instruction.b, instruction.c});
+        }
+        const ThreadedInstruction* const start = code.data();
+        const BytecodeFunction& main = program.functions[program.mainFunction];
+
+        vector<int32_t> registers(max<size_t>(INITIAL_REGISTERS, main.frameSize));
+        vector<Frame> frames;
+        size_t base = 0;
+        int32_t* r = registers.data();
+        const ThreadedInstruction* ip = start + main.entry;
+        int32_t returned = 0;
+
+#define DISPATCH() goto *ip->handler
+#define NEXT() do { ++ip; DISPATCH(); } while (0)
+#define JUMP_IF(condition, target) do { ip = (condition) ? start + (target) : ip + 1; DISPATCH(); } while (0)
+
+        DISPATCH();
+
+    op_const:
+        r[ip->a] = ip->b;
+        NEXT();
+    op_move:
+        r[ip->a] = r[ip->b];
+        NEXT();
+    op_add:
+        r[ip->a] = static_cast<int32_t>(static_cast<uint32_t>(r[ip->b]) + static_cast<uint32_t>(r[ip->c]));
+        NEXT();
+    op_sub:
+        r[ip->a] = static_cast<int32_t>(static_cast<uint32_t>(r[ip->b]) - static_cast<uint32_t>(r[ip->c]));
+        NEXT();
+    op_mul:
+        r[ip->a] = static_cast<int32_t>(static_cast<uint32_t>(r[ip->b]) * static_cast<uint32_t>(r[ip->c]));
+        NEXT();
+    op_div:
+        if (0 == r[ip->c]) {
+            goto division_by_zero;
+        }
+        if (INT32_MIN == r[ip->b] && -1 == r[ip->c]) {
+            return RUN_UNDEFINED;
+        }
+        r[ip->a] = r[ip->b] / r[ip->c];
+        NEXT();
+    op_add_imm:
+        r[ip->a] = static_cast<int32_t>(static_cast<uint32_t>(r[ip->b]) + static_cast<uint32_t>(ip->c));
+        NEXT();
+    op_mul_imm:
+        r[ip->a] = static_cast<int32_t>(static_cast<uint32_t>(r[ip->b]) * static_cast<uint32_t>(ip->c));
+        NEXT();
+    op_div_imm:
+        r[ip->a] = r[ip->b] / ip->c;
+        NEXT();
+    op_add_byte:
+        r[ip->a] = (r[ip->b] + r[ip->c]) & 255;
+        NEXT();
+    op_sub_byte:
+        r[ip->a] = (r[ip->b] - r[ip->c]) & 255;
+        NEXT();
+    op_mul_byte:
+        r[ip->a] = (r[ip->b] * r[ip->c]) & 255;
+        NEXT();
+    op_div_byte:
+        if (0 == r[ip->c]) {
+            goto division_by_zero;
+        }
+        r[ip->a] = (r[ip->b] / r[ip->c]) & 255;
+        NEXT();
+    op_trunc_byte:
+        r[ip->a] = r[ip->b] & 255;
+        NEXT();
+    op_jump:
+        ip = start + ip->a;
+        DISPATCH();
+    op_jump_zero:
+        JUMP_IF(0 == r[ip->a], ip->b);
+    op_jump_nonzero:
+        JUMP_IF(0 != r[ip->a], ip->b);
+    op_jump_eq:
+        JUMP_IF(r[ip->a] == r[ip->b], ip->c);
+    op_jump_ne:
+        JUMP_IF(r[ip->a] != r[ip->b], ip->c);
+    op_jump_lt:
+        JUMP_IF(r[ip->a] < r[ip->b], ip->c);
+    op_jump_gt:
+        JUMP_IF(r[ip->a] > r[ip->b], ip->c);
+    op_jump_le:
+        JUMP_IF(r[ip->a] <= r[ip->b], ip->c);
+    op_jump_ge:
+        JUMP_IF(r[ip->a] >= r[ip->b], ip->c);
+    op_jump_eq_imm:
+        JUMP_IF(r[ip->a] == ip->b, ip->c);
+    op_jump_ne_imm:
+        JUMP_IF(r[ip->a] != ip->b, ip->c);
+    op_jump_lt_imm:
+        JUMP_IF(r[ip->a] < ip->b, ip->c);
+    op_jump_gt_imm:
+        JUMP_IF(r[ip->a] > ip->b, ip->c);
+    op_jump_le_imm:
+        JUMP_IF(r[ip->a] <= ip->b, ip->c);
+    op_jump_ge_imm:
+        JUMP_IF(r[ip->a] >= ip->b, ip->c);
+    op_call: {
+        if (frames.size() >= depthLimit) {
+            return RUN_OUT_OF_BUDGET;
+        }
+        const BytecodeFunction& callee = program.functions[ip->b];
+        frames.push_back({ip + 1, base, ip->a});
+        base += ip->c;
+        if (base + callee.frameSize > registers.size()) {
+            registers.resize(max(2 * registers.size(), base + callee.frameSize));
+        }
+        r = registers.data() + base;
+        ip = start + callee.entry;
+        DISPATCH();
+    }
+    op_return:
+        returned = r[ip->a];
+        goto return_to_caller;
+    op_return_void:
+        returned = 0;
+        goto return_to_caller;
+    op_print:
+        output << program.strings[ip->a] << '\n';
+        NEXT();
+    op_printi:
+        output << r[ip->a] << '\n';
+        NEXT();
+
+    return_to_caller: {
+        if (frames.empty()) {
+            return RUN_FINISHED;
+        }
+        const Frame frame = frames.back();
+        frames.pop_back();
+        base = frame.base;
+        r = registers.data() + base;
+        r[frame.result] = returned;
+        ip = frame.returnAddress;
+        DISPATCH();
+    }
+    division_by_zero:
+        output << "Error division by zero\n";
+        return RUN_EXITED;
+
+#undef JUMP_IF
+#undef NEXT
+#undef DISPATCH
+    }
+};
+
+#endif // VIRTUAL_MACHINE_HPP